@@ -14,34 +14,100 @@
  *   make codec_benchmark
  * 
  * Usage:
- *   ./codec_benchmark
+ *   ./codec_benchmark [rkmpp|software|native|simulated|turbojpeg] [strips] [quant tables]
+ * 
+ *   The optional argument selects the encoder backend (default: rkmpp).
+ *   "software" uses the libavcodec mjpeg encoder and runs on x86.
+ *   "native" uses the built-in SIMD JPEG encoder (no codec needed).
+ *   "simulated" times frames like the MPP encoder (default model) and runs on x86.
+ *   "turbojpeg" encodes and decodes with libjpeg-turbo (make TURBOJPEG=1).
+ *   strips (1-32, default 1) splits the single-frame encode into parallel
+ *   restart-interval strips (native) or slice threads (software).
+ *   quant tables (JPEG or text file, see read_quant_tables_from_file()) is
+ *   compared against the standard and flat tables at the 3:1 size target.
  */
 
+#define _GNU_SOURCE  // memfd_create
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <math.h>
 
 #include "nv12_mjpeg_codec.h"
 
 // Constants
 #define WIDTH 1600
 #define HEIGHT 1200
-#define ENCODE_QUALITY 98  // QP=98 for testing
+#define ENCODE_QUALITY 98  // q_factor 98 (1-99, higher is better) for testing
 #define INPUT_YUV_FILE "test_data/video22_1.yuv"
 #define OUTPUT_MJPEG_FILE "output_test.mjpeg"
 #define OUTPUT_DECODED_YUV_FILE "output_decoded.yuv"
 #define CONTINUOUS_FRAMES 100  // Number of frames for continuous encoding test
+#define CAMERA_STRIDE ((WIDTH + 255) & ~255)  // Row pitch of the simulated camera buffers
+#define QUANT_TABLE_FRAMES 20  // Frames per quantization table set at the size target
+#define SLOT_RECORDING_FRAMES 16  // Slots in the in-memory fixed-size recording
+#define DEDUP_FRAMES 30  // Frames per deduplication mode
+#define FAILOVER_INTERVAL 10  // Frames between injected codec faults
+#define BATCH_FRAMES 8  // Frames per encoder_encode_batch() call
+
+// ============================================================================
+// Helper Functions
+// ============================================================================
+
+// Map command-line backend name to encoder backend
+static int parse_backend(const char* name, NV12MJPEGBackend* backend) {
+    if (strcmp(name, "rkmpp") == 0) {
+        *backend = NV12_MJPEG_BACKEND_RKMPP;
+    } else if (strcmp(name, "software") == 0) {
+        *backend = NV12_MJPEG_BACKEND_SOFTWARE;
+    } else if (strcmp(name, "native") == 0) {
+        *backend = NV12_MJPEG_BACKEND_NATIVE;
+    } else if (strcmp(name, "simulated") == 0) {
+        *backend = NV12_MJPEG_BACKEND_SIMULATED;
+    } else if (strcmp(name, "turbojpeg") == 0) {
+        *backend = NV12_MJPEG_BACKEND_TURBOJPEG;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// PSNR over all NV12 samples (Y and interleaved UV)
+static double nv12_psnr(const uint8_t* a, const uint8_t* b, size_t size) {
+    double sse = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        int d = (int)a[i] - (int)b[i];
+        sse += d * d;
+    }
+    if (sse == 0.0) {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 * size / sse);
+}
 
 // ============================================================================
 // Main Function
 // ============================================================================
 
-int main(void) {
+int main(int argc, char** argv) {
     int ret;
     uint64_t start_time, end_time;
     double encode_time_ms, decode_time_ms;
     size_t mjpeg_size;
+    const char* backend_name = argc > 1 ? argv[1] : "rkmpp";
+    int strips = argc > 2 ? atoi(argv[2]) : 1;
+    NV12MJPEGBackend backend;
+    
+    if (parse_backend(backend_name, &backend) < 0) {
+        fprintf(stderr, "Unknown backend: %s (expected rkmpp, software, native, simulated or turbojpeg)\n", backend_name);
+        return 1;
+    }
     
     printf("=================================================================\n");
     printf("FFmpeg-Rockchip NV12 ↔ MJPEG Codec Benchmark (New Memory API)\n");
@@ -49,7 +115,9 @@ int main(void) {
     printf("Resolution: %dx%d\n", WIDTH, HEIGHT);
     printf("Input YUV:  %s\n", INPUT_YUV_FILE);
     printf("Output Decoded YUV: %s\n", OUTPUT_DECODED_YUV_FILE);
-    printf("Quality: QP=%d\n", ENCODE_QUALITY);
+    printf("Quality: %d\n", ENCODE_QUALITY);
+    printf("Encoder backend: %s\n", backend_name);
+    printf("Strips: %d\n", strips);
     printf("=================================================================\n\n");
     
     // ========================================================================
@@ -92,16 +160,27 @@ int main(void) {
     
     printf("[3/6] Creating encoder and decoder contexts...\n");
     
-    NV12MJPEGEncoder* encoder = encoder_create(WIDTH, HEIGHT, ENCODE_QUALITY);
+    NV12MJPEGEncoderOptions enc_opts;
+    encoder_options_init(&enc_opts, WIDTH, HEIGHT, ENCODE_QUALITY);
+    enc_opts.backend = backend;
+    enc_opts.strips = strips;
+    // The pool keeps an encoder per CPU open next to the other tests' encoders
+    enc_opts.simulation.max_sessions = (int)sysconf(_SC_NPROCESSORS_ONLN) + 16;
+    
+    NV12MJPEGEncoder* encoder = encoder_create_with_options(&enc_opts);
     if (!encoder) {
         fprintf(stderr, "Failed to create encoder\n");
         free_nv12_buffer(input_nv12);
         free_nv12_buffer(decoded_nv12);
         return 1;
     }
-    printf("  ✓ Encoder created (mjpeg_rkmpp, %dx%d, QP=%d)\n", WIDTH, HEIGHT, ENCODE_QUALITY);
+    printf("  ✓ Encoder created (%s, %dx%d, quality %d)\n", backend_name, WIDTH, HEIGHT, ENCODE_QUALITY);
     
-    NV12MJPEGDecoder* decoder = decoder_create();
+    // The turbojpeg backend decodes with libjpeg-turbo too
+    NV12MJPEGDecoderBackend decoder_backend = backend == NV12_MJPEG_BACKEND_TURBOJPEG ?
+        NV12_MJPEG_DECODER_TURBOJPEG : NV12_MJPEG_DECODER_SOFTWARE;
+    const char* decoder_name = decoder_backend == NV12_MJPEG_DECODER_TURBOJPEG ? "turbojpeg" : "mjpeg";
+    NV12MJPEGDecoder* decoder = decoder_create_with_backend(decoder_backend);
     if (!decoder) {
         fprintf(stderr, "Failed to create decoder\n");
         encoder_destroy(encoder);
@@ -109,7 +188,7 @@ int main(void) {
         free_nv12_buffer(decoded_nv12);
         return 1;
     }
-    printf("  ✓ Decoder created (mjpeg_rkmpp)\n\n");
+    printf("  ✓ Decoder created (%s)\n\n", decoder_name);
     
     // Allocate MJPEG buffer (in memory, not saved to file)
     size_t mjpeg_buffer_size = encoder_max_output_size(encoder);
@@ -146,6 +225,15 @@ int main(void) {
     
     encode_time_ms = (double)(end_time - start_time) / 1000000.0;
     
+    NV12MJPEGEncoderStats enc_stats;
+    if (encoder_get_stats(encoder, &enc_stats) == 0 && enc_stats.num_strips > 1) {
+        printf("  Per-strip encode time:");
+        for (int i = 0; i < enc_stats.num_strips; i++) {
+            printf(" %.2f", enc_stats.strip_encode_ms[i]);
+        }
+        printf(" ms\n");
+    }
+    
     // Write MJPEG to file for verification
     FILE* mjpeg_file = fopen(OUTPUT_MJPEG_FILE, "wb");
     if (mjpeg_file) {
@@ -246,12 +334,772 @@ int main(void) {
         total_decode_time += (end_time - start_time);
     }
     
+    // Decoder comparison: the last frame through the mjpeg and the TurboJPEG decoder
+    uint64_t total_cmp_decode_time[2] = {0, 0};
+    int decode_cmp_frames = 0;
+    double decode_cmp_psnr = 0.0;
+    NV12MJPEGDecoder* cmp_decoders[2] = {
+        decoder_create_with_backend(NV12_MJPEG_DECODER_SOFTWARE),
+        decoder_create_with_backend(NV12_MJPEG_DECODER_TURBOJPEG)
+    };
+    uint8_t* cmp_nv12 = alloc_nv12_buffer(WIDTH, HEIGHT);
+    int decode_cmp_available = cmp_decoders[0] && cmp_decoders[1] && cmp_nv12;
+    if (decode_cmp_available) {
+        for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+            for (int d = 0; d < 2; d++) {
+                start_time = get_time_ns();
+                ret = decoder_decode_from_buffer(cmp_decoders[d], mjpeg_buffer, mjpeg_size,
+                                                 d ? cmp_nv12 : decoded_nv12, nv12_frame_size(WIDTH, HEIGHT),
+                                                 &decoded_width, &decoded_height);
+                end_time = get_time_ns();
+                if (ret < 0) {
+                    break;
+                }
+                total_cmp_decode_time[d] += (end_time - start_time);
+            }
+            if (ret < 0) {
+                fprintf(stderr, "Failed to decode frame %d (decoder comparison)\n", i);
+                break;
+            }
+            decode_cmp_frames++;
+        }
+        if (decode_cmp_frames > 0) {
+            decode_cmp_psnr = nv12_psnr(decoded_nv12, cmp_nv12, nv12_frame_size(WIDTH, HEIGHT));
+        }
+    }
+    free_nv12_buffer(cmp_nv12);
+    decoder_destroy(cmp_decoders[0]);
+    decoder_destroy(cmp_decoders[1]);
+    
+    // Zero-copy input path: same frames, encoder wraps the input buffer
+    uint64_t total_zero_copy_time = 0;
+    for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+        start_time = get_time_ns();
+        ret = encoder_encode_zero_copy(encoder, input_nv12, NULL, NULL,
+                                       mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+        end_time = get_time_ns();
+        
+        if (ret < 0) {
+            fprintf(stderr, "Failed to encode frame %d (zero-copy)\n", i);
+            break;
+        }
+        total_zero_copy_time += (end_time - start_time);
+    }
+    
+    // fd input: a memfd stands in for a camera dma-buf (padded rows, separate chroma
+    // offset); compared against mapping it and repacking into a contiguous buffer
+    uint64_t total_fd_time = 0;
+    uint64_t total_repack_time = 0;
+    int fd_frames = 0;
+    size_t camera_size = (size_t)CAMERA_STRIDE * HEIGHT * 3 / 2;
+    int camera_fd = memfd_create("nv12_camera", 0);
+    uint8_t* camera_map = MAP_FAILED;
+    if (camera_fd >= 0 && ftruncate(camera_fd, camera_size) == 0) {
+        camera_map = (uint8_t*)mmap(NULL, camera_size, PROT_READ | PROT_WRITE, MAP_SHARED, camera_fd, 0);
+    }
+    if (camera_map != MAP_FAILED) {
+        for (int y = 0; y < HEIGHT * 3 / 2; y++) {
+            memcpy(camera_map + (size_t)y * CAMERA_STRIDE, input_nv12 + (size_t)y * WIDTH, WIDTH);
+        }
+        NV12FrameFd camera_frame = {0};
+        camera_frame.fd = camera_fd;
+        camera_frame.y_stride = CAMERA_STRIDE;
+        camera_frame.uv_offset = (size_t)CAMERA_STRIDE * HEIGHT;
+        camera_frame.uv_stride = CAMERA_STRIDE;
+        for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+            // Pointer path: copy the padded rows into the contiguous layout first
+            start_time = get_time_ns();
+            for (int y = 0; y < HEIGHT * 3 / 2; y++) {
+                memcpy(decoded_nv12 + (size_t)y * WIDTH, camera_map + (size_t)y * CAMERA_STRIDE, WIDTH);
+            }
+            ret = encoder_encode_to_buffer(encoder, decoded_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+            end_time = get_time_ns();
+            if (ret < 0) {
+                fprintf(stderr, "Failed to encode frame %d (repack)\n", i);
+                break;
+            }
+            total_repack_time += (end_time - start_time);
+            
+            start_time = get_time_ns();
+            ret = encoder_encode_fd(encoder, &camera_frame, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+            end_time = get_time_ns();
+            if (ret < 0) {
+                fprintf(stderr, "Failed to encode frame %d (fd)\n", i);
+                break;
+            }
+            total_fd_time += (end_time - start_time);
+            fd_frames++;
+        }
+        encoder_release_fd(encoder, camera_fd);
+        munmap(camera_map, camera_size);
+    } else {
+        fprintf(stderr, "Warning: Failed to create memfd frame buffer\n");
+    }
+    if (camera_fd >= 0) {
+        close(camera_fd);
+    }
+    
+    // Quality ladder (archive/live/low bandwidth): one multi-quality encode against
+    // one encoder per quality. Qualities use the same 1-99 scale on every backend
+    // (the software backend encodes these at qscale 1, 4 and 10).
+    static const int ladder_qualities[3] = {ENCODE_QUALITY, 75, 40};
+    uint64_t total_ladder_time = 0;
+    uint64_t total_ladder_separate_time = 0;
+    int ladder_frames = 0;
+    uint8_t* ladder_buffers[3] = {NULL, NULL, NULL};
+    size_t ladder_sizes[3] = {mjpeg_buffer_size, mjpeg_buffer_size, mjpeg_buffer_size};
+    size_t ladder_out[3];
+    size_t ladder_rung_sizes[3] = {0, 0, 0};
+    NV12MJPEGEncoder* ladder_encoders[3] = {NULL, NULL, NULL};
+    int ladder_ok = 1;
+    for (int q = 0; q < 3; q++) {
+        NV12MJPEGEncoderOptions ladder_opts = enc_opts;
+        ladder_opts.quality = ladder_qualities[q];
+        ladder_opts.verbose = 0;
+        ladder_buffers[q] = (uint8_t*)malloc(mjpeg_buffer_size);
+        ladder_encoders[q] = encoder_create_with_options(&ladder_opts);
+        ladder_ok = ladder_ok && ladder_buffers[q] && ladder_encoders[q];
+    }
+    for (int i = 0; ladder_ok && i < CONTINUOUS_FRAMES; i++) {
+        start_time = get_time_ns();
+        ret = encoder_encode_multi_quality(encoder, input_nv12, ladder_qualities, 3,
+                                           ladder_buffers, ladder_sizes, ladder_out);
+        end_time = get_time_ns();
+        if (ret < 0) {
+            fprintf(stderr, "Failed to encode frame %d (multi-quality)\n", i);
+            break;
+        }
+        total_ladder_time += (end_time - start_time);
+        memcpy(ladder_rung_sizes, ladder_out, sizeof(ladder_rung_sizes));
+        
+        start_time = get_time_ns();
+        for (int q = 0; q < 3 && ret == 0; q++) {
+            ret = encoder_encode_to_buffer(ladder_encoders[q], input_nv12, ladder_buffers[q],
+                                           ladder_sizes[q], &ladder_out[q]);
+        }
+        end_time = get_time_ns();
+        if (ret < 0) {
+            fprintf(stderr, "Failed to encode frame %d (one encoder per quality)\n", i);
+            break;
+        }
+        total_ladder_separate_time += (end_time - start_time);
+        ladder_frames++;
+    }
+    for (int q = 0; q < 3; q++) {
+        encoder_destroy(ladder_encoders[q]);
+        free(ladder_buffers[q]);
+    }
+    // Each rung must be a different trade-off: sizes strictly decreasing with quality
+    int ladder_distinct = ladder_rung_sizes[0] > ladder_rung_sizes[1] && ladder_rung_sizes[1] > ladder_rung_sizes[2];
+    if (ladder_frames > 0 && !ladder_distinct) {
+        fprintf(stderr, "Warning: quality ladder rungs are not distinct (%zu/%zu/%zu bytes)\n",
+                ladder_rung_sizes[0], ladder_rung_sizes[1], ladder_rung_sizes[2]);
+    }
+    
+    // Optimized Huffman tables: per-frame (two passes) and streamed (window of
+    // previous frames) against the standard tables of the main encoder
+    uint64_t total_huff_time[2] = {0, 0};
+    uint64_t total_huff_bytes[3] = {0, 0, 0};
+    int huff_frames = 0;
+    NV12MJPEGEncoder* huff_encoders[2];
+    for (int m = 0; m < 2; m++) {
+        NV12MJPEGEncoderOptions huff_opts = enc_opts;
+        huff_opts.huffman = m == 0 ? NV12_MJPEG_HUFFMAN_FRAME : NV12_MJPEG_HUFFMAN_STREAM;
+        huff_opts.verbose = 0;
+        huff_encoders[m] = encoder_create_with_options(&huff_opts);
+    }
+    for (int i = 0; huff_encoders[0] && huff_encoders[1] && i < CONTINUOUS_FRAMES; i++) {
+        ret = encoder_encode_to_buffer(encoder, input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+        for (int m = 0; m < 2 && ret == 0; m++) {
+            total_huff_bytes[0] += m == 0 ? mjpeg_size : 0;
+            start_time = get_time_ns();
+            ret = encoder_encode_to_buffer(huff_encoders[m], input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+            end_time = get_time_ns();
+            total_huff_time[m] += (end_time - start_time);
+            total_huff_bytes[m + 1] += mjpeg_size;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "Failed to encode frame %d (optimized Huffman tables)\n", i);
+            break;
+        }
+        huff_frames++;
+    }
+    NV12MJPEGEncoderStats huff_stats = {0};
+    if (huff_encoders[1]) {
+        encoder_get_stats(huff_encoders[1], &huff_stats);
+    }
+    encoder_destroy(huff_encoders[0]);
+    encoder_destroy(huff_encoders[1]);
+    
+    // Refcounted packets: one encode shared by several sinks without output copies
+    uint64_t total_packet_time = 0;
+    for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+        NV12MJPEGPacket* pkt = NULL;
+        start_time = get_time_ns();
+        ret = encoder_encode_packet(encoder, input_nv12, &pkt);
+        if (ret < 0) {
+            fprintf(stderr, "Failed to encode frame %d (packet)\n", i);
+            break;
+        }
+        NV12MJPEGPacket* file_sink = nv12_mjpeg_packet_ref(pkt);
+        NV12MJPEGPacket* net_sink = nv12_mjpeg_packet_ref(pkt);
+        nv12_mjpeg_packet_release(&pkt);
+        nv12_mjpeg_packet_release(&file_sink);
+        nv12_mjpeg_packet_release(&net_sink);
+        end_time = get_time_ns();
+        total_packet_time += (end_time - start_time);
+    }
+    
+    // Size-targeted rate control: hit the 3:1 ratio of target.md in one pass where possible
+    NV12MJPEGEncoderStats rc_stats = {0};
+    uint64_t rc_retries_before = 0;
+    int rc_frames = 0;
+    double rc_ratio_sum = 0.0;
+    if (encoder_get_stats(encoder, &rc_stats) == 0 && encoder_set_target_ratio(encoder, 3.0) == 0) {
+        rc_retries_before = rc_stats.rc_retries;
+        for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+            ret = encoder_encode_to_buffer(encoder, input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+            if (ret < 0) {
+                fprintf(stderr, "Failed to encode frame %d (size target)\n", i);
+                break;
+            }
+            encoder_get_stats(encoder, &rc_stats);
+            rc_ratio_sum += rc_stats.last_compression_ratio;
+            rc_frames++;
+        }
+        encoder_set_target_size(encoder, 0);
+    }
+    
+    // Quantization tables at the 3:1 target: the better set keeps more PSNR at the same size
+    const char* quant_names[3] = {"standard", "flat 16", argc > 3 ? argv[3] : NULL};
+    uint8_t quant_tables[3][2][64];
+    int quant_sets = 0;
+    size_t quant_bytes[3] = {0};
+    double quant_psnr[3] = {0.0};
+    uint64_t quant_time[3] = {0};
+    memset(quant_tables[1], 16, sizeof(quant_tables[1]));
+    int num_quant = quant_names[2] && read_quant_tables_from_file(quant_names[2], quant_tables[2][0],
+                                                                   quant_tables[2][1]) == 0 ? 3 : 2;
+    if (encoder_set_quant_tables(encoder, NULL, NULL) == 0) {
+        for (quant_sets = 0; quant_sets < num_quant; quant_sets++) {
+            int q = quant_sets;
+            if (encoder_set_quant_tables(encoder, q ? quant_tables[q][0] : NULL, q ? quant_tables[q][1] : NULL) < 0 ||
+                encoder_set_target_ratio(encoder, 3.0) < 0) {
+                break;
+            }
+            for (int i = 0; i < QUANT_TABLE_FRAMES; i++) {
+                start_time = get_time_ns();
+                ret = encoder_encode_to_buffer(encoder, input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+                end_time = get_time_ns();
+                if (ret < 0) {
+                    fprintf(stderr, "Failed to encode frame %d (%s tables)\n", i, quant_names[q]);
+                    break;
+                }
+                quant_time[q] += end_time - start_time;
+                quant_bytes[q] += mjpeg_size;
+            }
+            if (ret < 0 || decoder_decode_from_buffer(decoder, mjpeg_buffer, mjpeg_size,
+                                                      decoded_nv12, nv12_frame_size(WIDTH, HEIGHT),
+                                                      &decoded_width, &decoded_height) < 0) {
+                break;
+            }
+            quant_psnr[q] = nv12_psnr(input_nv12, decoded_nv12, nv12_size);
+        }
+        encoder_set_target_size(encoder, 0);
+        encoder_set_quant_tables(encoder, NULL, NULL);
+    }
+    
+    // Constant-size slots at 3:1: a recording seekable by frame number without an index
+    size_t slot_size = nv12_size / 3;
+    uint8_t* recording = (uint8_t*)malloc(slot_size * SLOT_RECORDING_FRAMES);
+    NV12MJPEGEncoderStats slot_stats = {0};
+    uint64_t total_slot_time = 0;
+    uint64_t slot_padding_before = 0;
+    int slot_frames = 0;
+    int slot_seek_ok = 0;
+    if (recording && encoder_get_stats(encoder, &slot_stats) == 0 && encoder_set_slot_size(encoder, slot_size) == 0) {
+        slot_padding_before = slot_stats.total_slot_padding;
+        for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+            start_time = get_time_ns();
+            ret = encoder_encode_to_buffer(encoder, input_nv12, recording + (i % SLOT_RECORDING_FRAMES) * slot_size,
+                                           slot_size, &mjpeg_size);
+            end_time = get_time_ns();
+            if (ret < 0 || mjpeg_size != slot_size) {
+                fprintf(stderr, "Failed to encode frame %d (slot)\n", i);
+                break;
+            }
+            total_slot_time += end_time - start_time;
+            slot_frames++;
+        }
+        encoder_get_stats(encoder, &slot_stats);
+        encoder_set_slot_size(encoder, 0);
+        
+        // Random access: frame n is at n * slot_size
+        const uint8_t* slot = recording + (SLOT_RECORDING_FRAMES / 2) * slot_size;
+        size_t jpeg_size = nv12_mjpeg_slot_jpeg_size(slot, slot_size);
+        slot_seek_ok = slot_frames >= SLOT_RECORDING_FRAMES && jpeg_size > 0 &&
+                       decoder_decode_from_buffer(decoder, slot, jpeg_size, decoded_nv12, nv12_frame_size(WIDTH, HEIGHT),
+                                                  &decoded_width, &decoded_height) == 0;
+    }
+    free(recording);
+    
+    // Static scene with sensor noise: every other frame differs by +1 in every 64th sample
+    const char* dedup_names[3] = {"exact", "sampled", "threshold 2"};
+    int dedup_hits[3] = {0};
+    uint64_t dedup_time[3] = {0};
+    double dedup_hash_ms[3] = {0.0};
+    int dedup_modes = 0;
+    int motion_modes = 0;
+    int motion_gated[2] = {0};
+    uint64_t motion_time[2] = {0};
+    size_t motion_bytes[2] = {0};
+    double motion_score_max[2] = {0.0};
+    uint8_t* noisy_nv12 = alloc_nv12_buffer(WIDTH, HEIGHT);
+    if (noisy_nv12) {
+        memcpy(noisy_nv12, input_nv12, nv12_size);
+        for (size_t i = 0; i < nv12_size; i += 64) {
+            noisy_nv12[i] += noisy_nv12[i] < 255;
+        }
+        for (dedup_modes = 0; dedup_modes < 3; dedup_modes++) {
+            int m = dedup_modes;
+            NV12MJPEGEncoderStats dedup_stats;
+            if (encoder_set_dedup(encoder, (NV12MJPEGDedup)(NV12_MJPEG_DEDUP_EXACT + m), 2) < 0 ||
+                encoder_get_stats(encoder, &dedup_stats) < 0) {
+                break;
+            }
+            uint64_t hits_before = dedup_stats.dedup_hits;
+            double hash_before = dedup_stats.total_hash_ms;
+            for (int i = 0; i < DEDUP_FRAMES; i++) {
+                start_time = get_time_ns();
+                ret = encoder_encode_to_buffer(encoder, i % 2 ? noisy_nv12 : input_nv12,
+                                               mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+                end_time = get_time_ns();
+                if (ret < 0) {
+                    fprintf(stderr, "Failed to encode frame %d (dedup)\n", i);
+                    break;
+                }
+                dedup_time[m] += end_time - start_time;
+            }
+            encoder_get_stats(encoder, &dedup_stats);
+            dedup_hits[m] = (int)(dedup_stats.dedup_hits - hits_before);
+            dedup_hash_ms[m] = (dedup_stats.total_hash_ms - hash_before) / DEDUP_FRAMES;
+        }
+        encoder_set_dedup(encoder, NV12_MJPEG_DEDUP_OFF, 0);
+        
+        // Same scene gated on motion, with a clock overlay changing every 10th frame
+        uint8_t overlay_saved[32][128];
+        for (int y = 0; y < 32; y++) {
+            memcpy(overlay_saved[y], input_nv12 + (size_t)(y + 16) * WIDTH + 16, 128);
+        }
+        for (motion_modes = 0; motion_modes < 2; motion_modes++) {
+            int m = motion_modes;
+            NV12MJPEGMotionGate gate = {4 * 256, 0.01, m ? NV12_MJPEG_MOTION_REDUCE : NV12_MJPEG_MOTION_SKIP, 50};
+            NV12MJPEGEncoderStats motion_stats;
+            if (encoder_set_motion_gate(encoder, &gate) < 0 || encoder_get_stats(encoder, &motion_stats) < 0) {
+                break;
+            }
+            uint64_t gated_before = motion_stats.motion_skipped + motion_stats.motion_reduced;
+            for (int i = 0; i < DEDUP_FRAMES; i++) {
+                uint8_t* frame = i % 2 ? noisy_nv12 : input_nv12;
+                for (int y = 16; y < 48; y++) {
+                    memset(frame + (size_t)y * WIDTH + 16, (i / 10) % 2 ? 235 : 16, 128);
+                }
+                start_time = get_time_ns();
+                ret = encoder_encode_to_buffer(encoder, frame, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+                end_time = get_time_ns();
+                if (ret < 0) {
+                    fprintf(stderr, "Failed to encode frame %d (motion gate)\n", i);
+                    break;
+                }
+                encoder_get_stats(encoder, &motion_stats);
+                motion_time[m] += end_time - start_time;
+                motion_bytes[m] += mjpeg_size;
+                motion_score_max[m] = motion_stats.last_motion_score > motion_score_max[m] && i > 0 ?
+                                      motion_stats.last_motion_score : motion_score_max[m];
+            }
+            motion_gated[m] = (int)(motion_stats.motion_skipped + motion_stats.motion_reduced - gated_before);
+            encoder_set_motion_gate(encoder, NULL);
+        }
+        for (int y = 0; y < 32; y++) {
+            memcpy(input_nv12 + (size_t)(y + 16) * WIDTH + 16, overlay_saved[y], 128);
+        }
+        free_nv12_buffer(noisy_nv12);
+    }
+    
+    // Per-frame metadata: copy the frame to insert APP/COM segments, or writev() a scatter list
+    char meta_camera[64];
+    char meta_gps[] = "GPS 31.2304N 121.4737E";
+    uint64_t total_meta_copy_time = 0;
+    uint64_t total_meta_scatter_time = 0;
+    int meta_frames = 0;
+    int meta_match = 1;
+    int null_fd = open("/dev/null", O_WRONLY);
+    uint8_t* meta_copy = (uint8_t*)malloc(mjpeg_buffer_size + 2 * 65536);
+    for (int i = 0; i < CONTINUOUS_FRAMES && null_fd >= 0 && meta_copy; i++) {
+        NV12MJPEGPacket* meta_pkt = NULL;
+        NV12MJPEGScatter scatter;
+        snprintf(meta_camera, sizeof(meta_camera), "CAM=front-01;TS=%" PRIu64, get_time_ns());
+        NV12MJPEGSegment segments[2] = {
+            {0xE4, (const uint8_t*)meta_camera, strlen(meta_camera)},
+            {0xFE, (const uint8_t*)meta_gps, sizeof(meta_gps) - 1},
+        };
+        if (encoder_encode_packet(encoder, input_nv12, &meta_pkt) < 0) {
+            fprintf(stderr, "Failed to encode frame %d (metadata)\n", i);
+            break;
+        }
+        
+        // Copy path: SOI (+ JFIF APP0), segments, then the whole rest of the frame
+        start_time = get_time_ns();
+        size_t head = meta_pkt->data[3] == 0xE0 ? 4 + ((meta_pkt->data[4] << 8) | meta_pkt->data[5]) : 2;
+        size_t copy_size = head;
+        memcpy(meta_copy, meta_pkt->data, head);
+        for (int s = 0; s < 2; s++) {
+            size_t length = segments[s].size + 2;
+            uint8_t marker[4] = {0xFF, segments[s].marker, (uint8_t)(length >> 8), (uint8_t)length};
+            memcpy(meta_copy + copy_size, marker, 4);
+            memcpy(meta_copy + copy_size + 4, segments[s].data, segments[s].size);
+            copy_size += 2 + length;
+        }
+        memcpy(meta_copy + copy_size, meta_pkt->data + head, meta_pkt->size - head);
+        copy_size += meta_pkt->size - head;
+        ssize_t written = write(null_fd, meta_copy, copy_size);
+        end_time = get_time_ns();
+        total_meta_copy_time += end_time - start_time;
+        
+        // Scatter path: no copy of the frame
+        start_time = get_time_ns();
+        scatter.iov_count = 0;
+        if (nv12_mjpeg_scatter(meta_pkt->data, meta_pkt->size, segments, 2, &scatter) == 0) {
+            written = writev(null_fd, scatter.iov, scatter.iov_count);
+        }
+        end_time = get_time_ns();
+        total_meta_scatter_time += end_time - start_time;
+        
+        // Both paths produce the same file
+        size_t pos = 0;
+        for (int v = 0; v < scatter.iov_count && i == 0; v++) {
+            meta_match &= pos + scatter.iov[v].iov_len <= copy_size &&
+                          memcmp(meta_copy + pos, scatter.iov[v].iov_base, scatter.iov[v].iov_len) == 0;
+            pos += scatter.iov[v].iov_len;
+        }
+        meta_match &= scatter.iov_count > 0 && written == (ssize_t)copy_size && scatter.total_size == copy_size;
+        nv12_mjpeg_packet_release(&meta_pkt);
+        meta_frames++;
+    }
+    free(meta_copy);
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+    
+    // Failover: a codec error every FAILOVER_INTERVAL frames, recovered by the hot spare
+    // or by destroying and recreating the encoder
+    int failover_frames = 0;
+    int failover_errors = 0;
+    double failover_ms = 0.0;
+    double spare_build_ms = 0.0;
+    double recreate_ms = 0.0;
+    uint64_t failovers = 0;
+    NV12MJPEGEncoderOptions spare_opts = enc_opts;
+    spare_opts.hot_spare = 1;
+    spare_opts.verbose = 0;
+    NV12MJPEGEncoder* spare_encoder = encoder_create_with_options(&spare_opts);
+    if (spare_encoder && encoder_inject_fault(spare_encoder, 0) == 0) {
+        for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+            if (i % FAILOVER_INTERVAL == FAILOVER_INTERVAL - 1) {
+                encoder_inject_fault(spare_encoder, 1);
+            }
+            if (encoder_encode_to_buffer(spare_encoder, input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size) < 0) {
+                failover_errors++;
+            }
+            NV12MJPEGEncoderStats spare_stats;
+            if (encoder_get_stats(spare_encoder, &spare_stats) == 0 && spare_stats.failovers > failovers) {
+                failovers = spare_stats.failovers;
+                failover_ms += spare_stats.last_failover_ms;
+            }
+            failover_frames++;
+        }
+        NV12MJPEGEncoderStats spare_stats;
+        encoder_get_stats(spare_encoder, &spare_stats);
+        spare_build_ms = spare_stats.last_spare_build_ms;
+        
+        // Without a spare: the frame fails, the encoder is recreated and the frame encoded again
+        spare_opts.hot_spare = 0;
+        NV12MJPEGEncoder* plain_encoder = encoder_create_with_options(&spare_opts);
+        if (plain_encoder) {
+            encoder_inject_fault(plain_encoder, 1);
+            start_time = get_time_ns();
+            if (encoder_encode_to_buffer(plain_encoder, input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size) < 0) {
+                encoder_destroy(plain_encoder);
+                plain_encoder = encoder_create_with_options(&spare_opts);
+                if (plain_encoder) {
+                    encoder_encode_to_buffer(plain_encoder, input_nv12, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+                }
+            }
+            end_time = get_time_ns();
+            recreate_ms = (end_time - start_time) / 1000000.0;
+            encoder_destroy(plain_encoder);
+        }
+    }
+    encoder_destroy(spare_encoder);
+    
+    // Asynchronous path: keep the encoder queue full, poll packets in order
+    int async_done = 0;
+    start_time = get_time_ns();
+    for (int i = 0; i < CONTINUOUS_FRAMES || encoder_frames_in_flight(encoder) > 0; ) {
+        if (i == CONTINUOUS_FRAMES && encoder_drain(encoder) < 0) {
+            fprintf(stderr, "Failed to drain encoder\n");
+            break;
+        }
+        if (i < CONTINUOUS_FRAMES) {
+            ret = encoder_submit(encoder, input_nv12, NULL);
+            if (ret == 0) {
+                i++;
+                continue;
+            }
+            if (ret != -EAGAIN) {
+                fprintf(stderr, "Failed to submit frame %d\n", i);
+                break;
+            }
+        }
+        ret = encoder_poll(encoder, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size, NULL, 1000);
+        if (ret < 0) {
+            fprintf(stderr, "Failed to poll frame %d\n", async_done);
+            break;
+        }
+        async_done++;
+    }
+    end_time = get_time_ns();
+    uint64_t total_async_time = end_time - start_time;
+    
+    // Batch path: the same frames in batches, validated once per batch; a batch
+    // must not end the codec session (no flush + reopen per batch)
+    int batch_done = 0;
+    uint64_t total_batch_time = 0;
+    uint64_t batch_reopens = 0;
+    uint8_t* batch_outputs[BATCH_FRAMES];
+    const uint8_t* batch_frames[BATCH_FRAMES];
+    size_t batch_sizes[BATCH_FRAMES];
+    int batch_status[BATCH_FRAMES];
+    int batch_buffers = 0;
+    for (; batch_buffers < BATCH_FRAMES; batch_buffers++) {
+        batch_outputs[batch_buffers] = (uint8_t*)malloc(mjpeg_buffer_size);
+        if (!batch_outputs[batch_buffers]) {
+            break;
+        }
+        batch_frames[batch_buffers] = input_nv12;
+    }
+    if (batch_buffers == BATCH_FRAMES) {
+        encoder_get_stats(encoder, &enc_stats);
+        batch_reopens = enc_stats.session_reopens;
+        start_time = get_time_ns();
+        while (batch_done < CONTINUOUS_FRAMES) {
+            int batch_n = CONTINUOUS_FRAMES - batch_done < BATCH_FRAMES ? CONTINUOUS_FRAMES - batch_done : BATCH_FRAMES;
+            for (int i = 0; i < batch_n; i++) {
+                batch_sizes[i] = mjpeg_buffer_size;
+            }
+            ret = encoder_encode_batch(encoder, batch_frames, batch_n,
+                                       batch_outputs, batch_sizes, batch_status);
+            if (ret != batch_n) {
+                fprintf(stderr, "Failed to encode batch at frame %d (%d of %d frames)\n",
+                        batch_done, ret, batch_n);
+                break;
+            }
+            batch_done += batch_n;
+        }
+        end_time = get_time_ns();
+        total_batch_time = end_time - start_time;
+        encoder_get_stats(encoder, &enc_stats);
+        batch_reopens = enc_stats.session_reopens - batch_reopens;
+    } else {
+        fprintf(stderr, "Warning: Failed to allocate batch output buffers\n");
+    }
+    for (int i = 0; i < batch_buffers; i++) {
+        free(batch_outputs[i]);
+    }
+    
+    // Encoder pool: one instance per CPU, packets received in submission order
+    int pool_done = 0;
+    uint64_t total_pool_time = 0;
+    NV12MJPEGEncoderOptions pool_opts = enc_opts;
+    pool_opts.verbose = 0;
+    NV12MJPEGEncoderPool* pool = encoder_pool_create(&pool_opts, 0, 0);
+    if (pool) {
+        start_time = get_time_ns();
+        for (int i = 0; i < CONTINUOUS_FRAMES || encoder_pool_pending(pool) > 0; ) {
+            if (i < CONTINUOUS_FRAMES && encoder_pool_submit(pool, input_nv12, NULL, NULL, NULL, 0) == 0) {
+                i++;
+                continue;
+            }
+            ret = encoder_pool_receive(pool, mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size, NULL, 1000);
+            if (ret < 0) {
+                fprintf(stderr, "Failed to receive pool frame %d\n", pool_done);
+                break;
+            }
+            pool_done++;
+        }
+        end_time = get_time_ns();
+        total_pool_time = end_time - start_time;
+        encoder_pool_destroy(pool);
+    } else {
+        fprintf(stderr, "Warning: Failed to create encoder pool\n");
+    }
+    
+    // Encoder cache: requests alternating between a few resolutions, compared
+    // against creating and destroying an encoder per request
+    static const int cache_sizes[3][2] = {{WIDTH, HEIGHT}, {1280, 720}, {640, 480}};
+    NV12MJPEGEncoderCacheStats cache_stats = {0};
+    uint64_t total_cached_time = 0;
+    uint64_t total_uncached_time = 0;
+    int cache_requests = 0;
+    NV12MJPEGEncoderCache* cache = encoder_cache_create(&pool_opts, 0);
+    if (cache) {
+        for (int i = 0; i < CONTINUOUS_FRAMES; i++) {
+            int w = cache_sizes[i % 3][0];
+            int h = cache_sizes[i % 3][1];
+            start_time = get_time_ns();
+            ret = encoder_cache_encode(cache, input_nv12, w, h, ENCODE_QUALITY,
+                                       mjpeg_buffer, mjpeg_buffer_size, &mjpeg_size);
+            end_time = get_time_ns();
+            if (ret < 0) {
+                fprintf(stderr, "Failed to encode request %d (cache)\n", i);
+                break;
+            }
+            total_cached_time += (end_time - start_time);
+            
+            NV12MJPEGEncoderOptions request_opts = pool_opts;
+            request_opts.width = w;
+            request_opts.height = h;
+            start_time = get_time_ns();
+            NV12MJPEGEncoder* request_encoder = encoder_create_with_options(&request_opts);
+            ret = request_encoder ? encoder_encode_to_buffer(request_encoder, input_nv12, mjpeg_buffer,
+                                                             mjpeg_buffer_size, &mjpeg_size) : -ENOMEM;
+            encoder_destroy(request_encoder);
+            end_time = get_time_ns();
+            if (ret < 0) {
+                fprintf(stderr, "Failed to encode request %d (create per request)\n", i);
+                break;
+            }
+            total_uncached_time += (end_time - start_time);
+            cache_requests++;
+        }
+        encoder_cache_get_stats(cache, &cache_stats);
+        encoder_cache_destroy(cache);
+    } else {
+        fprintf(stderr, "Warning: Failed to create encoder cache\n");
+    }
+    
     double avg_encode_ms = (double)total_encode_time / CONTINUOUS_FRAMES / 1000000.0;
     double avg_decode_ms = (double)total_decode_time / CONTINUOUS_FRAMES / 1000000.0;
+    double avg_zero_copy_ms = (double)total_zero_copy_time / CONTINUOUS_FRAMES / 1000000.0;
+    double avg_packet_ms = (double)total_packet_time / CONTINUOUS_FRAMES / 1000000.0;
+    double avg_ladder_ms = ladder_frames > 0 ? (double)total_ladder_time / ladder_frames / 1000000.0 : 0.0;
+    double avg_ladder_separate_ms = ladder_frames > 0 ?
+        (double)total_ladder_separate_time / ladder_frames / 1000000.0 : 0.0;
+    double avg_huff_frame_ms = huff_frames > 0 ? (double)total_huff_time[0] / huff_frames / 1000000.0 : 0.0;
+    double avg_huff_stream_ms = huff_frames > 0 ? (double)total_huff_time[1] / huff_frames / 1000000.0 : 0.0;
+    double avg_fd_ms = fd_frames > 0 ? (double)total_fd_time / fd_frames / 1000000.0 : 0.0;
+    double avg_repack_ms = fd_frames > 0 ? (double)total_repack_time / fd_frames / 1000000.0 : 0.0;
+    double avg_async_ms = async_done > 0 ? (double)total_async_time / async_done / 1000000.0 : 0.0;
+    double avg_batch_ms = batch_done > 0 ? (double)total_batch_time / batch_done / 1000000.0 : 0.0;
+    double avg_pool_ms = pool_done > 0 ? (double)total_pool_time / pool_done / 1000000.0 : 0.0;
+    double avg_cached_ms = cache_requests > 0 ? (double)total_cached_time / cache_requests / 1000000.0 : 0.0;
+    double avg_uncached_ms = cache_requests > 0 ? (double)total_uncached_time / cache_requests / 1000000.0 : 0.0;
     
     printf("  ✓ Continuous encoding/decoding completed\n");
     printf("    - Average encode time: %.3f ms (%.2f FPS)\n", avg_encode_ms, 1000.0 / avg_encode_ms);
-    printf("    - Average decode time: %.3f ms (%.2f FPS)\n\n", avg_decode_ms, 1000.0 / avg_decode_ms);
+    printf("    - Average decode time: %.3f ms (%.2f FPS)\n", avg_decode_ms, 1000.0 / avg_decode_ms);
+    if (decode_cmp_frames > 0) {
+        printf("    - Decoders: mjpeg %.3f ms, turbojpeg %.3f ms (%.2fx speedup), outputs agree to %.2f dB\n",
+               (double)total_cmp_decode_time[0] / decode_cmp_frames / 1000000.0,
+               (double)total_cmp_decode_time[1] / decode_cmp_frames / 1000000.0,
+               (double)total_cmp_decode_time[0] / total_cmp_decode_time[1], decode_cmp_psnr);
+    } else if (!decode_cmp_available) {
+        printf("    - Decoder comparison: turbojpeg decoder not available (make TURBOJPEG=1)\n");
+    } else {
+        printf("    - Decoder comparison: failed\n");
+    }
+    printf("    - Average zero-copy encode time: %.3f ms (%.2f FPS)\n",
+           avg_zero_copy_ms, 1000.0 / avg_zero_copy_ms);
+    printf("    - Average packet encode time: %.3f ms (%.2f FPS, 3 refs per frame, no output copy)\n",
+           avg_packet_ms, 1000.0 / avg_packet_ms);
+    if (ladder_frames > 0) {
+        printf("    - 3-quality ladder (%d/%d/%d): one pass %.3f ms, one encoder per quality %.3f ms (%.2fx), "
+               "%zu/%zu/%zu bytes%s\n",
+               ladder_qualities[0], ladder_qualities[1], ladder_qualities[2], avg_ladder_ms,
+               avg_ladder_separate_ms, avg_ladder_separate_ms / avg_ladder_ms,
+               ladder_rung_sizes[0], ladder_rung_sizes[1], ladder_rung_sizes[2],
+               ladder_distinct ? "" : " (rungs NOT distinct)");
+    }
+    if (huff_frames > 0 && total_huff_bytes[0] > 0) {
+        printf("    - Optimized Huffman tables: per frame %.3f ms (%.1f%% smaller), "
+               "streamed %.3f ms (%.1f%% smaller, est. %ld bytes/frame)\n",
+               avg_huff_frame_ms, 100.0 - 100.0 * total_huff_bytes[1] / total_huff_bytes[0],
+               avg_huff_stream_ms, 100.0 - 100.0 * total_huff_bytes[2] / total_huff_bytes[0],
+               (long)(huff_stats.total_huffman_saved / huff_frames));
+    }
+    if (fd_frames > 0) {
+        printf("    - Padded camera buffer (stride %d): fd import %.3f ms, map + repack %.3f ms\n",
+               CAMERA_STRIDE, avg_fd_ms, avg_repack_ms);
+    }
+    if (rc_frames > 0) {
+        printf("    - Size target 3:1: average ratio %.2f, %lu re-encodes in %d frames\n",
+               rc_ratio_sum / rc_frames, (unsigned long)(rc_stats.rc_retries - rc_retries_before), rc_frames);
+    }
+    for (int q = 0; q < quant_sets; q++) {
+        printf("    - %s quantization tables at 3:1: %.0f bytes/frame, PSNR %.2f dB, %.3f ms\n",
+               quant_names[q], (double)quant_bytes[q] / QUANT_TABLE_FRAMES, quant_psnr[q],
+               (double)quant_time[q] / QUANT_TABLE_FRAMES / 1000000.0);
+    }
+    if (slot_frames > 0) {
+        printf("    - Fixed %zu-byte slots: %.3f ms, average padding %.0f bytes/frame (%.1f%%), seek + decode %s\n",
+               slot_size, (double)total_slot_time / slot_frames / 1000000.0,
+               (double)(slot_stats.total_slot_padding - slot_padding_before) / slot_frames,
+               100.0 * (slot_stats.total_slot_padding - slot_padding_before) / slot_frames / slot_size,
+               slot_seek_ok ? "ok" : "failed");
+    }
+    for (int m = 0; m < dedup_modes; m++) {
+        printf("    - Static scene, %s dedup: %d/%d frames reused, %.3f ms/frame (hash %.3f ms)\n",
+               dedup_names[m], dedup_hits[m], DEDUP_FRAMES,
+               (double)dedup_time[m] / DEDUP_FRAMES / 1000000.0, dedup_hash_ms[m]);
+    }
+    for (int m = 0; m < motion_modes; m++) {
+        printf("    - Static scene + overlay, motion gate (%s): %d/%d frames gated, %.3f ms/frame, "
+               "%.0f bytes/frame, max score %.3f\n",
+               m ? "reduce to 50" : "skip", motion_gated[m], DEDUP_FRAMES, (double)motion_time[m] / DEDUP_FRAMES / 1000000.0,
+               (double)motion_bytes[m] / DEDUP_FRAMES, motion_score_max[m]);
+    }
+    if (meta_frames > 0) {
+        printf("    - APP4 + COM metadata per frame: copy + write %.3f ms, scatter + writev %.3f ms (%s)\n",
+               (double)total_meta_copy_time / meta_frames / 1000000.0,
+               (double)total_meta_scatter_time / meta_frames / 1000000.0, meta_match ? "same bytes" : "MISMATCH");
+    }
+    if (failovers > 0) {
+        printf("    - Hot spare: %" PRIu64 " faults in %d frames, %d lost, failover + retry %.3f ms "
+               "(destroy + create + retry %.3f ms), background rebuild %.3f ms\n",
+               failovers, failover_frames, failover_errors, failover_ms / failovers, recreate_ms, spare_build_ms);
+    }
+    NV12MJPEGEncoderStats sim_stats;
+    if (backend == NV12_MJPEG_BACKEND_SIMULATED && encoder_get_stats(encoder, &sim_stats) == 0 &&
+        sim_stats.frames_encoded > 0) {
+        printf("    - Simulated hardware: last frame %.3f ms modeled, %.3f ms/frame waiting for the device, "
+               "%" PRIu64 " frames late (software encode slower than the model)\n",
+               sim_stats.last_sim_latency_ms, sim_stats.total_sim_wait_ms / sim_stats.frames_encoded,
+               sim_stats.sim_overruns);
+    }
+    if (quant_sets == 0) {
+        printf("    - Custom quantization tables: not supported by the %s backend\n", backend_name);
+    }
+    if (failover_frames == 0) {
+        printf("    - Hot spare failover: not applicable to the %s backend\n", backend_name);
+    }
+    printf("    - Average async encode time: %.3f ms (%.2f FPS, %d frames, queue depth %d)\n",
+           avg_async_ms, 1000.0 / avg_async_ms, async_done, enc_opts.queue_depth);
+    printf("    - Average batch encode time: %.3f ms (%.2f FPS, %d frames in batches of %d, %lu session reopens)\n",
+           avg_batch_ms, 1000.0 / avg_batch_ms, batch_done, BATCH_FRAMES, (unsigned long)batch_reopens);
+    printf("    - Average pool encode time: %.3f ms (%.2f FPS, %d frames, one instance per CPU)\n",
+           avg_pool_ms, 1000.0 / avg_pool_ms, pool_done);
+    printf("    - 3-resolution requests: cached %.3f ms (%lu hits, %lu misses), create per request %.3f ms\n\n",
+           avg_cached_ms, (unsigned long)cache_stats.hits, (unsigned long)cache_stats.misses, avg_uncached_ms);
     
     // ========================================================================
     // Performance Statistics
@@ -277,6 +1125,15 @@ int main(void) {
     printf("  Encoding:\n");
     printf("    - Average time: %.3f ms\n", avg_encode_ms);
     printf("    - Throughput:   %.2f FPS\n", 1000.0 / avg_encode_ms);
+    printf("    - Zero-copy:    %.3f ms (%.2f FPS)\n", avg_zero_copy_ms, 1000.0 / avg_zero_copy_ms);
+    printf("    - Packet:       %.3f ms (%.2f FPS)\n", avg_packet_ms, 1000.0 / avg_packet_ms);
+    printf("    - Huffman opt:  %.3f ms per frame, %.3f ms streamed\n", avg_huff_frame_ms, avg_huff_stream_ms);
+    printf("    - 3-quality:    %.3f ms (separate encoders %.3f ms)\n", avg_ladder_ms, avg_ladder_separate_ms);
+    printf("    - fd import:    %.3f ms (repack path %.3f ms)\n", avg_fd_ms, avg_repack_ms);
+    printf("    - Async:        %.3f ms (%.2f FPS)\n", avg_async_ms, 1000.0 / avg_async_ms);
+    printf("    - Batch:        %.3f ms (%.2f FPS)\n", avg_batch_ms, 1000.0 / avg_batch_ms);
+    printf("    - Pool:         %.3f ms (%.2f FPS)\n", avg_pool_ms, 1000.0 / avg_pool_ms);
+    printf("    - Cache (3 res): %.3f ms (create per request %.3f ms)\n", avg_cached_ms, avg_uncached_ms);
     printf("  Decoding:\n");
     printf("    - Average time: %.3f ms\n", avg_decode_ms);
     printf("    - Throughput:   %.2f FPS\n", 1000.0 / avg_decode_ms);
@@ -0,0 +1,1787 @@
+/*
+ * Native Baseline JPEG Encoder for NV12
+ *
+ * 4:2:0 baseline (SOF0) encoder that reads NV12 directly: 16x16 MCUs made of
+ * four Y blocks plus one Cb and one Cr block split straight out of the
+ * interleaved UV plane. Forward DCT (float AAN) and quantization are
+ * vectorized - AVX2 (selected at runtime) or SSE2 on x86, NEON on ARM - with a
+ * scalar fallback. Entropy coding uses the standard Annex K Huffman tables and
+ * a 64-bit bit buffer that emits 32 bits at a time with 0xFF byte stuffing.
+ * Header segments are built once per encoder and copied in front of each scan.
+ *
+ * Optionally the Huffman tables are optimized (ITU-T T.81 K.2): per frame, a
+ * first pass keeps the quantized blocks while counting their symbols and a
+ * second pass entropy codes them; in streaming mode, each frame is coded in one
+ * pass with tables built from the symbol counts of the previous frames.
+ *
+ * With more than one strip, every MCU row is a restart interval (DRI/RSTn) and
+ * horizontal strips of rows are encoded concurrently with OpenMP, then joined.
+ *
+ * Several qualities can be produced from one pass: each block is transformed
+ * once, then quantized and entropy coded into one output per table set.
+ */
+
+#include "nv12_jpeg_native.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__SSE2__)
+#define NATIVE_JPEG_SSE2 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define NATIVE_JPEG_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Worst case per MCU: 6 blocks x (DC 20 bits + 63 AC x 26 bits + EOB), doubled for
+// 0xFF stuffing, plus bit-buffer slack. Checked before each MCU is encoded.
+#define NATIVE_MCU_MAX_BYTES 2560
+
+#define NATIVE_HEADER_MAX_BYTES 1024
+
+// ============================================================================
+// Standard Tables (ITU-T T.81 Annex K)
+// ============================================================================
+
+static const uint8_t std_luma_quant[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99,
+};
+
+static const uint8_t std_chroma_quant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+// Zigzag index -> natural (row-major) index
+static const uint8_t zigzag_to_natural[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static const uint8_t dc_luma_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t dc_luma_vals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t dc_chroma_vals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t ac_luma_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const uint8_t ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+// AAN output scale factors: aan[0] = 1, aan[k] = cos(k*pi/16) * sqrt(2)
+static const float aan_scale[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+    1.0f, 0.785694958f, 0.541196100f, 0.275899379f,
+};
+
+// ============================================================================
+// Encoder Data Structures
+// ============================================================================
+
+// Huffman table: DHT contents plus the code of each symbol
+typedef struct {
+    uint8_t bits[16];             // Number of codes of length 1..16
+    uint8_t vals[256];            // Symbols in code order
+    uint16_t code[256];
+    uint8_t size[256];            // Code length per symbol (0 = no code)
+} HuffTable;
+
+// DC and AC tables for luma (0) and chroma (1)
+typedef struct {
+    HuffTable dc[2];
+    HuffTable ac[2];
+} HuffTables;
+
+// Symbol counts per table, gathered to build optimized tables
+typedef struct {
+    uint32_t dc[2][256];
+    uint32_t ac[2][256];
+} HuffCounts;
+
+// Quantization for one quality: tables in natural order (for DQT), reciprocals in DCT output order
+typedef struct {
+    float recip[2][64] __attribute__((aligned(32)));
+    uint8_t quant[2][64];
+    int quality;
+} QuantTables;
+
+typedef void (*fdct_fn)(const uint8_t* src, int stride, float* out);
+typedef void (*quant_fn)(const float* coef, const float* recip, int16_t* out);
+
+struct NativeJpegEncoder {
+    int width;
+    int height;
+    int chroma_width;
+    int chroma_height;
+    int mcu_cols;
+    int mcu_rows;
+    
+    // Tables that quality scales (natural order): Annex K or custom
+    uint8_t base_quant[2][64];
+    
+    // Quantization tables of the configured quality
+    QuantTables qt;
+    
+    // Zigzag index -> DCT output index (the DCT leaves blocks transposed)
+    uint8_t zigzag_src[64];
+    
+    // Standard Annex K tables (also used for multi-quality and abbreviated output)
+    HuffTables std_huff;
+    
+    // Optimized Huffman tables (NATIVE_JPEG_HUFFMAN_FRAME / _STREAM)
+    NativeJpegHuffman huffman;
+    HuffTables opt_huff;          // Tables of the current frame (FRAME) or the next frame (STREAM)
+    HuffCounts* strip_counts;     // Symbol counts per strip of the current frame
+    HuffCounts* window;           // STREAM: counts of the last window_size frames (ring)
+    HuffCounts window_sum;
+    int window_size;
+    int window_pos;
+    int16_t* blocks;              // FRAME: quantized zigzag blocks kept for the second pass
+    uint8_t opt_header[NATIVE_HEADER_MAX_BYTES];  // Complete header with the optimized DHT
+    size_t opt_header_size;
+    long huffman_saved;           // Estimated bytes saved on the last frame
+    
+    // Precomputed SOI..SOS header; DQT and DHT are contiguous so that the
+    // abbreviated header (no tables) is the same bytes with that range cut out
+    uint8_t header[NATIVE_HEADER_MAX_BYTES];
+    size_t header_size;
+    size_t tables_begin;
+    size_t tables_end;
+    uint8_t abbrev_header[NATIVE_HEADER_MAX_BYTES];
+    size_t abbrev_header_size;
+    int abbreviated;
+    
+    // Multi-quality output: table set and complete header per output
+    QuantTables multi_qt[NATIVE_JPEG_MAX_OUTPUTS];
+    uint8_t multi_header[NATIVE_JPEG_MAX_OUTPUTS][NATIVE_HEADER_MAX_BYTES];
+    
+    // Restart-interval strips: strip 0 is written in place, the rest into scratch (per output)
+    int strips;
+    uint8_t* strip_buf[NATIVE_JPEG_MAX_OUTPUTS][NATIVE_JPEG_MAX_STRIPS];
+    size_t strip_capacity[NATIVE_JPEG_MAX_OUTPUTS][NATIVE_JPEG_MAX_STRIPS];
+    
+    // Called after each MCU row with the source rows it read (can be NULL)
+    native_jpeg_row_fn row_fn;
+    void* row_opaque;
+    
+    fdct_fn fdct;
+    quant_fn quant_block;
+    const char* simd_name;
+};
+
+typedef struct {
+    uint64_t acc;                 // Pending bits, right-aligned
+    int nbits;                    // Number of pending bits
+    uint8_t* p;                   // Write pointer
+} BitWriter;
+
+// Inputs of one frame encode, shared by its strips
+typedef struct {
+    const uint8_t* y;
+    int y_stride;
+    const uint8_t* uv;
+    int uv_stride;
+    int outputs;                  // Outputs, quantized with qt[o]
+    const QuantTables* const* qt;
+    const HuffTables* huff;       // Huffman tables of every output
+    const int16_t* blocks;        // Second pass: stored blocks to entropy code (NULL = transform the planes)
+    HuffCounts* counts;           // Per-strip symbol counts of output 0 to gather (can be NULL)
+} FrameJob;
+
+// ============================================================================
+// Forward DCT + Quantization
+// ============================================================================
+
+// One 1-D float AAN pass over 8 vectors (libjpeg jfdctflt.c). Each vector holds
+// the same sample position of 1, 4 or 8 independent lines.
+#define AAN_PASS(T, ADD, SUB, MUL, SET1, r) do {                              \
+    T tmp0 = ADD(r[0], r[7]), tmp7 = SUB(r[0], r[7]);                        \
+    T tmp1 = ADD(r[1], r[6]), tmp6 = SUB(r[1], r[6]);                        \
+    T tmp2 = ADD(r[2], r[5]), tmp5 = SUB(r[2], r[5]);                        \
+    T tmp3 = ADD(r[3], r[4]), tmp4 = SUB(r[3], r[4]);                        \
+    T tmp10 = ADD(tmp0, tmp3), tmp13 = SUB(tmp0, tmp3);                      \
+    T tmp11 = ADD(tmp1, tmp2), tmp12 = SUB(tmp1, tmp2);                      \
+    r[0] = ADD(tmp10, tmp11);                                                \
+    r[4] = SUB(tmp10, tmp11);                                                \
+    T z1 = MUL(ADD(tmp12, tmp13), SET1(0.707106781f));                       \
+    r[2] = ADD(tmp13, z1);                                                   \
+    r[6] = SUB(tmp13, z1);                                                   \
+    tmp10 = ADD(tmp4, tmp5);                                                 \
+    tmp11 = ADD(tmp5, tmp6);                                                 \
+    tmp12 = ADD(tmp6, tmp7);                                                 \
+    T z5 = MUL(SUB(tmp10, tmp12), SET1(0.382683433f));                       \
+    T z2 = ADD(MUL(tmp10, SET1(0.541196100f)), z5);                          \
+    T z4 = ADD(MUL(tmp12, SET1(1.306562965f)), z5);                          \
+    T z3 = MUL(tmp11, SET1(0.707106781f));                                   \
+    T z11 = ADD(tmp7, z3), z13 = SUB(tmp7, z3);                              \
+    r[5] = ADD(z13, z2);                                                     \
+    r[3] = SUB(z13, z2);                                                     \
+    r[1] = ADD(z11, z4);                                                     \
+    r[7] = SUB(z11, z4);                                                     \
+} while (0)
+
+#define SCALAR_ADD(a, b) ((a) + (b))
+#define SCALAR_SUB(a, b) ((a) - (b))
+#define SCALAR_MUL(a, b) ((a) * (b))
+#define SCALAR_SET1(a) (a)
+
+// Output layout of every fdct variant: out[u * 8 + v] holds the coefficient of
+// vertical frequency v and horizontal frequency u (transposed natural order).
+static void fdct_c(const uint8_t* src, int stride, float* out) {
+    float ws[64];
+    
+    // Vertical pass, one column at a time
+    for (int x = 0; x < 8; x++) {
+        float r[8];
+        for (int i = 0; i < 8; i++) {
+            r[i] = (float)src[i * stride + x] - 128.0f;
+        }
+        AAN_PASS(float, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_SET1, r);
+        for (int v = 0; v < 8; v++) {
+            ws[v * 8 + x] = r[v];
+        }
+    }
+    
+    // Horizontal pass, one frequency row at a time
+    for (int v = 0; v < 8; v++) {
+        float r[8];
+        for (int x = 0; x < 8; x++) {
+            r[x] = ws[v * 8 + x];
+        }
+        AAN_PASS(float, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_SET1, r);
+        for (int u = 0; u < 8; u++) {
+            out[u * 8 + v] = r[u];
+        }
+    }
+}
+
+// Every quantizer rounds half away from zero the same way (add +/-0.5 carrying
+// the sign of the value, then truncate), so all CPU paths emit identical streams
+static void quant_c(const float* coef, const float* recip, int16_t* out) {
+    for (int i = 0; i < 64; i++) {
+        float q = coef[i] * recip[i];
+        out[i] = (int16_t)(int)(q + (signbit(q) ? -0.5f : 0.5f));
+    }
+}
+
+#ifdef NATIVE_JPEG_SSE2
+
+static void fdct_sse2(const uint8_t* src, int stride, float* out) {
+    __m128 lo[8], hi[8];
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 bias = _mm_set1_ps(128.0f);
+    
+    for (int i = 0; i < 8; i++) {
+        __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + i * stride)), zero);
+        lo[i] = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(p, zero)), bias);
+        hi[i] = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(p, zero)), bias);
+    }
+    
+    AAN_PASS(__m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps, lo);
+    AAN_PASS(__m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps, hi);
+    
+    // Transpose as four 4x4 quadrants: [A B; C D] -> [A' C'; B' D']
+    _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+    _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+    _MM_TRANSPOSE4_PS(lo[4], lo[5], lo[6], lo[7]);
+    _MM_TRANSPOSE4_PS(hi[4], hi[5], hi[6], hi[7]);
+    for (int i = 0; i < 4; i++) {
+        __m128 t = hi[i];
+        hi[i] = lo[i + 4];
+        lo[i + 4] = t;
+    }
+    
+    AAN_PASS(__m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps, lo);
+    AAN_PASS(__m128, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps, hi);
+    
+    for (int i = 0; i < 8; i++) {
+        _mm_storeu_ps(out + i * 8, lo[i]);
+        _mm_storeu_ps(out + i * 8 + 4, hi[i]);
+    }
+}
+
+static inline __m128i round_sse2(__m128 x) {
+    __m128 half = _mm_or_ps(_mm_and_ps(x, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.5f));
+    return _mm_cvttps_epi32(_mm_add_ps(x, half));
+}
+
+static void quant_sse2(const float* coef, const float* recip, int16_t* out) {
+    for (int i = 0; i < 64; i += 8) {
+        __m128i a = round_sse2(_mm_mul_ps(_mm_loadu_ps(coef + i), _mm_load_ps(recip + i)));
+        __m128i b = round_sse2(_mm_mul_ps(_mm_loadu_ps(coef + i + 4), _mm_load_ps(recip + i + 4)));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+    }
+}
+
+__attribute__((target("avx2")))
+static void fdct_avx2(const uint8_t* src, int stride, float* out) {
+    __m256 r[8];
+    const __m256 bias = _mm256_set1_ps(128.0f);
+    
+    for (int i = 0; i < 8; i++) {
+        __m128i p = _mm_loadl_epi64((const __m128i*)(src + i * stride));
+        r[i] = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(p)), bias);
+    }
+    
+    AAN_PASS(__m256, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps, r);
+    
+    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+    __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+    __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+    __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+    __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+    __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+    
+    AAN_PASS(__m256, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_set1_ps, r);
+    
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_ps(out + i * 8, r[i]);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i round_avx2(__m256 x) {
+    __m256 half = _mm256_or_ps(_mm256_and_ps(x, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(0.5f));
+    return _mm256_cvttps_epi32(_mm256_add_ps(x, half));
+}
+
+__attribute__((target("avx2")))
+static void quant_avx2(const float* coef, const float* recip, int16_t* out) {
+    for (int i = 0; i < 64; i += 16) {
+        __m256i a = round_avx2(_mm256_mul_ps(_mm256_loadu_ps(coef + i), _mm256_load_ps(recip + i)));
+        __m256i b = round_avx2(_mm256_mul_ps(_mm256_loadu_ps(coef + i + 8), _mm256_load_ps(recip + i + 8)));
+        // packs works per 128-bit lane; restore element order afterwards
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+}
+
+#endif // NATIVE_JPEG_SSE2
+
+#ifdef NATIVE_JPEG_NEON
+
+static inline void transpose4_neon(float32x4_t* a, float32x4_t* b, float32x4_t* c, float32x4_t* d) {
+    float32x4x2_t t0 = vtrnq_f32(*a, *b);
+    float32x4x2_t t1 = vtrnq_f32(*c, *d);
+    *a = vcombine_f32(vget_low_f32(t0.val[0]), vget_low_f32(t1.val[0]));
+    *b = vcombine_f32(vget_low_f32(t0.val[1]), vget_low_f32(t1.val[1]));
+    *c = vcombine_f32(vget_high_f32(t0.val[0]), vget_high_f32(t1.val[0]));
+    *d = vcombine_f32(vget_high_f32(t0.val[1]), vget_high_f32(t1.val[1]));
+}
+
+static void fdct_neon(const uint8_t* src, int stride, float* out) {
+    float32x4_t lo[8], hi[8];
+    const float32x4_t bias = vdupq_n_f32(128.0f);
+    
+    for (int i = 0; i < 8; i++) {
+        uint16x8_t p = vmovl_u8(vld1_u8(src + i * stride));
+        lo[i] = vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(p))), bias);
+        hi[i] = vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(p))), bias);
+    }
+    
+    AAN_PASS(float32x4_t, vaddq_f32, vsubq_f32, vmulq_f32, vdupq_n_f32, lo);
+    AAN_PASS(float32x4_t, vaddq_f32, vsubq_f32, vmulq_f32, vdupq_n_f32, hi);
+    
+    // Transpose as four 4x4 quadrants: [A B; C D] -> [A' C'; B' D']
+    transpose4_neon(&lo[0], &lo[1], &lo[2], &lo[3]);
+    transpose4_neon(&hi[0], &hi[1], &hi[2], &hi[3]);
+    transpose4_neon(&lo[4], &lo[5], &lo[6], &lo[7]);
+    transpose4_neon(&hi[4], &hi[5], &hi[6], &hi[7]);
+    for (int i = 0; i < 4; i++) {
+        float32x4_t t = hi[i];
+        hi[i] = lo[i + 4];
+        lo[i + 4] = t;
+    }
+    
+    AAN_PASS(float32x4_t, vaddq_f32, vsubq_f32, vmulq_f32, vdupq_n_f32, lo);
+    AAN_PASS(float32x4_t, vaddq_f32, vsubq_f32, vmulq_f32, vdupq_n_f32, hi);
+    
+    for (int i = 0; i < 8; i++) {
+        vst1q_f32(out + i * 8, lo[i]);
+        vst1q_f32(out + i * 8 + 4, hi[i]);
+    }
+}
+
+static inline int32x4_t round_neon(float32x4_t x) {
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000u));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+    return vcvtq_s32_f32(vaddq_f32(x, half));
+}
+
+static void quant_neon(const float* coef, const float* recip, int16_t* out) {
+    for (int i = 0; i < 64; i += 8) {
+        int32x4_t a = round_neon(vmulq_f32(vld1q_f32(coef + i), vld1q_f32(recip + i)));
+        int32x4_t b = round_neon(vmulq_f32(vld1q_f32(coef + i + 4), vld1q_f32(recip + i + 4)));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+}
+
+#endif // NATIVE_JPEG_NEON
+
+// ============================================================================
+// Block Fetch
+// ============================================================================
+
+// Split 8 rows of 8 interleaved UV pairs into separate 8x8 U and V blocks
+static void split_uv_block(const uint8_t* uv, int stride, uint8_t* u, uint8_t* v) {
+#if defined(NATIVE_JPEG_SSE2)
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    for (int i = 0; i < 8; i++) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(uv + i * stride));
+        __m128i packed = _mm_packus_epi16(_mm_and_si128(p, mask), _mm_srli_epi16(p, 8));
+        _mm_storel_epi64((__m128i*)(u + i * 8), packed);
+        _mm_storel_epi64((__m128i*)(v + i * 8), _mm_srli_si128(packed, 8));
+    }
+#elif defined(NATIVE_JPEG_NEON)
+    for (int i = 0; i < 8; i++) {
+        uint8x8x2_t p = vld2_u8(uv + i * stride);
+        vst1_u8(u + i * 8, p.val[0]);
+        vst1_u8(v + i * 8, p.val[1]);
+    }
+#else
+    for (int i = 0; i < 8; i++) {
+        const uint8_t* row = uv + i * stride;
+        for (int j = 0; j < 8; j++) {
+            u[i * 8 + j] = row[2 * j];
+            v[i * 8 + j] = row[2 * j + 1];
+        }
+    }
+#endif
+}
+
+// Copy a 16x16 luma area starting at (x0, y0), replicating the last column/row
+static void fetch_luma_edge(const uint8_t* y, int stride, int width, int height,
+                            int x0, int y0, uint8_t* dst) {
+    for (int i = 0; i < 16; i++) {
+        int sy = y0 + i < height ? y0 + i : height - 1;
+        const uint8_t* row = y + (size_t)sy * stride;
+        for (int j = 0; j < 16; j++) {
+            int sx = x0 + j < width ? x0 + j : width - 1;
+            dst[i * 16 + j] = row[sx];
+        }
+    }
+}
+
+// Same for an 8x8 chroma area at chroma position (cx0, cy0)
+static void fetch_chroma_edge(const uint8_t* uv, int stride, int cw, int ch,
+                              int cx0, int cy0, uint8_t* u, uint8_t* v) {
+    for (int i = 0; i < 8; i++) {
+        int sy = cy0 + i < ch ? cy0 + i : ch - 1;
+        const uint8_t* row = uv + (size_t)sy * stride;
+        for (int j = 0; j < 8; j++) {
+            int sx = cx0 + j < cw ? cx0 + j : cw - 1;
+            u[i * 8 + j] = row[2 * sx];
+            v[i * 8 + j] = row[2 * sx + 1];
+        }
+    }
+}
+
+// ============================================================================
+// Entropy Coding
+// ============================================================================
+
+static int huff_table_count(const HuffTable* table) {
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+        count += table->bits[i];
+    }
+    return count;
+}
+
+static void build_huff_table(HuffTable* table, const uint8_t* bits, const uint8_t* vals) {
+    memset(table, 0, sizeof(*table));
+    memcpy(table->bits, bits, 16);
+    memcpy(table->vals, vals, huff_table_count(table));
+    
+    int k = 0;
+    uint16_t code = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            table->code[vals[k]] = code++;
+            table->size[vals[k]] = (uint8_t)len;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+static inline void bw_emit_byte(BitWriter* bw, uint8_t b) {
+    *bw->p++ = b;
+    if (b == 0xFF) {
+        *bw->p++ = 0x00;
+    }
+}
+
+static inline void bw_put(BitWriter* bw, uint32_t bits, int n) {
+    bw->acc = (bw->acc << n) | bits;
+    bw->nbits += n;
+    if (bw->nbits >= 32) {
+        bw->nbits -= 32;
+        uint32_t word = (uint32_t)(bw->acc >> bw->nbits);
+        uint32_t inv = ~word;
+        if (!((inv - 0x01010101u) & ~inv & 0x80808080u)) {
+            // No 0xFF byte in the word, nothing to stuff
+            bw->p[0] = (uint8_t)(word >> 24);
+            bw->p[1] = (uint8_t)(word >> 16);
+            bw->p[2] = (uint8_t)(word >> 8);
+            bw->p[3] = (uint8_t)word;
+            bw->p += 4;
+        } else {
+            bw_emit_byte(bw, (uint8_t)(word >> 24));
+            bw_emit_byte(bw, (uint8_t)(word >> 16));
+            bw_emit_byte(bw, (uint8_t)(word >> 8));
+            bw_emit_byte(bw, (uint8_t)word);
+        }
+    }
+}
+
+// Pad with 1-bits to a byte boundary and write out everything pending
+static void bw_flush(BitWriter* bw) {
+    int pad = (8 - (bw->nbits & 7)) & 7;
+    if (pad) {
+        bw_put(bw, (1u << pad) - 1, pad);
+    }
+    while (bw->nbits >= 8) {
+        bw->nbits -= 8;
+        bw_emit_byte(bw, (uint8_t)(bw->acc >> bw->nbits));
+    }
+    bw->acc = 0;
+}
+
+static inline int bit_length(unsigned int v) {
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+// Bit k set when zz[k] != 0
+static inline uint64_t nonzero_mask(const int16_t* zz) {
+#if defined(NATIVE_JPEG_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i a = _mm_cmpeq_epi16(_mm_load_si128((const __m128i*)(zz + i)), zero);
+        __m128i b = _mm_cmpeq_epi16(_mm_load_si128((const __m128i*)(zz + i + 8)), zero);
+        uint32_t eq = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(a, b));
+        mask |= (uint64_t)(~eq & 0xFFFFu) << i;
+    }
+    return mask;
+#elif defined(NATIVE_JPEG_NEON)
+    static const uint8_t lane_bit[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x8_t bit = vld1_u8(lane_bit);
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 8) {
+        // Narrow each "nonzero" lane to one byte, then gather one bit per lane
+        int16x8_t v = vld1q_s16(zz + i);
+        uint8x8_t bits = vand_u8(vmovn_u16(vtstq_s16(v, v)), bit);
+#if defined(__aarch64__)
+        mask |= (uint64_t)vaddv_u8(bits) << i;
+#else
+        bits = vpadd_u8(bits, bits);
+        bits = vpadd_u8(bits, bits);
+        bits = vpadd_u8(bits, bits);
+        mask |= (uint64_t)vget_lane_u8(bits, 0) << i;
+#endif
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int k = 0; k < 64; k++) {
+        mask |= (uint64_t)(zz[k] != 0) << k;
+    }
+    return mask;
+#endif
+}
+
+static inline void zigzag_block(const int16_t* coef, const uint8_t* zigzag_src, int16_t* zz) {
+    for (int k = 0; k < 64; k++) {
+        zz[k] = coef[zigzag_src[k]];
+    }
+}
+
+// Entropy code one zigzag-ordered block (zz 16-byte aligned), counting the
+// emitted symbols into dc_count/ac_count if given. Always inlined with constant
+// counters, so the plain path carries no counting code.
+static inline __attribute__((always_inline)) void encode_block_impl(BitWriter* bw, const int16_t* zz, int* last_dc,
+                                                                    const HuffTable* dc, const HuffTable* ac,
+                                                                    uint32_t* dc_count, uint32_t* ac_count) {
+    uint64_t nonzero = nonzero_mask(zz);
+    
+    // DC difference
+    int diff = zz[0] - *last_dc;
+    *last_dc = zz[0];
+    int mag = diff < 0 ? -diff : diff;
+    int nbits = bit_length((unsigned int)mag);
+    uint32_t extra = (uint32_t)(diff < 0 ? diff - 1 : diff) & ((1u << nbits) - 1);
+    bw_put(bw, ((uint32_t)dc->code[nbits] << nbits) | extra, dc->size[nbits] + nbits);
+    if (dc_count) {
+        dc_count[nbits]++;
+    }
+    
+    // AC run-length coding, walking only the nonzero coefficients
+    nonzero &= ~1ULL;
+    int last = 0;
+    while (nonzero) {
+        int k = __builtin_ctzll(nonzero);
+        int run = k - last - 1;
+        while (run > 15) {
+            bw_put(bw, ac->code[0xF0], ac->size[0xF0]);
+            if (ac_count) {
+                ac_count[0xF0]++;
+            }
+            run -= 16;
+        }
+        
+        int v = zz[k];
+        mag = v < 0 ? -v : v;
+        if (mag > 1023) {
+            // Baseline AC coefficients are limited to 10 bits
+            mag = 1023;
+            v = v < 0 ? -1023 : 1023;
+        }
+        nbits = bit_length((unsigned int)mag);
+        extra = (uint32_t)(v < 0 ? v - 1 : v) & ((1u << nbits) - 1);
+        int symbol = (run << 4) | nbits;
+        bw_put(bw, ((uint32_t)ac->code[symbol] << nbits) | extra, ac->size[symbol] + nbits);
+        if (ac_count) {
+            ac_count[symbol]++;
+        }
+        
+        last = k;
+        nonzero &= nonzero - 1;
+    }
+    
+    if (last != 63) {
+        bw_put(bw, ac->code[0x00], ac->size[0x00]);
+        if (ac_count) {
+            ac_count[0x00]++;
+        }
+    }
+}
+
+static void encode_block(BitWriter* bw, const int16_t* zz, int* last_dc, const HuffTable* dc, const HuffTable* ac) {
+    encode_block_impl(bw, zz, last_dc, dc, ac, NULL, NULL);
+}
+
+// Same as encode_block(), counting the symbols for optimized tables
+static void encode_block_counted(BitWriter* bw, const int16_t* zz, int* last_dc, const HuffTable* dc,
+                                 const HuffTable* ac, uint32_t* dc_count, uint32_t* ac_count) {
+    encode_block_impl(bw, zz, last_dc, dc, ac, dc_count, ac_count);
+}
+
+// Count the symbols encode_block() would emit for one zigzag-ordered block
+// (statistics pass, nothing is written)
+static void count_block(const int16_t* zz, int last_dc, uint32_t* dc_count, uint32_t* ac_count) {
+    uint64_t nonzero = nonzero_mask(zz);
+    
+    int diff = zz[0] - last_dc;
+    dc_count[bit_length((unsigned int)(diff < 0 ? -diff : diff))]++;
+    
+    nonzero &= ~1ULL;
+    int last = 0;
+    while (nonzero) {
+        int k = __builtin_ctzll(nonzero);
+        int run = k - last - 1;
+        ac_count[0xF0] += run >> 4;
+        
+        int mag = zz[k] < 0 ? -zz[k] : zz[k];
+        ac_count[((run & 15) << 4) | bit_length((unsigned int)(mag > 1023 ? 1023 : mag))]++;
+        
+        last = k;
+        nonzero &= nonzero - 1;
+    }
+    
+    if (last != 63) {
+        ac_count[0x00]++;
+    }
+}
+
+// Length-limited optimal Huffman table for the symbol counts (ITU-T T.81 K.2,
+// as in libjpeg). Symbols listed in always[] get a code even if never counted.
+static void build_optimal_huff_table(HuffTable* table, const uint32_t* counts, const uint8_t* always, int num_always) {
+    uint64_t freq[257];
+    int codesize[257];
+    int others[257];
+    int active[257];
+    int num_active = 0;
+    
+    for (int i = 0; i < 256; i++) {
+        freq[i] = counts[i];
+    }
+    for (int i = 0; i < num_always; i++) {
+        freq[always[i]]++;
+    }
+    // Reserved symbol: keeps real symbols off the all-ones code
+    freq[256] = 1;
+    for (int i = 0; i <= 256; i++) {
+        codesize[i] = 0;
+        others[i] = -1;
+        if (freq[i]) {
+            active[num_active++] = i;
+        }
+    }
+    
+    // Merge the two least frequent subtrees until one is left
+    while (num_active > 1) {
+        int i1 = -1, i2 = -1;
+        for (int i = 0; i < num_active; i++) {
+            if (i1 < 0 || freq[active[i]] <= freq[active[i1]]) {
+                i1 = i;
+            }
+        }
+        for (int i = 0; i < num_active; i++) {
+            if (i != i1 && (i2 < 0 || freq[active[i]] <= freq[active[i2]])) {
+                i2 = i;
+            }
+        }
+        
+        int c1 = active[i1], c2 = active[i2];
+        freq[c1] += freq[c2];
+        memmove(&active[i2], &active[i2 + 1], (size_t)(num_active - i2 - 1) * sizeof(int));
+        num_active--;
+        
+        // Every symbol of both subtrees gets one bit longer
+        codesize[c1]++;
+        while (others[c1] >= 0) {
+            c1 = others[c1];
+            codesize[c1]++;
+        }
+        others[c1] = c2;
+        codesize[c2]++;
+        while (others[c2] >= 0) {
+            c2 = others[c2];
+            codesize[c2]++;
+        }
+    }
+    
+    int bits[258] = { 0 };
+    int max_len = 0;
+    for (int i = 0; i <= 256; i++) {
+        bits[codesize[i]]++;
+        if (codesize[i] > max_len) {
+            max_len = codesize[i];
+        }
+    }
+    
+    // Limit codes to 16 bits: a pair of longest codes moves up, a shorter code splits
+    for (int len = max_len; len > 16; len--) {
+        while (bits[len] > 0) {
+            int j = len - 2;
+            while (bits[j] == 0) {
+                j--;
+            }
+            bits[len] -= 2;
+            bits[len - 1]++;
+            bits[j + 1] += 2;
+            bits[j]--;
+        }
+    }
+    
+    // Drop the reserved symbol's code (one of the longest)
+    int len = 16;
+    while (len > 0 && bits[len] == 0) {
+        len--;
+    }
+    if (len > 0) {
+        bits[len]--;
+    }
+    
+    uint8_t table_bits[16];
+    uint8_t vals[256];
+    int n = 0;
+    for (int i = 0; i < 16; i++) {
+        table_bits[i] = (uint8_t)bits[i + 1];
+    }
+    for (int l = 1; l <= max_len; l++) {
+        for (int sym = 0; sym < 256; sym++) {
+            if (codesize[sym] == l) {
+                vals[n++] = (uint8_t)sym;
+            }
+        }
+    }
+    build_huff_table(table, table_bits, vals);
+}
+
+// Optimized tables for all four table slots. always_all: every valid symbol gets
+// a code (tables reused for frames whose symbols were not counted)
+static void build_optimal_tables(HuffTables* huff, const HuffCounts* counts, int always_all) {
+    build_optimal_huff_table(&huff->dc[0], counts->dc[0], dc_luma_vals, always_all ? 12 : 0);
+    build_optimal_huff_table(&huff->ac[0], counts->ac[0], ac_luma_vals, always_all ? 162 : 0);
+    build_optimal_huff_table(&huff->dc[1], counts->dc[1], dc_chroma_vals, always_all ? 12 : 0);
+    build_optimal_huff_table(&huff->ac[1], counts->ac[1], ac_chroma_vals, always_all ? 162 : 0);
+}
+
+// Estimated bytes saved by huff over the standard tables for these symbol counts:
+// code bits (extra bits are the same) plus the DHT size difference
+static long huffman_saved_bytes(const HuffCounts* counts, const HuffTables* huff, const HuffTables* std) {
+    int64_t bits = 0;
+    long dht_bytes = 0;
+    
+    for (int t = 0; t < 2; t++) {
+        for (int sym = 0; sym < 256; sym++) {
+            bits += (int64_t)counts->dc[t][sym] * (std->dc[t].size[sym] - huff->dc[t].size[sym]);
+            bits += (int64_t)counts->ac[t][sym] * (std->ac[t].size[sym] - huff->ac[t].size[sym]);
+        }
+        dht_bytes += huff_table_count(&std->dc[t]) - huff_table_count(&huff->dc[t]);
+        dht_bytes += huff_table_count(&std->ac[t]) - huff_table_count(&huff->ac[t]);
+    }
+    return (long)(bits / 8) + dht_bytes;
+}
+
+// ============================================================================
+// Tables and Header
+// ============================================================================
+
+// libjpeg quality scaling: percent of the base tables (quality 50 = as given)
+static int quality_scale(int quality) {
+    return quality < 50 ? 5000 / quality : 200 - quality * 2;
+}
+
+static uint8_t scale_quant(int base, int scale) {
+    int q = (base * scale + 50) / 100;
+    if (q < 1) q = 1;
+    if (q > 255) q = 255;
+    return (uint8_t)q;
+}
+
+// Scale the encoder's base tables to a quality
+static void build_quant_tables(const NativeJpegEncoder* enc, QuantTables* qt, int quality) {
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+    int scale = quality_scale(quality);
+    
+    qt->quality = quality;
+    for (int t = 0; t < 2; t++) {
+        const uint8_t* base = enc->base_quant[t];
+        for (int n = 0; n < 64; n++) {
+            int q = scale_quant(base[n], scale);
+            qt->quant[t][n] = (uint8_t)q;
+            
+            // Reciprocal in DCT output (transposed) order, folding in the AAN scaling
+            int row = n / 8, col = n % 8;
+            qt->recip[t][col * 8 + row] = 1.0f / ((float)q * aan_scale[row] * aan_scale[col] * 8.0f);
+        }
+    }
+}
+
+static uint8_t* put_u16(uint8_t* p, int v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+    return p + 2;
+}
+
+// DQT: both tables in zigzag order
+static uint8_t* put_dqt(uint8_t* p, const QuantTables* qt) {
+    *p++ = 0xFF;
+    *p++ = 0xDB;
+    p = put_u16(p, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        *p++ = (uint8_t)t;
+        for (int k = 0; k < 64; k++) {
+            *p++ = qt->quant[t][zigzag_to_natural[k]];
+        }
+    }
+    return p;
+}
+
+static uint8_t* put_dht(uint8_t* p, int table_class_id, const HuffTable* table) {
+    int count = huff_table_count(table);
+    *p++ = 0xFF;
+    *p++ = 0xC4;
+    p = put_u16(p, 2 + 1 + 16 + count);
+    *p++ = (uint8_t)table_class_id;
+    memcpy(p, table->bits, 16);
+    p += 16;
+    memcpy(p, table->vals, count);
+    return p + count;
+}
+
+// DHT: luma DC/AC, then chroma DC/AC
+static uint8_t* put_dht_tables(uint8_t* p, const HuffTables* huff) {
+    p = put_dht(p, 0x00, &huff->dc[0]);
+    p = put_dht(p, 0x10, &huff->ac[0]);
+    p = put_dht(p, 0x01, &huff->dc[1]);
+    p = put_dht(p, 0x11, &huff->ac[1]);
+    return p;
+}
+
+static void build_header(NativeJpegEncoder* enc) {
+    uint8_t* p = enc->header;
+    
+    // SOI + APP0 (JFIF 1.01, no thumbnail)
+    static const uint8_t soi_app0[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+        0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+    };
+    memcpy(p, soi_app0, sizeof(soi_app0));
+    p += sizeof(soi_app0);
+    
+    enc->tables_begin = (size_t)(p - enc->header);
+    p = put_dqt(p, &enc->qt);
+    p = put_dht_tables(p, &enc->std_huff);
+    enc->tables_end = (size_t)(p - enc->header);
+    
+    // SOF0: Y 2x2 sampled with table 0, Cb/Cr 1x1 with table 1
+    *p++ = 0xFF;
+    *p++ = 0xC0;
+    p = put_u16(p, 17);
+    *p++ = 8;
+    p = put_u16(p, enc->height);
+    p = put_u16(p, enc->width);
+    *p++ = 3;
+    *p++ = 1; *p++ = 0x22; *p++ = 0;
+    *p++ = 2; *p++ = 0x11; *p++ = 1;
+    *p++ = 3; *p++ = 0x11; *p++ = 1;
+    
+    // DRI: one MCU row per restart interval when encoding in strips
+    if (enc->strips > 1) {
+        *p++ = 0xFF;
+        *p++ = 0xDD;
+        p = put_u16(p, 4);
+        p = put_u16(p, enc->mcu_cols);
+    }
+    
+    // SOS: all three components in one interleaved scan
+    *p++ = 0xFF;
+    *p++ = 0xDA;
+    p = put_u16(p, 12);
+    *p++ = 3;
+    *p++ = 1; *p++ = 0x00;
+    *p++ = 2; *p++ = 0x11;
+    *p++ = 3; *p++ = 0x11;
+    *p++ = 0;
+    *p++ = 63;
+    *p++ = 0;
+    
+    enc->header_size = (size_t)(p - enc->header);
+    
+    // Abbreviated header: everything except the tables
+    memcpy(enc->abbrev_header, enc->header, enc->tables_begin);
+    memcpy(enc->abbrev_header + enc->tables_begin, enc->header + enc->tables_end,
+           enc->header_size - enc->tables_end);
+    enc->abbrev_header_size = enc->header_size - (enc->tables_end - enc->tables_begin);
+}
+
+// Complete header with the current quantization tables and the optimized DHT
+static void build_opt_header(NativeJpegEncoder* enc) {
+    uint8_t* p = enc->opt_header;
+    
+    memcpy(p, enc->header, enc->tables_begin);
+    p = put_dqt(p + enc->tables_begin, &enc->qt);
+    p = put_dht_tables(p, &enc->opt_huff);
+    memcpy(p, enc->header + enc->tables_end, enc->header_size - enc->tables_end);
+    enc->opt_header_size = (size_t)(p - enc->opt_header) + enc->header_size - enc->tables_end;
+}
+
+// ============================================================================
+// Scan Encoding
+// ============================================================================
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// MCU rows of strip s are [strip_row_begin, strip_row_end)
+static int strip_row_begin(const NativeJpegEncoder* enc, int s) {
+    return (int)((int64_t)s * enc->mcu_rows / enc->strips);
+}
+
+static int strip_row_end(const NativeJpegEncoder* enc, int s) {
+    return strip_row_begin(enc, s + 1);
+}
+
+// Load MCU (mx, my): returns its 16x16 luma (edge MCUs padded into luma_edge)
+// and splits its Cb/Cr blocks
+static inline const uint8_t* load_mcu(const NativeJpegEncoder* enc, const FrameJob* job, int mx, int my,
+                                      uint8_t* luma_edge, int* luma_stride, uint8_t* u_block, uint8_t* v_block) {
+    int cx0 = mx * 8, cy0 = my * 8;
+    if (cx0 + 8 <= enc->chroma_width && cy0 + 8 <= enc->chroma_height) {
+        split_uv_block(job->uv + (size_t)cy0 * job->uv_stride + cx0 * 2, job->uv_stride, u_block, v_block);
+    } else {
+        fetch_chroma_edge(job->uv, job->uv_stride, enc->chroma_width, enc->chroma_height,
+                          cx0, cy0, u_block, v_block);
+    }
+    
+    int x0 = mx * 16, y0 = my * 16;
+    if (x0 + 16 <= enc->width && y0 + 16 <= enc->height) {
+        *luma_stride = job->y_stride;
+        return job->y + (size_t)y0 * job->y_stride + x0;
+    }
+    fetch_luma_edge(job->y, job->y_stride, enc->width, enc->height, x0, y0, luma_edge);
+    *luma_stride = 16;
+    return luma_edge;
+}
+
+// The rows of MCU row my were just read and are still in cache: hand them to the caller
+static inline void notify_row(const NativeJpegEncoder* enc, const FrameJob* job, int my) {
+    if (enc->row_fn) {
+        int y0 = my * 16;
+        enc->row_fn(enc->row_opaque, job->y, job->y_stride, job->uv, job->uv_stride,
+                    y0, y0 + 16 < enc->height ? y0 + 16 : enc->height);
+    }
+}
+
+// With strips, each MCU row is a restart interval: every row except the frame's
+// last ends with RSTn (n = row index mod 8), so strips can simply be joined
+static inline int ends_restart_interval(const NativeJpegEncoder* enc, int my) {
+    return enc->strips > 1 && my != enc->mcu_rows - 1;
+}
+
+static inline void put_restart(BitWriter* bw, int my) {
+    bw_flush(bw);
+    *bw->p++ = 0xFF;
+    *bw->p++ = (uint8_t)(0xD0 + (my & 7));
+}
+
+// Quantize and entropy code one transformed block into every output
+static inline void encode_block_outputs(const NativeJpegEncoder* enc, const FrameJob* job, const float* coef,
+                                        int table, int comp, HuffCounts* counts, BitWriter* bw,
+                                        int (*last_dc)[3]) {
+    int16_t q[64] __attribute__((aligned(32)));
+    int16_t zz[64] __attribute__((aligned(16)));
+    
+    for (int o = 0; o < job->outputs; o++) {
+        enc->quant_block(coef, job->qt[o]->recip[table], q);
+        zigzag_block(q, enc->zigzag_src, zz);
+        if (counts && o == 0) {
+            encode_block_counted(&bw[o], zz, &last_dc[o][comp], &job->huff->dc[table], &job->huff->ac[table],
+                                 counts->dc[table], counts->ac[table]);
+        } else {
+            encode_block(&bw[o], zz, &last_dc[o][comp], &job->huff->dc[table], &job->huff->ac[table]);
+        }
+    }
+}
+
+// Encode MCU rows [row_begin, row_end) from the planes into bw[0..outputs-1],
+// counting output 0's symbols into counts (can be NULL). Returns -ENOMEM when
+// an output could run past its limit.
+static int encode_mcu_rows(const NativeJpegEncoder* enc, const FrameJob* job, HuffCounts* counts,
+                           int row_begin, int row_end, BitWriter* bw, const uint8_t* const* limit) {
+    int last_dc[NATIVE_JPEG_MAX_OUTPUTS][3] = { { 0 } };
+    
+    uint8_t luma_edge[256];
+    uint8_t u_block[64], v_block[64];
+    float coef[64] __attribute__((aligned(32)));
+    
+    for (int my = row_begin; my < row_end; my++) {
+        for (int mx = 0; mx < enc->mcu_cols; mx++) {
+            for (int o = 0; o < job->outputs; o++) {
+                if (bw[o].p > limit[o]) {
+                    return -ENOMEM;
+                }
+            }
+            
+            int luma_stride;
+            const uint8_t* luma = load_mcu(enc, job, mx, my, luma_edge, &luma_stride, u_block, v_block);
+            
+            for (int b = 0; b < 4; b++) {
+                const uint8_t* src = luma + (b >> 1) * 8 * luma_stride + (b & 1) * 8;
+                enc->fdct(src, luma_stride, coef);
+                encode_block_outputs(enc, job, coef, 0, 0, counts, bw, last_dc);
+            }
+            
+            enc->fdct(u_block, 8, coef);
+            encode_block_outputs(enc, job, coef, 1, 1, counts, bw, last_dc);
+            
+            enc->fdct(v_block, 8, coef);
+            encode_block_outputs(enc, job, coef, 1, 2, counts, bw, last_dc);
+        }
+        
+        notify_row(enc, job, my);
+        
+        if (ends_restart_interval(enc, my)) {
+            for (int o = 0; o < job->outputs; o++) {
+                put_restart(&bw[o], my);
+                last_dc[o][0] = last_dc[o][1] = last_dc[o][2] = 0;
+            }
+        }
+    }
+    
+    for (int o = 0; o < job->outputs; o++) {
+        bw_flush(&bw[o]);
+    }
+    return 0;
+}
+
+// Statistics pass (FRAME mode): quantize MCU rows [row_begin, row_end) of output 0
+// into blocks (6 zigzag-ordered blocks per MCU, in MCU order) and count their symbols
+static void gather_mcu_rows(const NativeJpegEncoder* enc, const FrameJob* job, int16_t* blocks,
+                            HuffCounts* counts, int row_begin, int row_end) {
+    int last_dc[3] = { 0 };
+    
+    uint8_t luma_edge[256];
+    uint8_t u_block[64], v_block[64];
+    float coef[64] __attribute__((aligned(32)));
+    int16_t q[64] __attribute__((aligned(32)));
+    
+    for (int my = row_begin; my < row_end; my++) {
+        for (int mx = 0; mx < enc->mcu_cols; mx++) {
+            int16_t* mcu = blocks + ((size_t)my * enc->mcu_cols + mx) * 6 * 64;
+            int luma_stride;
+            const uint8_t* luma = load_mcu(enc, job, mx, my, luma_edge, &luma_stride, u_block, v_block);
+            
+            for (int b = 0; b < 6; b++) {
+                int table = b < 4 ? 0 : 1;
+                int comp = b < 4 ? 0 : b - 3;
+                if (b < 4) {
+                    enc->fdct(luma + (b >> 1) * 8 * luma_stride + (b & 1) * 8, luma_stride, coef);
+                } else {
+                    enc->fdct(b == 4 ? u_block : v_block, 8, coef);
+                }
+                int16_t* zz = mcu + b * 64;
+                enc->quant_block(coef, job->qt[0]->recip[table], q);
+                zigzag_block(q, enc->zigzag_src, zz);
+                count_block(zz, last_dc[comp], counts->dc[table], counts->ac[table]);
+                last_dc[comp] = zz[0];
+            }
+        }
+        
+        notify_row(enc, job, my);
+        
+        if (ends_restart_interval(enc, my)) {
+            last_dc[0] = last_dc[1] = last_dc[2] = 0;
+        }
+    }
+}
+
+// Second pass (FRAME mode): entropy code the stored blocks of MCU rows [row_begin, row_end)
+static int encode_stored_rows(const NativeJpegEncoder* enc, const FrameJob* job,
+                              int row_begin, int row_end, BitWriter* bw, const uint8_t* limit) {
+    int last_dc[3] = { 0 };
+    
+    for (int my = row_begin; my < row_end; my++) {
+        for (int mx = 0; mx < enc->mcu_cols; mx++) {
+            if (bw->p > limit) {
+                return -ENOMEM;
+            }
+            
+            const int16_t* mcu = job->blocks + ((size_t)my * enc->mcu_cols + mx) * 6 * 64;
+            for (int b = 0; b < 6; b++) {
+                int table = b < 4 ? 0 : 1;
+                int comp = b < 4 ? 0 : b - 3;
+                encode_block(bw, mcu + b * 64, &last_dc[comp], &job->huff->dc[table], &job->huff->ac[table]);
+            }
+        }
+        
+        if (ends_restart_interval(enc, my)) {
+            put_restart(bw, my);
+            last_dc[0] = last_dc[1] = last_dc[2] = 0;
+        }
+    }
+    
+    bw_flush(bw);
+    return 0;
+}
+
+// Entropy code the MCU rows of strip s (counts restart from zero, so a redone
+// strip is not counted twice)
+static int encode_strip_rows(const NativeJpegEncoder* enc, const FrameJob* job, int s,
+                             BitWriter* bw, const uint8_t* const* limit) {
+    if (job->blocks) {
+        return encode_stored_rows(enc, job, strip_row_begin(enc, s), strip_row_end(enc, s), bw, limit[0]);
+    }
+    HuffCounts* counts = NULL;
+    if (job->counts) {
+        counts = &job->counts[s];
+        memset(counts, 0, sizeof(*counts));
+    }
+    return encode_mcu_rows(enc, job, counts, strip_row_begin(enc, s), strip_row_end(enc, s), bw, limit);
+}
+
+// On -ENOMEM every output reports the size that always fits
+static int encode_frame_too_small(const NativeJpegEncoder* enc, int outputs, size_t* out_size) {
+    for (int o = 0; o < outputs; o++) {
+        out_size[o] = native_jpeg_max_output_size(enc);
+    }
+    return -ENOMEM;
+}
+
+// Encode one frame into the job's outputs, each with its table set and header
+static int encode_frame(NativeJpegEncoder* enc, const FrameJob* job,
+                        const uint8_t* const* header, const size_t* header_size,
+                        uint8_t* const* out, const size_t* out_capacity, size_t* out_size, double* strip_ms) {
+    int outputs = job->outputs;
+    uint8_t* scan[NATIVE_JPEG_MAX_OUTPUTS];
+    const uint8_t* limit[NATIVE_JPEG_MAX_OUTPUTS];
+    BitWriter bw[NATIVE_JPEG_MAX_OUTPUTS];
+    
+    for (int o = 0; o < outputs; o++) {
+        if (out_capacity[o] < header_size[o] + NATIVE_MCU_MAX_BYTES) {
+            return encode_frame_too_small(enc, outputs, out_size);
+        }
+    }
+    for (int o = 0; o < outputs; o++) {
+        memcpy(out[o], header[o], header_size[o]);
+        scan[o] = out[o] + header_size[o];
+        limit[o] = out[o] + out_capacity[o] - NATIVE_MCU_MAX_BYTES;
+    }
+    
+    if (enc->strips == 1) {
+        for (int o = 0; o < outputs; o++) {
+            bw[o] = (BitWriter){ 0, 0, scan[o] };
+        }
+        double t_start = now_ms();
+        int ret = encode_strip_rows(enc, job, 0, bw, limit);
+        if (ret < 0) {
+            return encode_frame_too_small(enc, outputs, out_size);
+        }
+        if (strip_ms) {
+            strip_ms[0] = now_ms() - t_start;
+        }
+        for (int o = 0; o < outputs; o++) {
+            *bw[o].p++ = 0xFF;
+            *bw[o].p++ = 0xD9;
+            out_size[o] = (size_t)(bw[o].p - out[o]);
+        }
+        return 0;
+    }
+    
+    // Scratch for strips 1..n-1, sized for their share of the raw frame
+    for (int o = 0; o < outputs; o++) {
+        for (int s = 1; s < enc->strips; s++) {
+            if (!enc->strip_buf[o][s]) {
+                int rows = strip_row_end(enc, s) - strip_row_begin(enc, s);
+                enc->strip_capacity[o][s] = (size_t)rows * enc->mcu_cols * 384 + NATIVE_MCU_MAX_BYTES;
+                enc->strip_buf[o][s] = (uint8_t*)malloc(enc->strip_capacity[o][s]);
+                if (!enc->strip_buf[o][s]) {
+                    return -ENOMEM;
+                }
+            }
+        }
+    }
+    
+    size_t strip_size[NATIVE_JPEG_MAX_OUTPUTS][NATIVE_JPEG_MAX_STRIPS];
+    int status[NATIVE_JPEG_MAX_STRIPS];
+    
+    #pragma omp parallel for schedule(static, 1)
+    for (int s = 0; s < enc->strips; s++) {
+        uint8_t* dst[NATIVE_JPEG_MAX_OUTPUTS];
+        const uint8_t* strip_limit[NATIVE_JPEG_MAX_OUTPUTS];
+        BitWriter strip_bw[NATIVE_JPEG_MAX_OUTPUTS];
+        for (int o = 0; o < outputs; o++) {
+            dst[o] = s == 0 ? scan[o] : enc->strip_buf[o][s];
+            strip_limit[o] = s == 0 ? limit[o]
+                                    : enc->strip_buf[o][s] + enc->strip_capacity[o][s] - NATIVE_MCU_MAX_BYTES;
+            strip_bw[o] = (BitWriter){ 0, 0, dst[o] };
+        }
+        double t_start = now_ms();
+        status[s] = encode_strip_rows(enc, job, s, strip_bw, strip_limit);
+        for (int o = 0; o < outputs; o++) {
+            strip_size[o][s] = (size_t)(strip_bw[o].p - dst[o]);
+        }
+        if (strip_ms) {
+            strip_ms[s] = now_ms() - t_start;
+        }
+    }
+    
+    if (status[0] < 0) {
+        return encode_frame_too_small(enc, outputs, out_size);
+    }
+    
+    // Rare: a strip outgrew its share of the raw size; grow its scratch and redo it
+    for (int s = 1; s < enc->strips; s++) {
+        if (status[s] == 0) {
+            continue;
+        }
+        int rows = strip_row_end(enc, s) - strip_row_begin(enc, s);
+        size_t capacity = ((size_t)rows * enc->mcu_cols + 1) * NATIVE_MCU_MAX_BYTES;
+        const uint8_t* strip_limit[NATIVE_JPEG_MAX_OUTPUTS];
+        BitWriter strip_bw[NATIVE_JPEG_MAX_OUTPUTS];
+        for (int o = 0; o < outputs; o++) {
+            uint8_t* buf = (uint8_t*)realloc(enc->strip_buf[o][s], capacity);
+            if (!buf) {
+                return -ENOMEM;
+            }
+            enc->strip_buf[o][s] = buf;
+            enc->strip_capacity[o][s] = capacity;
+            strip_limit[o] = buf + capacity - NATIVE_MCU_MAX_BYTES;
+            strip_bw[o] = (BitWriter){ 0, 0, buf };
+        }
+        
+        encode_strip_rows(enc, job, s, strip_bw, strip_limit);
+        for (int o = 0; o < outputs; o++) {
+            strip_size[o][s] = (size_t)(strip_bw[o].p - enc->strip_buf[o][s]);
+        }
+    }
+    
+    // Join: strips already end with the RSTn of their last row
+    int too_small = 0;
+    for (int o = 0; o < outputs; o++) {
+        size_t total = header_size[o] + 2;
+        for (int s = 0; s < enc->strips; s++) {
+            total += strip_size[o][s];
+        }
+        out_size[o] = total;
+        too_small |= total > out_capacity[o];
+    }
+    if (too_small) {
+        return -ENOMEM;
+    }
+    
+    for (int o = 0; o < outputs; o++) {
+        uint8_t* p = scan[o] + strip_size[o][0];
+        for (int s = 1; s < enc->strips; s++) {
+            memcpy(p, enc->strip_buf[o][s], strip_size[o][s]);
+            p += strip_size[o][s];
+        }
+        *p++ = 0xFF;
+        *p++ = 0xD9;
+    }
+    
+    return 0;
+}
+
+// ============================================================================
+// Optimized Huffman Tables
+// ============================================================================
+
+// Add the counts of strips 1..n-1 into strip 0
+static void merge_strip_counts(NativeJpegEncoder* enc) {
+    HuffCounts* total = &enc->strip_counts[0];
+    for (int s = 1; s < enc->strips; s++) {
+        const HuffCounts* c = &enc->strip_counts[s];
+        for (int t = 0; t < 2; t++) {
+            for (int sym = 0; sym < 256; sym++) {
+                total->dc[t][sym] += c->dc[t][sym];
+                total->ac[t][sym] += c->ac[t][sym];
+            }
+        }
+    }
+}
+
+// FRAME mode statistics pass: quantize the whole frame into enc->blocks, counting symbols per strip
+static int gather_frame(NativeJpegEncoder* enc, const FrameJob* job, double* strip_ms) {
+    if (!enc->blocks) {
+        size_t size = (size_t)enc->mcu_cols * enc->mcu_rows * 6 * 64 * sizeof(int16_t);
+        enc->blocks = (int16_t*)aligned_alloc(32, (size + 31) & ~(size_t)31);
+        if (!enc->blocks) {
+            return -ENOMEM;
+        }
+    }
+    
+    #pragma omp parallel for schedule(static, 1)
+    for (int s = 0; s < enc->strips; s++) {
+        double t_start = now_ms();
+        memset(&enc->strip_counts[s], 0, sizeof(HuffCounts));
+        gather_mcu_rows(enc, job, enc->blocks, &enc->strip_counts[s], strip_row_begin(enc, s), strip_row_end(enc, s));
+        strip_ms[s] = now_ms() - t_start;
+    }
+    merge_strip_counts(enc);
+    return 0;
+}
+
+// STREAM mode: replace the oldest frame's counts in the window and rebuild the
+// tables for the next frame. Every valid symbol keeps a code, since the next
+// frame may use symbols the window has not seen.
+static void huffman_window_push(NativeJpegEncoder* enc, const HuffCounts* frame) {
+    HuffCounts* oldest = &enc->window[enc->window_pos];
+    HuffCounts* sum = &enc->window_sum;
+    
+    for (int t = 0; t < 2; t++) {
+        for (int sym = 0; sym < 256; sym++) {
+            sum->dc[t][sym] += frame->dc[t][sym] - oldest->dc[t][sym];
+            sum->ac[t][sym] += frame->ac[t][sym] - oldest->ac[t][sym];
+        }
+    }
+    *oldest = *frame;
+    enc->window_pos = (enc->window_pos + 1) % enc->window_size;
+    build_optimal_tables(&enc->opt_huff, sum, 1);
+}
+
+// Encode one complete frame with optimized Huffman tables. FRAME: a statistics
+// pass stores the quantized blocks, then they are entropy coded with tables built
+// for them. STREAM: one pass with the window's tables while counting this
+// frame's symbols for the next frame.
+static int encode_frame_optimized(NativeJpegEncoder* enc, FrameJob* job, uint8_t* out, size_t out_capacity,
+                                  size_t* out_size, double* strip_ms) {
+    double gather_ms[NATIVE_JPEG_MAX_STRIPS] = { 0 };
+    
+    if (enc->huffman == NATIVE_JPEG_HUFFMAN_FRAME) {
+        int ret = gather_frame(enc, job, gather_ms);
+        if (ret < 0) {
+            return ret;
+        }
+        build_optimal_tables(&enc->opt_huff, &enc->strip_counts[0], 0);
+        job->blocks = enc->blocks;
+    } else {
+        job->counts = enc->strip_counts;
+    }
+    job->huff = &enc->opt_huff;
+    build_opt_header(enc);
+    
+    const uint8_t* header = enc->opt_header;
+    size_t header_size = enc->opt_header_size;
+    int ret = encode_frame(enc, job, &header, &header_size, &out, &out_capacity, out_size, strip_ms);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    if (enc->huffman == NATIVE_JPEG_HUFFMAN_STREAM) {
+        merge_strip_counts(enc);
+    }
+    enc->huffman_saved = huffman_saved_bytes(&enc->strip_counts[0], &enc->opt_huff, &enc->std_huff);
+    if (enc->huffman == NATIVE_JPEG_HUFFMAN_STREAM) {
+        huffman_window_push(enc, &enc->strip_counts[0]);
+    }
+    
+    if (strip_ms) {
+        for (int s = 0; s < enc->strips; s++) {
+            strip_ms[s] += gather_ms[s];
+        }
+    }
+    return 0;
+}
+
+// ============================================================================
+// Public Functions
+// ============================================================================
+
+NativeJpegEncoder* native_jpeg_create(int width, int height, int quality, int strips) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535) {
+        fprintf(stderr, "Invalid native JPEG dimensions: %dx%d\n", width, height);
+        return NULL;
+    }
+    
+    NativeJpegEncoder* enc = (NativeJpegEncoder*)aligned_alloc(32, (sizeof(NativeJpegEncoder) + 31) & ~(size_t)31);
+    if (!enc) {
+        fprintf(stderr, "Failed to allocate native JPEG encoder\n");
+        return NULL;
+    }
+    memset(enc, 0, sizeof(*enc));
+    
+    enc->width = width;
+    enc->height = height;
+    enc->chroma_width = (width + 1) / 2;
+    enc->chroma_height = (height + 1) / 2;
+    enc->mcu_cols = (width + 15) / 16;
+    enc->mcu_rows = (height + 15) / 16;
+    
+    if (strips > NATIVE_JPEG_MAX_STRIPS) strips = NATIVE_JPEG_MAX_STRIPS;
+    if (strips > enc->mcu_rows) strips = enc->mcu_rows;
+    enc->strips = strips > 1 ? strips : 1;
+    
+    for (int k = 0; k < 64; k++) {
+        int n = zigzag_to_natural[k];
+        enc->zigzag_src[k] = (uint8_t)((n % 8) * 8 + n / 8);
+    }
+    
+    build_huff_table(&enc->std_huff.dc[0], dc_luma_bits, dc_luma_vals);
+    build_huff_table(&enc->std_huff.ac[0], ac_luma_bits, ac_luma_vals);
+    build_huff_table(&enc->std_huff.dc[1], dc_chroma_bits, dc_chroma_vals);
+    build_huff_table(&enc->std_huff.ac[1], ac_chroma_bits, ac_chroma_vals);
+    
+    memcpy(enc->base_quant[0], std_luma_quant, 64);
+    memcpy(enc->base_quant[1], std_chroma_quant, 64);
+    
+    build_quant_tables(enc, &enc->qt, quality);
+    build_header(enc);
+    
+    enc->fdct = fdct_c;
+    enc->quant_block = quant_c;
+    enc->simd_name = "c";
+#if defined(NATIVE_JPEG_SSE2)
+    enc->fdct = fdct_sse2;
+    enc->quant_block = quant_sse2;
+    enc->simd_name = "sse2";
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        enc->fdct = fdct_avx2;
+        enc->quant_block = quant_avx2;
+        enc->simd_name = "avx2";
+    }
+#elif defined(NATIVE_JPEG_NEON)
+    enc->fdct = fdct_neon;
+    enc->quant_block = quant_neon;
+    enc->simd_name = "neon";
+#endif
+    
+    return enc;
+}
+
+int native_jpeg_encode(NativeJpegEncoder* enc, const uint8_t* y, int y_stride,
+                       const uint8_t* uv, int uv_stride,
+                       uint8_t* out, size_t out_capacity, size_t* out_size, double* strip_ms) {
+    if (!enc || !y || !uv || !out || !out_size) {
+        return -EINVAL;
+    }
+    
+    const QuantTables* qt = &enc->qt;
+    FrameJob job = { y, y_stride, uv, uv_stride, 1, &qt, &enc->std_huff, NULL, NULL };
+    if (enc->huffman != NATIVE_JPEG_HUFFMAN_STANDARD && !enc->abbreviated) {
+        return encode_frame_optimized(enc, &job, out, out_capacity, out_size, strip_ms);
+    }
+    
+    enc->huffman_saved = 0;
+    const uint8_t* header = enc->abbreviated ? enc->abbrev_header : enc->header;
+    size_t header_size = enc->abbreviated ? enc->abbrev_header_size : enc->header_size;
+    return encode_frame(enc, &job, &header, &header_size, &out, &out_capacity, out_size, strip_ms);
+}
+
+int native_jpeg_encode_multi(NativeJpegEncoder* enc, const uint8_t* y, int y_stride,
+                             const uint8_t* uv, int uv_stride, const int* qualities, int count,
+                             uint8_t* const* out, const size_t* out_capacity, size_t* out_size, double* strip_ms) {
+    const QuantTables* qt[NATIVE_JPEG_MAX_OUTPUTS];
+    const uint8_t* header[NATIVE_JPEG_MAX_OUTPUTS];
+    size_t header_size[NATIVE_JPEG_MAX_OUTPUTS];
+    
+    if (!enc || !y || !uv || !qualities || count < 1 || count > NATIVE_JPEG_MAX_OUTPUTS ||
+        !out || !out_capacity || !out_size) {
+        return -EINVAL;
+    }
+    
+    // Table sets and headers are rebuilt only when an output's quality changes;
+    // headers are the complete header with that output's DQT
+    for (int o = 0; o < count; o++) {
+        if (qualities[o] < 1 || qualities[o] > 100 || !out[o]) {
+            return -EINVAL;
+        }
+        if (enc->multi_qt[o].quality != qualities[o]) {
+            build_quant_tables(enc, &enc->multi_qt[o], qualities[o]);
+            memcpy(enc->multi_header[o], enc->header, enc->header_size);
+            put_dqt(enc->multi_header[o] + enc->tables_begin, &enc->multi_qt[o]);
+        }
+        qt[o] = &enc->multi_qt[o];
+        header[o] = enc->multi_header[o];
+        header_size[o] = enc->header_size;
+    }
+    
+    enc->huffman_saved = 0;
+    FrameJob job = { y, y_stride, uv, uv_stride, count, qt, &enc->std_huff, NULL, NULL };
+    return encode_frame(enc, &job, header, header_size, out, out_capacity, out_size, strip_ms);
+}
+
+size_t native_jpeg_max_output_size(const NativeJpegEncoder* enc) {
+    if (!enc) {
+        return 0;
+    }
+    return enc->header_size + (size_t)(enc->mcu_cols * enc->mcu_rows + 1) * NATIVE_MCU_MAX_BYTES;
+}
+
+size_t native_jpeg_output_reserve(const NativeJpegEncoder* enc) {
+    if (!enc) {
+        return 0;
+    }
+    return enc->header_size + NATIVE_MCU_MAX_BYTES;
+}
+
+int native_jpeg_set_quality(NativeJpegEncoder* enc, int quality) {
+    if (!enc || quality < 1 || quality > 100) {
+        return -EINVAL;
+    }
+    if (quality == enc->qt.quality) {
+        return 0;
+    }
+    
+    // Tables and DQT are rebuilt in place; the header size does not change
+    build_quant_tables(enc, &enc->qt, quality);
+    build_header(enc);
+    return 0;
+}
+
+int native_jpeg_set_base_tables(NativeJpegEncoder* enc, const uint8_t* luma, const uint8_t* chroma) {
+    if (!enc || !luma != !chroma) {
+        return -EINVAL;
+    }
+    for (int n = 0; luma && n < 64; n++) {
+        if (!luma[n] || !chroma[n]) {
+            return -EINVAL;
+        }
+    }
+    
+    memcpy(enc->base_quant[0], luma ? luma : std_luma_quant, 64);
+    memcpy(enc->base_quant[1], chroma ? chroma : std_chroma_quant, 64);
+    
+    // Rescale for the current quality; multi-quality table sets are rebuilt on next use
+    build_quant_tables(enc, &enc->qt, enc->qt.quality);
+    build_header(enc);
+    for (int o = 0; o < NATIVE_JPEG_MAX_OUTPUTS; o++) {
+        enc->multi_qt[o].quality = 0;
+    }
+    return 0;
+}
+
+void native_jpeg_quality_tables(int quality, uint8_t* luma, uint8_t* chroma) {
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+    int scale = quality_scale(quality);
+    
+    for (int n = 0; n < 64; n++) {
+        luma[n] = scale_quant(std_luma_quant[n], scale);
+        chroma[n] = scale_quant(std_chroma_quant[n], scale);
+    }
+}
+
+void native_jpeg_set_abbreviated(NativeJpegEncoder* enc, int abbreviated) {
+    if (enc) {
+        enc->abbreviated = abbreviated;
+    }
+}
+
+int native_jpeg_write_tables(const NativeJpegEncoder* enc, uint8_t* out, size_t out_capacity, size_t* out_size) {
+    if (!enc || !out || !out_size) {
+        return -EINVAL;
+    }
+    
+    size_t tables_size = enc->tables_end - enc->tables_begin;
+    *out_size = tables_size + 4;
+    if (out_capacity < *out_size) {
+        return -ENOMEM;
+    }
+    out[0] = 0xFF;
+    out[1] = 0xD8;
+    memcpy(out + 2, enc->header + enc->tables_begin, tables_size);
+    out[tables_size + 2] = 0xFF;
+    out[tables_size + 3] = 0xD9;
+    return 0;
+}
+
+int native_jpeg_set_huffman(NativeJpegEncoder* enc, NativeJpegHuffman mode, int window) {
+    if (!enc || mode < NATIVE_JPEG_HUFFMAN_STANDARD || mode > NATIVE_JPEG_HUFFMAN_STREAM) {
+        return -EINVAL;
+    }
+    if (mode == NATIVE_JPEG_HUFFMAN_STREAM && (window < 1 || window > NATIVE_JPEG_MAX_HUFFMAN_WINDOW)) {
+        return -EINVAL;
+    }
+    
+    // Standard tables until the new mode's state is allocated
+    enc->huffman = NATIVE_JPEG_HUFFMAN_STANDARD;
+    enc->huffman_saved = 0;
+    free(enc->window);
+    enc->window = NULL;
+    if (mode != NATIVE_JPEG_HUFFMAN_FRAME) {
+        free(enc->blocks);
+        enc->blocks = NULL;
+    }
+    if (mode == NATIVE_JPEG_HUFFMAN_STANDARD) {
+        return 0;
+    }
+    
+    if (!enc->strip_counts) {
+        enc->strip_counts = (HuffCounts*)calloc(enc->strips, sizeof(HuffCounts));
+        if (!enc->strip_counts) {
+            return -ENOMEM;
+        }
+    }
+    if (mode == NATIVE_JPEG_HUFFMAN_STREAM) {
+        enc->window = (HuffCounts*)calloc(window, sizeof(HuffCounts));
+        if (!enc->window) {
+            return -ENOMEM;
+        }
+        enc->window_size = window;
+        enc->window_pos = 0;
+        memset(&enc->window_sum, 0, sizeof(enc->window_sum));
+    }
+    
+    // The first streamed frame uses the standard tables
+    enc->opt_huff = enc->std_huff;
+    enc->huffman = mode;
+    return 0;
+}
+
+long native_jpeg_huffman_saved(const NativeJpegEncoder* enc) {
+    return enc ? enc->huffman_saved : 0;
+}
+
+void native_jpeg_set_row_callback(NativeJpegEncoder* enc, native_jpeg_row_fn fn, void* opaque) {
+    if (enc) {
+        enc->row_fn = fn;
+        enc->row_opaque = opaque;
+    }
+}
+
+int native_jpeg_quality(const NativeJpegEncoder* enc) {
+    return enc ? enc->qt.quality : 0;
+}
+
+const char* native_jpeg_simd_name(const NativeJpegEncoder* enc) {
+    return enc ? enc->simd_name : "none";
+}
+
+int native_jpeg_strips(const NativeJpegEncoder* enc) {
+    return enc ? enc->strips : 0;
+}
+
+void native_jpeg_destroy(NativeJpegEncoder* enc) {
+    if (!enc) {
+        return;
+    }
+    for (int o = 0; o < NATIVE_JPEG_MAX_OUTPUTS; o++) {
+        for (int s = 0; s < NATIVE_JPEG_MAX_STRIPS; s++) {
+            free(enc->strip_buf[o][s]);
+        }
+    }
+    free(enc->strip_counts);
+    free(enc->window);
+    free(enc->blocks);
+    free(enc);
+}
@@ -0,0 +1,211 @@
+/*
+ * Native Baseline JPEG Encoder for NV12 (internal)
+ *
+ * Self-contained 4:2:0 baseline JPEG encoder used by NV12_MJPEG_BACKEND_NATIVE.
+ * Reads NV12 directly (no AVFrame/AVPacket plumbing). Not part of the public API.
+ */
+
+#ifndef NV12_JPEG_NATIVE_H
+#define NV12_JPEG_NATIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NativeJpegEncoder NativeJpegEncoder;
+
+#define NATIVE_JPEG_MAX_STRIPS 32
+#define NATIVE_JPEG_MAX_OUTPUTS 4
+#define NATIVE_JPEG_MAX_HUFFMAN_WINDOW 16
+
+/**
+ * Huffman table selection
+ */
+typedef enum NativeJpegHuffman {
+    NATIVE_JPEG_HUFFMAN_STANDARD = 0, // Annex K tables
+    NATIVE_JPEG_HUFFMAN_FRAME,        // Tables optimized for each frame (statistics pass + coding pass)
+    NATIVE_JPEG_HUFFMAN_STREAM,       // Tables from the previous frames' statistics (one pass)
+} NativeJpegHuffman;
+
+/**
+ * Per-MCU-row callback: luma rows [row_begin, row_end) and their chroma rows
+ * have just been encoded. Strips call it concurrently for different rows.
+ */
+typedef void (*native_jpeg_row_fn)(void* opaque, const uint8_t* y, int y_stride,
+                                   const uint8_t* uv, int uv_stride, int row_begin, int row_end);
+
+/**
+ * Create native encoder
+ *
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ * @param quality JPEG quality factor (1-100, higher is better, libjpeg scaling)
+ * @param strips Horizontal strips encoded in parallel (clamped to 1..32 and MCU rows);
+ *               more than one adds a restart marker after every MCU row
+ * @return Encoder, or NULL on failure
+ */
+NativeJpegEncoder* native_jpeg_create(int width, int height, int quality, int strips);
+
+/**
+ * Encode one NV12 frame to a complete baseline JPEG
+ *
+ * @param enc Native encoder
+ * @param y Y plane
+ * @param y_stride Y plane stride in bytes
+ * @param uv Interleaved UV plane
+ * @param uv_stride UV plane stride in bytes
+ * @param out Output buffer
+ * @param out_capacity Size of output buffer in bytes
+ * @param out_size Pointer to store encoded size (required size on -ENOMEM)
+ * @param strip_ms Per-strip encode time in ms (native_jpeg_strips() entries, can be NULL)
+ * @return 0 on success, -ENOMEM if the output buffer may be too small
+ */
+int native_jpeg_encode(NativeJpegEncoder* enc, const uint8_t* y, int y_stride,
+                       const uint8_t* uv, int uv_stride,
+                       uint8_t* out, size_t out_capacity, size_t* out_size, double* strip_ms);
+
+/**
+ * Encode one NV12 frame to several complete JPEGs of different qualities in one pass.
+ * Each block is transformed once and quantized/entropy coded per output; outputs
+ * are always complete (abbreviated mode does not apply).
+ *
+ * @param enc Native encoder
+ * @param y Y plane
+ * @param y_stride Y plane stride in bytes
+ * @param uv Interleaved UV plane
+ * @param uv_stride UV plane stride in bytes
+ * @param qualities Quality factor per output (1-100)
+ * @param count Number of outputs (1..NATIVE_JPEG_MAX_OUTPUTS)
+ * @param out Output buffer per output
+ * @param out_capacity Size of each output buffer in bytes
+ * @param out_size Encoded size per output (required sizes on -ENOMEM)
+ * @param strip_ms Per-strip encode time in ms (can be NULL)
+ * @return 0 on success, -ENOMEM if an output buffer may be too small
+ */
+int native_jpeg_encode_multi(NativeJpegEncoder* enc, const uint8_t* y, int y_stride,
+                             const uint8_t* uv, int uv_stride, const int* qualities, int count,
+                             uint8_t* const* out, const size_t* out_capacity, size_t* out_size, double* strip_ms);
+
+/**
+ * Get worst-case encoded size (buffers of this size never fail with -ENOMEM)
+ */
+size_t native_jpeg_max_output_size(const NativeJpegEncoder* enc);
+
+/**
+ * Get output headroom beyond the entropy-coded data (headers, EOI, last MCU).
+ * A buffer of (expected scan size + reserve) only fails if the scan is larger.
+ */
+size_t native_jpeg_output_reserve(const NativeJpegEncoder* enc);
+
+/**
+ * Change quality for the following frames (rebuilds quantization tables and DQT, no reallocation)
+ *
+ * @param enc Native encoder
+ * @param quality JPEG quality factor (1-100)
+ * @return 0 on success, -EINVAL on invalid quality
+ */
+int native_jpeg_set_quality(NativeJpegEncoder* enc, int quality);
+
+/**
+ * Replace the tables that quality scales (default: ITU-T T.81 Annex K). At
+ * quality 50 frames use them as given. Takes effect from the next frame.
+ *
+ * @param enc Native encoder
+ * @param luma 64 luma table entries in natural (row-major) order, 1-255 (NULL with chroma NULL = Annex K)
+ * @param chroma 64 chroma table entries in natural order, 1-255
+ * @return 0 on success, -EINVAL on invalid tables
+ */
+int native_jpeg_set_base_tables(NativeJpegEncoder* enc, const uint8_t* luma, const uint8_t* chroma);
+
+/**
+ * Get the Annex K tables scaled to a quality (libjpeg scaling, as used by
+ * native_jpeg_create() without custom base tables)
+ *
+ * @param quality JPEG quality factor (clamped to 1-100)
+ * @param luma Receives 64 luma table entries in natural order
+ * @param chroma Receives 64 chroma table entries in natural order
+ */
+void native_jpeg_quality_tables(int quality, uint8_t* luma, uint8_t* chroma);
+
+/**
+ * Get current quality factor
+ */
+int native_jpeg_quality(const NativeJpegEncoder* enc);
+
+/**
+ * Select abbreviated output: frames without DQT/DHT (JPEG abbreviated format).
+ * The tables come from native_jpeg_write_tables() and change with the quality.
+ *
+ * @param enc Native encoder
+ * @param abbreviated 1 to omit tables from the following frames, 0 for complete frames
+ */
+void native_jpeg_set_abbreviated(NativeJpegEncoder* enc, int abbreviated);
+
+/**
+ * Write the tables-only stream (SOI, DQT, DHT, EOI) for the current quality
+ *
+ * @param enc Native encoder
+ * @param out Output buffer
+ * @param out_capacity Size of output buffer in bytes
+ * @param out_size Pointer to store the stream size (required size on -ENOMEM)
+ * @return 0 on success, -ENOMEM if the buffer is too small
+ */
+int native_jpeg_write_tables(const NativeJpegEncoder* enc, uint8_t* out, size_t out_capacity, size_t* out_size);
+
+/**
+ * Select the Huffman tables of the following complete frames. Multi-quality and
+ * abbreviated frames always use the standard tables.
+ *
+ * FRAME keeps the frame's quantized coefficients (3 bytes per pixel) between a
+ * statistics pass and the coding pass. STREAM codes each
+ * frame in one pass with tables built from the symbol counts of the previous
+ * window frames (standard tables for the first frame).
+ *
+ * @param enc Native encoder
+ * @param mode Table selection
+ * @param window STREAM: frames of statistics (1..NATIVE_JPEG_MAX_HUFFMAN_WINDOW), ignored otherwise
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOMEM (standard tables stay selected)
+ */
+int native_jpeg_set_huffman(NativeJpegEncoder* enc, NativeJpegHuffman mode, int window);
+
+/**
+ * Get the estimated size saving of the optimized Huffman tables on the last frame
+ * (bytes against the standard tables, negative if larger; 0 with standard tables)
+ */
+long native_jpeg_huffman_saved(const NativeJpegEncoder* enc);
+
+/**
+ * Set a callback run after each MCU row of the following encodes, so that
+ * other per-pixel work can reuse the rows while they are in cache
+ *
+ * @param enc Native encoder
+ * @param fn Callback (NULL to disable)
+ * @param opaque User pointer passed to fn
+ */
+void native_jpeg_set_row_callback(NativeJpegEncoder* enc, native_jpeg_row_fn fn, void* opaque);
+
+/**
+ * Get name of the selected DCT/quantization code path ("avx2", "sse2", "neon", "c")
+ */
+const char* native_jpeg_simd_name(const NativeJpegEncoder* enc);
+
+/**
+ * Get number of strips actually used
+ */
+int native_jpeg_strips(const NativeJpegEncoder* enc);
+
+/**
+ * Destroy native encoder
+ *
+ * @param enc Native encoder (can be NULL)
+ */
+void native_jpeg_destroy(NativeJpegEncoder* enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NV12_JPEG_NATIVE_H
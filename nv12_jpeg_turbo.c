@@ -0,0 +1,429 @@
+/*
+ * TurboJPEG Encoder/Decoder for NV12
+ *
+ * Frames go through tjCompressFromYUVPlanes() and tjDecompressToYUVPlanes():
+ * libjpeg-turbo's SIMD DCT and Huffman coding without its color conversion.
+ * Only the chroma layout differs from NV12. The Y plane is passed to the
+ * library in place, and the interleaved UV plane is split into U and V planes
+ * before encoding or interleaved from them after decoding. Both directions are
+ * vectorized: SSE2 on x86, NEON on ARM, with a scalar fallback.
+ */
+
+#include "nv12_jpeg_turbo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef NV12_MJPEG_HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__SSE2__)
+#define TURBO_JPEG_SSE2 1
+#include <emmintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define TURBO_JPEG_NEON 1
+#include <arm_neon.h>
+#endif
+
+const char* turbo_jpeg_simd_name(void) {
+#if defined(TURBO_JPEG_SSE2)
+    return "sse2";
+#elif defined(TURBO_JPEG_NEON)
+    return "neon";
+#else
+    return "c";
+#endif
+}
+
+#ifdef NV12_MJPEG_HAVE_TURBOJPEG
+
+struct TurboJpegEncoder {
+    tjhandle handle;
+    int width;
+    int height;
+    int chroma_width;
+    int chroma_height;
+    int quality;
+    uint8_t* chroma;              // U plane then V plane, chroma_width x chroma_height each
+    unsigned char* out;           // Worst-case output for callers with smaller buffers (tjAlloc)
+    unsigned long out_capacity;   // tjBufSize() of the frame
+};
+
+struct TurboJpegDecoder {
+    tjhandle handle;
+    uint8_t* chroma;              // Decoded U and V planes (after Y for odd sizes)
+    size_t chroma_capacity;
+};
+
+// ============================================================================
+// NV12 Chroma Split/Interleave
+// ============================================================================
+
+// Split one row of interleaved UV pairs into U and V
+static void split_uv_row(const uint8_t* uv, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+#if defined(TURBO_JPEG_SSE2)
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(uv + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(uv + 2 * x + 16));
+        _mm_storeu_si128((__m128i*)(u + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i*)(v + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#elif defined(TURBO_JPEG_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t p = vld2q_u8(uv + 2 * x);
+        vst1q_u8(u + x, p.val[0]);
+        vst1q_u8(v + x, p.val[1]);
+    }
+#endif
+    for (; x < width; x++) {
+        u[x] = uv[2 * x];
+        v[x] = uv[2 * x + 1];
+    }
+}
+
+// Interleave one row of U and V into UV pairs
+static void merge_uv_row(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    int x = 0;
+#if defined(TURBO_JPEG_SSE2)
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(u + x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(v + x));
+        _mm_storeu_si128((__m128i*)(uv + 2 * x), _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i*)(uv + 2 * x + 16), _mm_unpackhi_epi8(a, b));
+    }
+#elif defined(TURBO_JPEG_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t p = { { vld1q_u8(u + x), vld1q_u8(v + x) } };
+        vst2q_u8(uv + 2 * x, p);
+    }
+#endif
+    for (; x < width; x++) {
+        uv[2 * x] = u[x];
+        uv[2 * x + 1] = v[x];
+    }
+}
+
+// ============================================================================
+// Encoder
+// ============================================================================
+
+TurboJpegEncoder* turbo_jpeg_encoder_create(int width, int height, int quality) {
+    // Even sizes: the library reads Y padded to whole chroma samples
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535 || (width | height) & 1 ||
+        quality < 1 || quality > 100) {
+        fprintf(stderr, "Invalid TurboJPEG encoder parameters: %dx%d, quality %d\n", width, height, quality);
+        return NULL;
+    }
+    
+    TurboJpegEncoder* enc = (TurboJpegEncoder*)calloc(1, sizeof(TurboJpegEncoder));
+    if (!enc) {
+        fprintf(stderr, "Failed to allocate TurboJPEG encoder\n");
+        return NULL;
+    }
+    enc->width = width;
+    enc->height = height;
+    enc->chroma_width = (width + 1) / 2;
+    enc->chroma_height = (height + 1) / 2;
+    enc->quality = quality;
+    enc->out_capacity = tjBufSize(width, height, TJSAMP_420);
+    
+    enc->handle = tjInitCompress();
+    if (!enc->handle) {
+        fprintf(stderr, "Failed to initialize TurboJPEG compressor: %s\n", tjGetErrorStr2(NULL));
+        free(enc);
+        return NULL;
+    }
+    enc->chroma = (uint8_t*)malloc((size_t)enc->chroma_width * enc->chroma_height * 2);
+    enc->out = tjAlloc((int)enc->out_capacity);
+    if (!enc->chroma || !enc->out) {
+        fprintf(stderr, "Failed to allocate TurboJPEG encoder buffers\n");
+        turbo_jpeg_encoder_destroy(enc);
+        return NULL;
+    }
+    
+    return enc;
+}
+
+int turbo_jpeg_encode(TurboJpegEncoder* enc, const uint8_t* y, int y_stride,
+                      const uint8_t* uv, int uv_stride,
+                      uint8_t* out, size_t out_capacity, size_t* out_size) {
+    if (!enc || !y || !uv || !out || !out_size) {
+        return -EINVAL;
+    }
+    
+    int cw = enc->chroma_width;
+    int ch = enc->chroma_height;
+    uint8_t* u = enc->chroma;
+    uint8_t* v = enc->chroma + (size_t)cw * ch;
+    #pragma omp parallel for if(ch > 240)
+    for (int row = 0; row < ch; row++) {
+        split_uv_row(uv + (size_t)row * uv_stride, u + (size_t)row * cw, v + (size_t)row * cw, cw);
+    }
+    
+    // Large enough caller buffers are written directly; TJFLAG_NOREALLOC
+    // assumes tjBufSize() bytes, so smaller ones get a copy of the result
+    const unsigned char* planes[3] = { y, u, v };
+    int strides[3] = { y_stride, cw, cw };
+    unsigned char* dst = out_capacity >= enc->out_capacity ? out : enc->out;
+    unsigned long size = enc->out_capacity;
+    if (tjCompressFromYUVPlanes(enc->handle, planes, enc->width, strides, enc->height, TJSAMP_420,
+                                &dst, &size, enc->quality, TJFLAG_NOREALLOC) < 0) {
+        fprintf(stderr, "TurboJPEG encode failed: %s\n", tjGetErrorStr2(enc->handle));
+        return -EIO;
+    }
+    
+    *out_size = size;
+    if (dst != out) {
+        if (size > out_capacity) {
+            return -ENOMEM;
+        }
+        memcpy(out, dst, size);
+    }
+    return 0;
+}
+
+int turbo_jpeg_set_quality(TurboJpegEncoder* enc, int quality) {
+    if (!enc || quality < 1 || quality > 100) {
+        return -EINVAL;
+    }
+    enc->quality = quality;
+    return 0;
+}
+
+size_t turbo_jpeg_max_output_size(const TurboJpegEncoder* enc) {
+    return enc ? enc->out_capacity : 0;
+}
+
+void turbo_jpeg_encoder_destroy(TurboJpegEncoder* enc) {
+    if (!enc) {
+        return;
+    }
+    if (enc->handle) {
+        tjDestroy(enc->handle);
+    }
+    tjFree(enc->out);
+    free(enc->chroma);
+    free(enc);
+}
+
+// ============================================================================
+// Decoder
+// ============================================================================
+
+// Average 2x2 luma positions' worth of non-4:2:0 chroma into the NV12 UV plane.
+// hx/vy: luma pixels per chroma sample horizontally/vertically (1, 2 or 4).
+static void resample_chroma(const uint8_t* u, const uint8_t* v, int src_width, int src_height,
+                            int hx, int vy, uint8_t* uv, int uv_stride, int width, int height) {
+    #pragma omp parallel for if(height > 240)
+    for (int row = 0; row < height; row++) {
+        int y0 = 2 * row / vy;
+        int y1 = (2 * row + 1) / vy < src_height ? (2 * row + 1) / vy : src_height - 1;
+        const uint8_t* u0 = u + (size_t)y0 * src_width;
+        const uint8_t* u1 = u + (size_t)y1 * src_width;
+        const uint8_t* v0 = v + (size_t)y0 * src_width;
+        const uint8_t* v1 = v + (size_t)y1 * src_width;
+        uint8_t* d = uv + (size_t)row * uv_stride;
+        for (int x = 0; x < width; x++) {
+            int x0 = 2 * x / hx;
+            int x1 = (2 * x + 1) / hx < src_width ? (2 * x + 1) / hx : src_width - 1;
+            d[2 * x] = (uint8_t)((u0[x0] + u0[x1] + u1[x0] + u1[x1] + 2) >> 2);
+            d[2 * x + 1] = (uint8_t)((v0[x0] + v0[x1] + v1[x0] + v1[x1] + 2) >> 2);
+        }
+    }
+}
+
+TurboJpegDecoder* turbo_jpeg_decoder_create(void) {
+    TurboJpegDecoder* dec = (TurboJpegDecoder*)calloc(1, sizeof(TurboJpegDecoder));
+    if (!dec) {
+        fprintf(stderr, "Failed to allocate TurboJPEG decoder\n");
+        return NULL;
+    }
+    dec->handle = tjInitDecompress();
+    if (!dec->handle) {
+        fprintf(stderr, "Failed to initialize TurboJPEG decompressor: %s\n", tjGetErrorStr2(NULL));
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+int turbo_jpeg_load_tables(TurboJpegDecoder* dec, const uint8_t* tables, size_t tables_size) {
+    int width, height, subsamp, colorspace;
+    
+    if (!dec || !tables) {
+        return -EINVAL;
+    }
+    // The decompressor keeps the tables of a tables-only stream for the following frames
+    if (tjDecompressHeader3(dec->handle, tables, tables_size, &width, &height, &subsamp, &colorspace) < 0) {
+        fprintf(stderr, "TurboJPEG cannot load tables (libjpeg-turbo 2.1 or later needed): %s\n",
+                tjGetErrorStr2(dec->handle));
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int turbo_jpeg_read_header(TurboJpegDecoder* dec, const uint8_t* data, size_t size, int* width, int* height) {
+    int subsamp, colorspace;
+    
+    if (!dec || !data || !width || !height) {
+        return -EINVAL;
+    }
+    if (tjDecompressHeader3(dec->handle, data, size, width, height, &subsamp, &colorspace) < 0 ||
+        *width <= 0 || *height <= 0) {
+        fprintf(stderr, "Invalid JPEG header: %s\n", tjGetErrorStr2(dec->handle));
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int turbo_jpeg_decode(TurboJpegDecoder* dec, const uint8_t* data, size_t size,
+                      uint8_t* y, int y_stride, uint8_t* uv, int uv_stride) {
+    int width, height, subsamp, colorspace;
+    
+    if (!dec || !data || !y || !uv) {
+        return -EINVAL;
+    }
+    if (tjDecompressHeader3(dec->handle, data, size, &width, &height, &subsamp, &colorspace) < 0) {
+        fprintf(stderr, "Invalid JPEG header: %s\n", tjGetErrorStr2(dec->handle));
+        return -EINVAL;
+    }
+    if (width <= 0 || height <= 0) {
+        // Tables-only streams read successfully but hold no picture
+        fprintf(stderr, "JPEG data contains no image\n");
+        return -EINVAL;
+    }
+    if (colorspace == TJCS_CMYK || colorspace == TJCS_YCCK || subsamp < 0 || subsamp >= TJ_NUMSAMP) {
+        fprintf(stderr, "JPEG color space/subsampling cannot be decoded to NV12\n");
+        return -ENOTSUP;
+    }
+    
+    // The library writes Y padded to whole chroma samples: odd sizes decode it aside
+    int nv12_cw = (width + 1) / 2;
+    int nv12_ch = (height + 1) / 2;
+    int yw = tjPlaneWidth(0, width, subsamp);
+    int yh = tjPlaneHeight(0, height, subsamp);
+    int y_direct = yw == width && yh == height;
+    int cw = subsamp != TJSAMP_GRAY ? tjPlaneWidth(1, width, subsamp) : 0;
+    int ch = subsamp != TJSAMP_GRAY ? tjPlaneHeight(1, height, subsamp) : 0;
+    size_t y_size = y_direct ? 0 : (size_t)yw * yh;
+    size_t needed = y_size + (size_t)cw * ch * 2;
+    if (needed > dec->chroma_capacity) {
+        uint8_t* buf = (uint8_t*)realloc(dec->chroma, needed);
+        if (!buf) {
+            return -ENOMEM;
+        }
+        dec->chroma = buf;
+        dec->chroma_capacity = needed;
+    }
+    
+    uint8_t* u = dec->chroma + y_size;
+    uint8_t* v = u + (size_t)cw * ch;
+    unsigned char* planes[3] = { y_direct ? y : dec->chroma, u, v };
+    int strides[3] = { y_direct ? y_stride : yw, cw, cw };
+    if (tjDecompressToYUVPlanes(dec->handle, data, size, planes, 0, strides, 0, 0) < 0 &&
+        tjGetErrorCode(dec->handle) != TJERR_WARNING) {
+        // Warnings (e.g. truncated data) still produce a picture, as with the mjpeg decoder
+        fprintf(stderr, "TurboJPEG decode failed: %s\n", tjGetErrorStr2(dec->handle));
+        return -EINVAL;
+    }
+    
+    if (!y_direct) {
+        for (int row = 0; row < height; row++) {
+            memcpy(y + (size_t)row * y_stride, dec->chroma + (size_t)row * yw, width);
+        }
+    }
+    if (subsamp == TJSAMP_GRAY) {
+        for (int row = 0; row < nv12_ch; row++) {
+            memset(uv + (size_t)row * uv_stride, 128, (size_t)nv12_cw * 2);
+        }
+    } else if (subsamp == TJSAMP_420) {
+        #pragma omp parallel for if(ch > 240)
+        for (int row = 0; row < ch; row++) {
+            merge_uv_row(u + (size_t)row * cw, v + (size_t)row * cw, uv + (size_t)row * uv_stride, cw);
+        }
+    } else {
+        resample_chroma(u, v, cw, ch, tjMCUWidth[subsamp] / 8, tjMCUHeight[subsamp] / 8,
+                        uv, uv_stride, nv12_cw, nv12_ch);
+    }
+    return 0;
+}
+
+void turbo_jpeg_decoder_destroy(TurboJpegDecoder* dec) {
+    if (!dec) {
+        return;
+    }
+    if (dec->handle) {
+        tjDestroy(dec->handle);
+    }
+    free(dec->chroma);
+    free(dec);
+}
+
+#else // !NV12_MJPEG_HAVE_TURBOJPEG
+
+TurboJpegEncoder* turbo_jpeg_encoder_create(int width, int height, int quality) {
+    (void)width;
+    (void)height;
+    (void)quality;
+    fprintf(stderr, "TurboJPEG backend not available (build with make TURBOJPEG=1)\n");
+    return NULL;
+}
+
+int turbo_jpeg_encode(TurboJpegEncoder* enc, const uint8_t* y, int y_stride,
+                      const uint8_t* uv, int uv_stride,
+                      uint8_t* out, size_t out_capacity, size_t* out_size) {
+    (void)enc; (void)y; (void)y_stride; (void)uv; (void)uv_stride;
+    (void)out; (void)out_capacity; (void)out_size;
+    return -ENOTSUP;
+}
+
+int turbo_jpeg_set_quality(TurboJpegEncoder* enc, int quality) {
+    (void)enc;
+    (void)quality;
+    return -ENOTSUP;
+}
+
+size_t turbo_jpeg_max_output_size(const TurboJpegEncoder* enc) {
+    (void)enc;
+    return 0;
+}
+
+void turbo_jpeg_encoder_destroy(TurboJpegEncoder* enc) {
+    (void)enc;
+}
+
+TurboJpegDecoder* turbo_jpeg_decoder_create(void) {
+    fprintf(stderr, "TurboJPEG backend not available (build with make TURBOJPEG=1)\n");
+    return NULL;
+}
+
+int turbo_jpeg_load_tables(TurboJpegDecoder* dec, const uint8_t* tables, size_t tables_size) {
+    (void)dec;
+    (void)tables;
+    (void)tables_size;
+    return -ENOTSUP;
+}
+
+int turbo_jpeg_read_header(TurboJpegDecoder* dec, const uint8_t* data, size_t size, int* width, int* height) {
+    (void)dec; (void)data; (void)size; (void)width; (void)height;
+    return -ENOTSUP;
+}
+
+int turbo_jpeg_decode(TurboJpegDecoder* dec, const uint8_t* data, size_t size,
+                      uint8_t* y, int y_stride, uint8_t* uv, int uv_stride) {
+    (void)dec; (void)data; (void)size; (void)y; (void)y_stride; (void)uv; (void)uv_stride;
+    return -ENOTSUP;
+}
+
+void turbo_jpeg_decoder_destroy(TurboJpegDecoder* dec) {
+    (void)dec;
+}
+
+#endif // NV12_MJPEG_HAVE_TURBOJPEG
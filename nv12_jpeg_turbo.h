@@ -0,0 +1,137 @@
+/*
+ * TurboJPEG Encoder/Decoder for NV12 (internal)
+ *
+ * NV12 front end for libjpeg-turbo used by NV12_MJPEG_BACKEND_TURBOJPEG and
+ * NV12_MJPEG_DECODER_TURBOJPEG. Goes through TurboJPEG's planar YUV entry
+ * points, so no RGB conversion happens. Not part of the public API.
+ *
+ * Compiled in with NV12_MJPEG_HAVE_TURBOJPEG (make TURBOJPEG=1); without it
+ * the create functions fail and the backend is unavailable.
+ */
+
+#ifndef NV12_JPEG_TURBO_H
+#define NV12_JPEG_TURBO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TurboJpegEncoder TurboJpegEncoder;
+typedef struct TurboJpegDecoder TurboJpegDecoder;
+
+/**
+ * Create TurboJPEG encoder (4:2:0 baseline output)
+ *
+ * @param width Frame width in pixels (even)
+ * @param height Frame height in pixels (even)
+ * @param quality JPEG quality factor (1-100, libjpeg scaling)
+ * @return Encoder, or NULL on failure or when built without TurboJPEG
+ */
+TurboJpegEncoder* turbo_jpeg_encoder_create(int width, int height, int quality);
+
+/**
+ * Encode one NV12 frame to a complete baseline JPEG. The Y plane is read in
+ * place; the UV plane is deinterleaved into internal U and V planes.
+ *
+ * @param enc TurboJPEG encoder
+ * @param y Y plane
+ * @param y_stride Y plane stride in bytes
+ * @param uv Interleaved UV plane
+ * @param uv_stride UV plane stride in bytes
+ * @param out Output buffer (written directly if at least turbo_jpeg_max_output_size() bytes)
+ * @param out_capacity Size of output buffer in bytes
+ * @param out_size Pointer to store encoded size (required size on -ENOMEM)
+ * @return 0 on success, -ENOMEM if the output buffer is too small, -EIO on library errors
+ */
+int turbo_jpeg_encode(TurboJpegEncoder* enc, const uint8_t* y, int y_stride,
+                      const uint8_t* uv, int uv_stride,
+                      uint8_t* out, size_t out_capacity, size_t* out_size);
+
+/**
+ * Change quality for the following frames
+ *
+ * @param enc TurboJPEG encoder
+ * @param quality JPEG quality factor (1-100)
+ * @return 0 on success, -EINVAL on invalid quality
+ */
+int turbo_jpeg_set_quality(TurboJpegEncoder* enc, int quality);
+
+/**
+ * Get worst-case encoded size (tjBufSize(); buffers of this size are encoded into without a copy)
+ */
+size_t turbo_jpeg_max_output_size(const TurboJpegEncoder* enc);
+
+/**
+ * Destroy TurboJPEG encoder
+ *
+ * @param enc TurboJPEG encoder (can be NULL)
+ */
+void turbo_jpeg_encoder_destroy(TurboJpegEncoder* enc);
+
+/**
+ * Create TurboJPEG decoder
+ *
+ * @return Decoder, or NULL on failure or when built without TurboJPEG
+ */
+TurboJpegDecoder* turbo_jpeg_decoder_create(void);
+
+/**
+ * Load the tables of a tables-only stream (SOI, DQT, DHT, EOI) for decoding
+ * abbreviated frames (libjpeg-turbo 2.1 or later)
+ *
+ * @param dec TurboJPEG decoder
+ * @param tables Tables-only JPEG stream
+ * @param tables_size Size of the stream in bytes
+ * @return 0 on success, -EINVAL if the library cannot read the stream
+ */
+int turbo_jpeg_load_tables(TurboJpegDecoder* dec, const uint8_t* tables, size_t tables_size);
+
+/**
+ * Read the frame size from a JPEG header
+ *
+ * @param dec TurboJPEG decoder
+ * @param data JPEG data
+ * @param size Size of JPEG data in bytes
+ * @param width Pointer to store frame width
+ * @param height Pointer to store frame height
+ * @return 0 on success, -EINVAL on invalid data
+ */
+int turbo_jpeg_read_header(TurboJpegDecoder* dec, const uint8_t* data, size_t size, int* width, int* height);
+
+/**
+ * Decode a JPEG into NV12 planes of its size (turbo_jpeg_read_header()).
+ * Y is decoded in place; 4:2:0 chroma is interleaved into the UV plane, other
+ * subsamplings are averaged to 4:2:0 and grayscale gets neutral chroma.
+ *
+ * @param dec TurboJPEG decoder
+ * @param data JPEG data
+ * @param size Size of JPEG data in bytes
+ * @param y Y plane
+ * @param y_stride Y plane stride in bytes
+ * @param uv Interleaved UV plane
+ * @param uv_stride UV plane stride in bytes
+ * @return 0 on success, -EINVAL on invalid data, -ENOTSUP for CMYK/YCCK or unknown subsampling, -ENOMEM
+ */
+int turbo_jpeg_decode(TurboJpegDecoder* dec, const uint8_t* data, size_t size,
+                      uint8_t* y, int y_stride, uint8_t* uv, int uv_stride);
+
+/**
+ * Destroy TurboJPEG decoder
+ *
+ * @param dec TurboJPEG decoder (can be NULL)
+ */
+void turbo_jpeg_decoder_destroy(TurboJpegDecoder* dec);
+
+/**
+ * Get name of the chroma split/interleave code path ("sse2", "neon", "c")
+ */
+const char* turbo_jpeg_simd_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NV12_JPEG_TURBO_H
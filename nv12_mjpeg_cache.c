@@ -0,0 +1,239 @@
+/*
+ * NV12 → MJPEG Multi-Resolution Encoder Cache
+ *
+ * Keeps opened encoder instances keyed by (width, height, quality) so that a
+ * service encoding at a handful of resolutions pays avcodec_open2() and the
+ * frame allocations once per configuration instead of once per request.
+ * Idle instances are evicted least recently used first under a memory cap.
+ */
+
+#include "nv12_mjpeg_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Default memory cap when encoder_cache_create() gets 0
+#define CACHE_DEFAULT_MEMORY_CAP (64u * 1024 * 1024)
+
+// ============================================================================
+// Cache Data Structures
+// ============================================================================
+
+typedef struct {
+    NV12MJPEGEncoder* encoder;    // Opened instance
+    int width;                    // Key
+    int height;
+    int quality;
+    size_t memory;                // Estimated footprint of the instance
+    int in_use;                   // Acquired by a caller (never evicted)
+    uint64_t last_used;           // LRU clock value
+} CacheEntry;
+
+struct NV12MJPEGEncoderCache {
+    NV12MJPEGEncoderOptions opts; // Template for new instances (size/quality replaced)
+    size_t memory_cap;            // Evict idle instances above this footprint
+    
+    CacheEntry* entries;
+    int num_entries;
+    int capacity;                 // Allocated entries
+    size_t memory;                // Sum of entry footprints
+    uint64_t clock;               // LRU clock
+    
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    
+    pthread_mutex_t lock;
+};
+
+// ============================================================================
+// Cache Internals
+// ============================================================================
+
+// Frame buffers plus the worst-case output packet dominate an instance's memory
+static size_t cache_entry_memory(NV12MJPEGEncoder* encoder, int width, int height) {
+    return nv12_frame_size(width, height) + encoder_max_output_size(encoder);
+}
+
+// Remove the least recently used idle entry (lock held). Returns its encoder, or NULL if none is idle.
+static NV12MJPEGEncoder* cache_evict_one(NV12MJPEGEncoderCache* cache) {
+    int victim = -1;
+    
+    for (int i = 0; i < cache->num_entries; i++) {
+        if (!cache->entries[i].in_use &&
+            (victim < 0 || cache->entries[i].last_used < cache->entries[victim].last_used)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return NULL;
+    }
+    
+    NV12MJPEGEncoder* encoder = cache->entries[victim].encoder;
+    cache->memory -= cache->entries[victim].memory;
+    cache->entries[victim] = cache->entries[--cache->num_entries];
+    cache->evictions++;
+    return encoder;
+}
+
+// Evict idle entries until the cache fits its cap (lock held on entry and return).
+// Instances are destroyed outside the lock.
+static void cache_trim(NV12MJPEGEncoderCache* cache) {
+    while (cache->memory > cache->memory_cap) {
+        NV12MJPEGEncoder* victim = cache_evict_one(cache);
+        if (!victim) {
+            break;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        encoder_destroy(victim);
+        pthread_mutex_lock(&cache->lock);
+    }
+}
+
+// ============================================================================
+// Cache API
+// ============================================================================
+
+NV12MJPEGEncoderCache* encoder_cache_create(const NV12MJPEGEncoderOptions* opts, size_t memory_cap) {
+    if (!opts) {
+        return NULL;
+    }
+    
+    NV12MJPEGEncoderCache* cache = (NV12MJPEGEncoderCache*)calloc(1, sizeof(NV12MJPEGEncoderCache));
+    if (!cache) {
+        fprintf(stderr, "Failed to allocate encoder cache\n");
+        return NULL;
+    }
+    
+    cache->opts = *opts;
+    cache->memory_cap = memory_cap ? memory_cap : CACHE_DEFAULT_MEMORY_CAP;
+    pthread_mutex_init(&cache->lock, NULL);
+    
+    return cache;
+}
+
+NV12MJPEGEncoder* encoder_cache_acquire(NV12MJPEGEncoderCache* cache, int width, int height, int quality) {
+    if (!cache || width <= 0 || height <= 0) {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->num_entries; i++) {
+        CacheEntry* entry = &cache->entries[i];
+        if (!entry->in_use && entry->width == width && entry->height == height && entry->quality == quality) {
+            entry->in_use = 1;
+            entry->last_used = ++cache->clock;
+            cache->hits++;
+            pthread_mutex_unlock(&cache->lock);
+            return entry->encoder;
+        }
+    }
+    cache->misses++;
+    NV12MJPEGEncoderOptions opts = cache->opts;
+    pthread_mutex_unlock(&cache->lock);
+    
+    // Open outside the lock: other configurations stay available meanwhile
+    opts.width = width;
+    opts.height = height;
+    opts.quality = quality;
+    NV12MJPEGEncoder* encoder = encoder_create_with_options(&opts);
+    if (!encoder) {
+        return NULL;
+    }
+    size_t memory = cache_entry_memory(encoder, width, height);
+    
+    pthread_mutex_lock(&cache->lock);
+    if (cache->num_entries == cache->capacity) {
+        int capacity = cache->capacity ? cache->capacity * 2 : 8;
+        CacheEntry* entries = (CacheEntry*)realloc(cache->entries, capacity * sizeof(CacheEntry));
+        if (!entries) {
+            pthread_mutex_unlock(&cache->lock);
+            fprintf(stderr, "Failed to grow encoder cache\n");
+            encoder_destroy(encoder);
+            return NULL;
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+    
+    CacheEntry* entry = &cache->entries[cache->num_entries++];
+    entry->encoder = encoder;
+    entry->width = width;
+    entry->height = height;
+    entry->quality = quality;
+    entry->memory = memory;
+    entry->in_use = 1;
+    entry->last_used = ++cache->clock;
+    cache->memory += memory;
+    cache_trim(cache);
+    pthread_mutex_unlock(&cache->lock);
+    
+    return encoder;
+}
+
+void encoder_cache_release(NV12MJPEGEncoderCache* cache, NV12MJPEGEncoder* encoder) {
+    if (!cache || !encoder) {
+        return;
+    }
+    
+    pthread_mutex_lock(&cache->lock);
+    for (int i = 0; i < cache->num_entries; i++) {
+        if (cache->entries[i].encoder == encoder) {
+            cache->entries[i].in_use = 0;
+            cache->entries[i].last_used = ++cache->clock;
+            break;
+        }
+    }
+    // The cap may have been exceeded while every instance was in use
+    cache_trim(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+int encoder_cache_encode(NV12MJPEGEncoderCache* cache, const uint8_t* nv12_data, int width, int height,
+                         int quality, uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    if (!cache || !nv12_data || !out_buffer || !out_size) {
+        return -EINVAL;
+    }
+    
+    NV12MJPEGEncoder* encoder = encoder_cache_acquire(cache, width, height, quality);
+    if (!encoder) {
+        return -ENOMEM;
+    }
+    int ret = encoder_encode_to_buffer(encoder, nv12_data, out_buffer, buffer_size, out_size);
+    encoder_cache_release(cache, encoder);
+    
+    return ret;
+}
+
+int encoder_cache_get_stats(NV12MJPEGEncoderCache* cache, NV12MJPEGEncoderCacheStats* stats) {
+    if (!cache || !stats) {
+        return -EINVAL;
+    }
+    
+    pthread_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->entries = cache->num_entries;
+    stats->memory_bytes = cache->memory;
+    pthread_mutex_unlock(&cache->lock);
+    
+    return 0;
+}
+
+void encoder_cache_destroy(NV12MJPEGEncoderCache* cache) {
+    if (!cache) {
+        return;
+    }
+    
+    for (int i = 0; i < cache->num_entries; i++) {
+        encoder_destroy(cache->entries[i].encoder);
+    }
+    free(cache->entries);
+    
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
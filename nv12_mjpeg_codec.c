@@ -6,12 +6,23 @@
  */
 
 #include "nv12_mjpeg_codec.h"
+#include "nv12_jpeg_native.h"
+#include "nv12_jpeg_turbo.h"
+#include "nv12_mjpeg_sim.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <linux/dma-buf.h>
+#endif
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -26,59 +37,664 @@
 #include <omp.h>
 #endif
 
+#if defined(__SSE2__)
+#define NV12_MJPEG_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define NV12_MJPEG_NEON 1
+#include <arm_neon.h>
+#endif
+
 // ============================================================================
 // Helper Functions
 // ============================================================================
 
-static void copy_frame_to_nv12_buffer(const AVFrame* frame, uint8_t* out_nv12_buffer, int width, int height) {
-    // Copy NV12 data from frame to output buffer
+static void copy_frame_to_nv12_desc(const AVFrame* frame, const NV12FrameDesc* dst, int width, int height) {
+    // Copy NV12 data from frame to the destination planes
     // Y plane - use bulk copy if possible, otherwise per-row copy
-    uint8_t* dst_y = out_nv12_buffer;
+    uint8_t* dst_y = dst->y;
     const uint8_t* src_y = frame->data[0];
-    if (frame->linesize[0] == width) {
+    if (frame->linesize[0] == width && dst->y_stride == width) {
         // Bulk copy - no padding
-        memcpy(dst_y, src_y, width * height);
+        memcpy(dst_y, src_y, (size_t)width * height);
     } else {
         // Per-row copy with OpenMP parallelization
         #pragma omp parallel for if(height > 480)
         for (int y = 0; y < height; y++) {
-            memcpy(dst_y + y * width, src_y + y * frame->linesize[0], width);
+            memcpy(dst_y + (size_t)y * dst->y_stride, src_y + (size_t)y * frame->linesize[0], width);
         }
     }
     
     // UV plane - use bulk copy if possible, otherwise per-row copy
-    uint8_t* dst_uv = out_nv12_buffer + width * height;
+    uint8_t* dst_uv = dst->uv;
     const uint8_t* src_uv = frame->data[1];
-    if (frame->linesize[1] == width) {
+    if (frame->linesize[1] == width && dst->uv_stride == width) {
         // Bulk copy - no padding
-        memcpy(dst_uv, src_uv, width * height / 2);
+        memcpy(dst_uv, src_uv, (size_t)width * height / 2);
     } else {
         // Per-row copy with OpenMP parallelization
         #pragma omp parallel for if(height > 480)
         for (int y = 0; y < height / 2; y++) {
-            memcpy(dst_uv + y * width, src_uv + y * frame->linesize[1], width);
+            memcpy(dst_uv + (size_t)y * dst->uv_stride, src_uv + (size_t)y * frame->linesize[1], width);
         }
     }
 }
 
+// Planes of a frame descriptor are inside the caller's allocation as far as we can check
+static int nv12_frame_desc_valid(const NV12FrameDesc* desc) {
+    return desc && desc->y && desc->uv && desc->width > 0 && desc->height > 0 &&
+           desc->y_stride >= desc->width && desc->uv_stride >= desc->width;
+}
+
 // ============================================================================
 // Persistent Encoder Context Implementation
 // ============================================================================
 
+// Per-frame and configuration diagnostics, suppressed when verbose == 0
+#define ENCODER_LOG(encoder, ...) \
+    do { if ((encoder)->verbose) fprintf(stderr, __VA_ARGS__); } while (0)
+
+// Size-targeted rate control
+#define RC_DEFAULT_ALPHA 0.8      // Initial size ~ step^-alpha exponent
+#define RC_AIM 0.95               // Predict for this fraction of the target (headroom)
+#define RC_RETRY_AIM 0.85         // More headroom when re-encoding an oversized frame
+
+// Region-of-interest encoders kept per encoder (one per crop size)
+#define ROI_CACHE_SIZE 4
+
+// A codec that returns no packet for this long after the last frame was sent
+// (synchronous encode, batch tail) is holding it back and gets flushed
+#define BATCH_STALL_MS 100
+
+// fd mappings kept per encoder (camera/ISP buffer pools are typically 4-8 buffers)
+#define FD_CACHE_SIZE 8
+
+// Read-only mapping of one frame buffer fd
+typedef struct EncoderFdMapping {
+    uint8_t* addr;                // Mapped address (NULL = free slot)
+    size_t length;                // Mapped length
+    int fd;                       // Caller's fd (not owned)
+    dev_t dev;                    // Identity of the buffer behind fd, so a reused
+    ino_t ino;                    // fd number never hits a stale mapping
+    off_t size;                   // st_size when mapped; a resized buffer is mapped again
+    uint64_t last_used;           // LRU clock value
+} EncoderFdMapping;
+
+// Simulated backend: frames the codec can hold (async queue plus one synchronous frame)
+#define SIM_FIFO_SIZE (NV12_MJPEG_MAX_QUEUE_DEPTH + 1)
+
 struct NV12MJPEGEncoder {
     const AVCodec* codec;         // Cached codec pointer
     AVCodecContext* codec_ctx;    // Hardware encoder context (persistent)
     AVFrame* frame;               // Pre-allocated frame with buffers
+    AVFrame* wrap_frame;          // Frame shell for zero-copy input (no own buffers)
+    AVBufferPool* chroma_pool;    // U/V planes for zero-copy input on planar backends
     AVPacket* pkt;                // Pre-allocated packet
+    NativeJpegEncoder* native;    // Built-in encoder (NV12_MJPEG_BACKEND_NATIVE, no codec)
+    TurboJpegEncoder* turbo;      // libjpeg-turbo encoder (NV12_MJPEG_BACKEND_TURBOJPEG, no codec)
+    AVBufferPool* native_out_pool;  // Output packets for asynchronous native encodes
+    NV12MJPEGBackend backend;     // Selected encoder backend
+    enum AVPixelFormat pix_fmt;   // Input pixel format of the codec
     int width;                    // Configured width
     int height;                   // Configured height
     int quality;                  // Configured quality
+    int next_quality;             // One-shot quality override for the next frame (0 = none)
+    
+    // Size-targeted rate control: size = rc_coef * activity * step^-rc_alpha
+    size_t rc_target_size;        // Max encoded bytes per frame (0 = fixed quality)
+    double rc_coef;               // Fitted on the last frame (0 = no frame seen yet)
+    double rc_alpha;              // Size sensitivity to quantizer step, refined on re-encodes
+    double rc_activity;           // Content activity of the frame being encoded
+    size_t rc_first_size;         // First-pass size of the frame being encoded
+    int rc_first_quality;         // First-pass quality of the frame being encoded
+    size_t slot_size;             // Fixed output size, padded (0 = off; rc_target_size follows it)
+    
+    // Static-scene deduplication: the last encoded frame's signature and output
+    NV12MJPEGDedup dedup;         // Comparison mode (encoder_set_dedup())
+    int dedup_threshold;          // NV12_MJPEG_DEDUP_THRESHOLD: max mean level change per block
+    int dedup_valid;              // Signature and output below belong to the last frame
+    uint64_t dedup_hash;          // Hash of the last encoded frame (EXACT, SAMPLED)
+    uint64_t dedup_hash_next;     // Hash of the incoming frame
+    uint16_t* dedup_sums;         // Block sums of the last encoded frame (THRESHOLD, 3 per macroblock)
+    uint16_t* dedup_sums_next;    // Block sums of the incoming frame
+    uint8_t* dedup_output;        // Last encoded output
+    size_t dedup_output_size;
+    size_t dedup_output_capacity;
+    
+    // Motion gating: luma of the last encoded frame and of the incoming one
+    int motion_enabled;           // encoder_set_motion_gate() called with a gate
+    NV12MJPEGMotionGate motion;   // Gate parameters
+    uint8_t* motion_ref;          // Luma reference (stride = width), valid when motion_ref_valid
+    uint8_t* motion_next;         // Luma of the frame being encoded, becomes the reference
+    uint32_t* motion_sads;        // Per-macroblock SAD of the incoming frame
+    int motion_ref_valid;
+    int motion_luma_copied;       // The motion check already copied the luma into encoder->frame
+    
+    // Abbreviated output: frames omit the tables of the session
+    int abbreviated;              // Abbreviated mode enabled (opts->abbreviated)
+    NV12MJPEGHuffman huffman;     // Huffman table selection (opts->huffman)
+    int huffman_window;           // Statistics window of NV12_MJPEG_HUFFMAN_STREAM
+    uint8_t tables[NV12_MJPEG_MAX_TABLES_SIZE];  // Tables-only stream: SOI, DQT, DHT, EOI
+    size_t tables_size;           // 0 until the first frame is encoded
+    int tables_quality;           // Native backend: quality the tables were built for
+    
+    // Custom quantization tables (natural order), scaled by quality like the standard ones
+    int custom_quant;             // Set by encoder_set_quant_tables()
+    uint8_t quant_tables[2][64];  // Luma, chroma
+    
+    // Hot spare: standby codec context swapped in when the codec fails
+    int hot_spare;                // opts->hot_spare (codec backends)
+    AVCodecContext* spare_ctx;    // Opened standby context (NULL while being built)
+    struct EncoderSpareJob* spare_job;  // Background build in progress (NULL if none)
+    int fault_pending;            // Injected codec failures still to come (encoder_inject_fault())
+    
+    // Simulated backend: device session, and the frames sent but not yet
+    // returned, oldest first: modeled completion time, and the packet once the
+    // codec has produced it (taken out at once so the codec accepts the next frame)
+    NV12MJPEGSimulation sim_config;
+    SimSession* sim;
+    uint64_t sim_done[SIM_FIFO_SIZE];
+    AVPacket* sim_pkts[SIM_FIFO_SIZE];
+    int sim_head;
+    int sim_count;                // Frames in the FIFO
+    int sim_pkt_count;            // Of which packets received (the oldest ones)
+    
+    // Region-of-interest encoders, created per crop size and reused (LRU)
+    NV12MJPEGEncoder* roi_cache[ROI_CACHE_SIZE];
+    uint64_t roi_last_used[ROI_CACHE_SIZE];
+    uint64_t roi_clock;
+    
+    // Thumbnail planes produced alongside the current frame (multi-output encode)
+    int thumb_shift;              // Downscale factor log2 while encoding (0 = no thumbnail)
+    int thumb_width;              // Thumbnail size (even)
+    int thumb_height;
+    uint8_t* thumb_nv12;          // Thumbnail NV12 planes (grown on demand)
+    size_t thumb_capacity;
+    
+    // fd input: buffers mapped once and reused while the fd stays open (LRU)
+    EncoderFdMapping fd_cache[FD_CACHE_SIZE];
+    uint64_t fd_clock;
+    
+    int verbose;                  // Print configuration and per-frame [Perf] logs
+    int strips;                   // Restart-interval strips / slice threads per frame
     int64_t frame_counter;        // Frame counter for PTS
+    NV12MJPEGEncoderStats stats;  // Counters and timings for encoder_get_stats()
+    
+    // Asynchronous submit/poll state (allocated on first encoder_submit())
+    int queue_depth;              // Max frames in flight
+    AVFrame** async_frames;       // Input slots, used round-robin
+    AVPacket** async_ready;       // Received packets waiting for encoder_poll() (FIFO)
+    void** async_user_data;       // User pointers of frames in flight (FIFO)
+    int async_next_slot;          // Next input slot to fill
+    int async_in_flight;          // Submitted but not yet handed back to the caller
+    int async_ready_head;         // Oldest received packet
+    int async_ready_count;        // Number of received packets
+    int async_user_head;          // Oldest frame in flight
+    nv12_mjpeg_completion_fn completion_cb;  // Optional completion callback
+    void* completion_opaque;      // User pointer for completion_cb
 };
 
+// Background build of a standby codec context
+typedef struct EncoderSpareJob {
+    NV12MJPEGEncoder config;      // Snapshot of the encoder's settings, only read by encoder_open_codec()
+    AVCodecContext* retired;      // Failed context, freed off the encode path (can be NULL)
+    AVCodecContext* ctx;          // Built context (NULL on failure)
+    double build_ms;              // Time to free the retired context and open the new one
+    int done;
+    pthread_mutex_t lock;
+    pthread_t thread;
+} EncoderSpareJob;
+
+void encoder_options_init(NV12MJPEGEncoderOptions* opts, int width, int height, int quality) {
+    if (!opts) {
+        return;
+    }
+    memset(opts, 0, sizeof(*opts));
+    opts->width = width;
+    opts->height = height;
+    opts->quality = quality;
+    opts->backend = NV12_MJPEG_BACKEND_RKMPP;
+    opts->queue_depth = 4;
+    opts->verbose = 1;
+    opts->strips = 1;
+    opts->huffman = NV12_MJPEG_HUFFMAN_STANDARD;
+    opts->huffman_window = 8;
+    opts->simulation.latency_ms = 4.0;
+    opts->simulation.jitter_ms = 0.3;
+    opts->simulation.tail_probability = 0.01;
+    opts->simulation.tail_ms = 10.0;
+    opts->simulation.cores = 1;
+    opts->simulation.max_sessions = 8;
+    opts->simulation.seed = 1;
+}
+
+// Free the submit/poll queue; frames still in flight are dropped
+static void encoder_async_free(NV12MJPEGEncoder* encoder) {
+    if (encoder->async_frames) {
+        for (int i = 0; i < encoder->queue_depth; i++) {
+            av_frame_free(&encoder->async_frames[i]);
+        }
+        free(encoder->async_frames);
+        encoder->async_frames = NULL;
+    }
+    if (encoder->async_ready) {
+        for (int i = 0; i < encoder->queue_depth; i++) {
+            av_packet_free(&encoder->async_ready[i]);
+        }
+        free(encoder->async_ready);
+        encoder->async_ready = NULL;
+    }
+    free(encoder->async_user_data);
+    encoder->async_user_data = NULL;
+}
+
+static void encoder_free_resources(NV12MJPEGEncoder* encoder) {
+    encoder_async_free(encoder);
+    if (encoder->pkt) {
+        av_packet_free(&encoder->pkt);
+    }
+    if (encoder->wrap_frame) {
+        av_frame_free(&encoder->wrap_frame);
+    }
+    if (encoder->frame) {
+        av_frame_free(&encoder->frame);
+    }
+    if (encoder->chroma_pool) {
+        av_buffer_pool_uninit(&encoder->chroma_pool);
+    }
+    if (encoder->codec_ctx) {
+        avcodec_free_context(&encoder->codec_ctx);
+    }
+    if (encoder->native_out_pool) {
+        av_buffer_pool_uninit(&encoder->native_out_pool);
+    }
+    native_jpeg_destroy(encoder->native);
+    encoder->native = NULL;
+    turbo_jpeg_encoder_destroy(encoder->turbo);
+    encoder->turbo = NULL;
+    for (int i = 0; i < ROI_CACHE_SIZE; i++) {
+        encoder_destroy(encoder->roi_cache[i]);
+        encoder->roi_cache[i] = NULL;
+    }
+    free(encoder->thumb_nv12);
+    encoder->thumb_nv12 = NULL;
+    free(encoder->dedup_sums);
+    free(encoder->dedup_sums_next);
+    free(encoder->dedup_output);
+    encoder->dedup_sums = NULL;
+    encoder->dedup_sums_next = NULL;
+    encoder->dedup_output = NULL;
+    free(encoder->motion_ref);
+    free(encoder->motion_next);
+    free(encoder->motion_sads);
+    encoder->motion_ref = NULL;
+    encoder->motion_next = NULL;
+    encoder->motion_sads = NULL;
+    for (int i = 0; i < SIM_FIFO_SIZE; i++) {
+        av_packet_free(&encoder->sim_pkts[i]);
+    }
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        if (encoder->fd_cache[i].addr) {
+            munmap(encoder->fd_cache[i].addr, encoder->fd_cache[i].length);
+            encoder->fd_cache[i].addr = NULL;
+        }
+    }
+}
+
+// Configure mjpeg_rkmpp: NV12 input, fixed QP via the MPP private options
+static void encoder_configure_rkmpp(NV12MJPEGEncoder* encoder, AVCodecContext* codec_ctx) {
+    int quality = encoder->quality;
+    
+    codec_ctx->pix_fmt = AV_PIX_FMT_NV12;
+    
+    // Set quality control parameters - use fixed QP mode
+    // 1. Set flag to tell encoder to use fixed quantization parameters
+    codec_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    
+    // 2. Set global_quality (critical for quality control)
+    // In FFmpeg, global_quality uses lambda units
+    codec_ctx->global_quality = quality * FF_QP2LAMBDA;
+    
+    // Print quality parameters for debugging
+    ENCODER_LOG(encoder, "[Encoder Config] FF_QP2LAMBDA constant: %d\n", FF_QP2LAMBDA);
+    ENCODER_LOG(encoder, "[Encoder Config] Quality (QP): %d\n", quality);
+    ENCODER_LOG(encoder, "[Encoder Config] global_quality: %d (QP * FF_QP2LAMBDA = %d * %d)\n", 
+            codec_ctx->global_quality, quality, FF_QP2LAMBDA);
+    
+    // 3. Set high bitrate for quality encoding
+    // For 1600x1200 @ 30fps with extremely high quality, instantaneous bitrate may exceed 100 Mbps
+    int64_t high_bitrate = 100 * 1000 * 1000; // 100 Mbps
+    
+    codec_ctx->bit_rate = high_bitrate;
+    codec_ctx->rc_max_rate = high_bitrate;
+    codec_ctx->rc_buffer_size = high_bitrate; // Allow buffer to hold one second of data
+    
+    ENCODER_LOG(encoder, "[Encoder Config] Rate control: bit_rate=%ld bps (%.2f Mbps), rc_max_rate=%ld, rc_buffer_size=%ld\n",
+            codec_ctx->bit_rate, codec_ctx->bit_rate / 1000000.0,
+            codec_ctx->rc_max_rate, codec_ctx->rc_buffer_size);
+    
+    // Set quality bounds to match the fixed QP
+    codec_ctx->qmin = quality;
+    codec_ctx->qmax = quality;
+    
+    ENCODER_LOG(encoder, "[Encoder Config] Quality bounds: qmin=%d, qmax=%d\n", 
+            codec_ctx->qmin, codec_ctx->qmax);
+    
+    // Set hardware encoder options for Rockchip MPP
+    av_opt_set_int(codec_ctx->priv_data, "qp_init", quality, 0);
+    av_opt_set_int(codec_ctx->priv_data, "qp_min", quality, 0);
+    av_opt_set_int(codec_ctx->priv_data, "qp_max", quality, 0);
+    
+    ENCODER_LOG(encoder, "[Encoder Config] Hardware encoder options: qp_init=%d, qp_min=%d, qp_max=%d\n",
+            quality, quality, quality);
+}
+
+// mjpeg_rkmpp (and its simulation) applies the quality when opened: no per-frame QP
+static int encoder_quality_fixed(const NV12MJPEGEncoder* encoder) {
+    return encoder->backend == NV12_MJPEG_BACKEND_RKMPP || encoder->backend == NV12_MJPEG_BACKEND_SIMULATED;
+}
+
+// Native and TurboJPEG encode the caller's NV12 themselves: no codec, frames or packets
+static int encoder_codecless(const NV12MJPEGEncoder* encoder) {
+    return encoder->native || encoder->turbo;
+}
+
+// libjpeg q_factor scaling: percent of the Annex K tables used at a quality (1-99)
+static double quality_scale_percent(int quality) {
+    return quality < 50 ? 5000.0 / quality : 200.0 - quality * 2;
+}
+
+// Map a quality value (1-99 q_factor) to the backend's codec QP
+static int encoder_quality_to_qscale(const NV12MJPEGEncoder* encoder, int quality) {
+    // The simulated backend's matrices carry the q_factor; mjpeg uses them as given at qscale 8
+    if (encoder->backend == NV12_MJPEG_BACKEND_SIMULATED) {
+        return 8;
+    }
+    // mjpeg scales its tables by qscale/8, so qscale 8 is quality 50; mpegvideo
+    // encoders only support qscale 1-31
+    if (encoder->backend == NV12_MJPEG_BACKEND_SOFTWARE) {
+        int qscale = (int)lround(quality_scale_percent(quality) * 8.0 / 100.0);
+        return qscale < 1 ? 1 : (qscale > 31 ? 31 : qscale);
+    }
+    return quality;
+}
+
+// Configure the libavcodec mjpeg encoder: planar full-range 4:2:0 input, fixed qscale
+static void encoder_configure_software(NV12MJPEGEncoder* encoder, AVCodecContext* codec_ctx) {
+    int qscale = encoder_quality_to_qscale(encoder, encoder->quality);
+    
+    codec_ctx->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    codec_ctx->color_range = AVCOL_RANGE_JPEG;
+    codec_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+    codec_ctx->global_quality = qscale * FF_QP2LAMBDA;
+    codec_ctx->qmin = qscale;
+    codec_ctx->qmax = qscale;
+    
+    // Strips map to slice threads: each thread codes a band of MB rows
+    if (encoder->strips > 1) {
+        codec_ctx->thread_count = encoder->strips;
+        codec_ctx->thread_type = FF_THREAD_SLICE;
+    }
+    
+    // libavcodec only optimizes per frame, which is at least as small as the window tables
+    if (encoder->huffman != NV12_MJPEG_HUFFMAN_STANDARD) {
+        av_opt_set(codec_ctx->priv_data, "huffman", "optimal", 0);
+    }
+    
+    // Custom matrices replace the Annex K ones; mjpeg scales them by qscale/8
+    // per frame (the DC step stays fixed). Freed with the context.
+    // The simulated backend models MPP's q_factor with the libjpeg-scaled Annex K tables.
+    uint8_t sim_tables[2][64];
+    const uint8_t (*tables)[64] = encoder->custom_quant ? encoder->quant_tables : NULL;
+    if (encoder->backend == NV12_MJPEG_BACKEND_SIMULATED) {
+        native_jpeg_quality_tables(encoder->quality, sim_tables[0], sim_tables[1]);
+        tables = sim_tables;
+    }
+    if (tables) {
+        uint16_t* luma = (uint16_t*)av_malloc(64 * sizeof(uint16_t));
+        uint16_t* chroma = (uint16_t*)av_malloc(64 * sizeof(uint16_t));
+        if (luma && chroma) {
+            for (int n = 0; n < 64; n++) {
+                luma[n] = tables[0][n];
+                chroma[n] = tables[1][n];
+            }
+            codec_ctx->intra_matrix = luma;
+            codec_ctx->chroma_intra_matrix = chroma;
+        } else {
+            fprintf(stderr, "Failed to allocate quantization matrices, using the standard tables\n");
+            av_free(luma);
+            av_free(chroma);
+        }
+    }
+    
+    ENCODER_LOG(encoder, "[Encoder Config] Software mjpeg: pix_fmt=yuvj420p, qscale=%d, slice threads=%d, huffman=%s\n",
+            qscale, encoder->strips, encoder->huffman != NV12_MJPEG_HUFFMAN_STANDARD ? "optimal" : "default");
+}
+
+static const char* encoder_backend_codec_name(NV12MJPEGBackend backend) {
+    switch (backend) {
+    case NV12_MJPEG_BACKEND_RKMPP:
+        return "mjpeg_rkmpp";
+    case NV12_MJPEG_BACKEND_SOFTWARE:
+        return "mjpeg";
+    case NV12_MJPEG_BACKEND_NATIVE:
+        return "native";
+    case NV12_MJPEG_BACKEND_SIMULATED:
+        return "mjpeg";
+    case NV12_MJPEG_BACKEND_TURBOJPEG:
+        return "turbojpeg";
+    }
+    return NULL;
+}
+
+// Allocate, configure and open a codec context for the encoder's settings
+static AVCodecContext* encoder_open_codec(NV12MJPEGEncoder* encoder) {
+    int ret;
+    
+    // Allocate codec context
+    AVCodecContext* codec_ctx = avcodec_alloc_context3(encoder->codec);
+    if (!codec_ctx) {
+        fprintf(stderr, "Failed to allocate codec context\n");
+        return NULL;
+    }
+    
+    // Configure codec parameters
+    codec_ctx->width = encoder->width;
+    codec_ctx->height = encoder->height;
+    codec_ctx->time_base = (AVRational){1, 30};
+    codec_ctx->framerate = (AVRational){30, 1};
+    codec_ctx->gop_size = 1;  // Every frame is a keyframe (required for MJPEG)
+    codec_ctx->max_b_frames = 0;  // No B-frames for MJPEG
+    
+    if (encoder->backend == NV12_MJPEG_BACKEND_RKMPP) {
+        encoder_configure_rkmpp(encoder, codec_ctx);
+    } else {
+        encoder_configure_software(encoder, codec_ctx);
+    }
+    
+    // Open codec (expensive operation - done once)
+    ret = avcodec_open2(codec_ctx, encoder->codec, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to open codec: %s\n", av_err2str(ret));
+        avcodec_free_context(&codec_ctx);
+        return NULL;
+    }
+    
+    // Print actual effective settings after codec is opened
+    ENCODER_LOG(encoder, "[Encoder Config] === After avcodec_open2() ===\n");
+    ENCODER_LOG(encoder, "[Encoder Config] Actual effective bit_rate: %ld bps\n", codec_ctx->bit_rate);
+    ENCODER_LOG(encoder, "[Encoder Config] Actual effective global_quality: %d\n", codec_ctx->global_quality);
+    ENCODER_LOG(encoder, "[Encoder Config] Actual effective QScale: %d (global_quality / FF_QP2LAMBDA = %d / %d)\n", 
+            codec_ctx->global_quality / FF_QP2LAMBDA, 
+            codec_ctx->global_quality, FF_QP2LAMBDA);
+    ENCODER_LOG(encoder, "[Encoder Config] Actual effective qmin: %d, qmax: %d\n",
+            codec_ctx->qmin, codec_ctx->qmax);
+    
+    return codec_ctx;
+}
+
+// ============================================================================
+// Hot-Spare Failover
+// ============================================================================
+
+static void* encoder_spare_main(void* arg) {
+    EncoderSpareJob* job = (EncoderSpareJob*)arg;
+    uint64_t t_start = get_time_ns();
+    
+    // A wedged context can take a while to close: never on the encode path
+    if (job->retired) {
+        avcodec_free_context(&job->retired);
+    }
+    AVCodecContext* ctx = encoder_open_codec(&job->config);
+    
+    pthread_mutex_lock(&job->lock);
+    job->ctx = ctx;
+    job->build_ms = (get_time_ns() - t_start) / 1000000.0;
+    job->done = 1;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// Pick up a finished background build (wait for it if wait is set)
+static void encoder_spare_collect(NV12MJPEGEncoder* encoder, int wait) {
+    EncoderSpareJob* job = encoder->spare_job;
+    if (!job) {
+        return;
+    }
+    if (!wait) {
+        pthread_mutex_lock(&job->lock);
+        int done = job->done;
+        pthread_mutex_unlock(&job->lock);
+        if (!done) {
+            return;
+        }
+    }
+    
+    pthread_join(job->thread, NULL);
+    encoder->spare_ctx = job->ctx;
+    encoder->stats.last_spare_build_ms = job->build_ms;
+    if (!job->ctx) {
+        fprintf(stderr, "Failed to open standby codec context\n");
+    }
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+    encoder->spare_job = NULL;
+}
+
+// Build a new standby context in the background from the current settings,
+// freeing retired (a failed context) on the same thread
+static void encoder_spare_start(NV12MJPEGEncoder* encoder, AVCodecContext* retired) {
+    EncoderSpareJob* job = (EncoderSpareJob*)calloc(1, sizeof(EncoderSpareJob));
+    if (!job) {
+        fprintf(stderr, "Failed to allocate standby context job\n");
+        avcodec_free_context(&retired);
+        return;
+    }
+    job->config = *encoder;
+    job->retired = retired;
+    pthread_mutex_init(&job->lock, NULL);
+    if (pthread_create(&job->thread, NULL, encoder_spare_main, job) != 0) {
+        fprintf(stderr, "Failed to start standby context thread\n");
+        pthread_mutex_destroy(&job->lock);
+        avcodec_free_context(&job->retired);
+        free(job);
+        return;
+    }
+    encoder->spare_job = job;
+}
+
+// Settings changed: the standby context must be rebuilt to match
+static void encoder_spare_refresh(NV12MJPEGEncoder* encoder) {
+    if (!encoder->hot_spare) {
+        return;
+    }
+    encoder_spare_collect(encoder, 1);
+    avcodec_free_context(&encoder->spare_ctx);
+    encoder_spare_start(encoder, NULL);
+}
+
+// Codec failed with err: swap in the standby context and rebuild another one in
+// the background. Returns 0 if the frame can be retried, else err.
+static int encoder_failover(NV12MJPEGEncoder* encoder, int err) {
+    if (!encoder->hot_spare) {
+        return err;
+    }
+    
+    // A build still running (back-to-back failures) is waited for: it has a head start on a reopen
+    encoder_spare_collect(encoder, !encoder->spare_ctx);
+    if (!encoder->spare_ctx) {
+        return err;
+    }
+    
+    AVCodecContext* failed = encoder->codec_ctx;
+    encoder->codec_ctx = encoder->spare_ctx;
+    encoder->spare_ctx = NULL;
+    encoder->sim_count = encoder->sim_pkt_count;  // Simulated frames of the failed context never complete
+    encoder->stats.failovers++;
+    fprintf(stderr, "Encoder error (%s): switched to the standby codec context\n", av_err2str(err));
+    encoder_spare_start(encoder, failed);
+    return 0;
+}
+
+// Start a fresh codec session (after EOF or an error mid-stream)
+static int encoder_reset_session(NV12MJPEGEncoder* encoder) {
+    if (encoder_codecless(encoder)) {
+        return 0;
+    }
+    if (encoder->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) {
+        avcodec_flush_buffers(encoder->codec_ctx);
+        return 0;
+    }
+    
+    AVCodecContext* codec_ctx = encoder_open_codec(encoder);
+    if (!codec_ctx) {
+        return AVERROR_EXTERNAL;
+    }
+    avcodec_free_context(&encoder->codec_ctx);
+    encoder->codec_ctx = codec_ctx;
+    encoder->stats.session_reopens++;
+    return 0;
+}
+
+// Quality of the next frame: the one-shot override if set, else the configured quality
+static int encoder_take_frame_quality(NV12MJPEGEncoder* encoder) {
+    int quality = encoder->next_quality ? encoder->next_quality : encoder->quality;
+    encoder->next_quality = 0;
+    encoder->stats.last_quality = quality;
+    return quality;
+}
+
+// Set the QP of a frame about to be sent. mjpeg rebuilds its quantization
+// matrices from the frame QP on every picture, but clamps it to qmin/qmax,
+// so the bounds follow the frame (the codec stays open).
+static void encoder_set_frame_qscale(NV12MJPEGEncoder* encoder, AVFrame* frame) {
+    int qscale = encoder_quality_to_qscale(encoder, encoder_take_frame_quality(encoder));
+    
+    frame->quality = qscale * FF_QP2LAMBDA;
+    if (encoder->backend == NV12_MJPEG_BACKEND_SOFTWARE) {
+        encoder->codec_ctx->global_quality = frame->quality;
+        encoder->codec_ctx->qmin = qscale;
+        encoder->codec_ctx->qmax = qscale;
+    }
+}
+
 NV12MJPEGEncoder* encoder_create(int width, int height, int quality) {
+    NV12MJPEGEncoderOptions opts;
+    encoder_options_init(&opts, width, height, quality);
+    return encoder_create_with_options(&opts);
+}
+
+NV12MJPEGEncoder* encoder_create_with_options(const NV12MJPEGEncoderOptions* opts) {
     int ret;
     
+    if (!opts) {
+        return NULL;
+    }
+    
+    int width = opts->width;
+    int height = opts->height;
+    int quality = opts->quality;
+    
     // Validate parameters
     if (width <= 0 || height <= 0) {
         fprintf(stderr, "Invalid dimensions: %dx%d\n", width, height);
@@ -88,6 +704,39 @@ NV12MJPEGEncoder* encoder_create(int width, int height, int quality) {
         fprintf(stderr, "Invalid quality: %d (must be 1-99)\n", quality);
         return NULL;
     }
+    if (opts->queue_depth < 1 || opts->queue_depth > NV12_MJPEG_MAX_QUEUE_DEPTH) {
+        fprintf(stderr, "Invalid queue depth: %d (must be 1-%d)\n",
+                opts->queue_depth, NV12_MJPEG_MAX_QUEUE_DEPTH);
+        return NULL;
+    }
+    if (opts->strips < 1 || opts->strips > NV12_MJPEG_MAX_STRIPS) {
+        fprintf(stderr, "Invalid strip count: %d (must be 1-%d)\n", opts->strips, NV12_MJPEG_MAX_STRIPS);
+        return NULL;
+    }
+    if (opts->huffman < NV12_MJPEG_HUFFMAN_STANDARD || opts->huffman > NV12_MJPEG_HUFFMAN_STREAM) {
+        fprintf(stderr, "Invalid Huffman table mode: %d\n", opts->huffman);
+        return NULL;
+    }
+    if (opts->huffman == NV12_MJPEG_HUFFMAN_STREAM &&
+        (opts->huffman_window < 1 || opts->huffman_window > NV12_MJPEG_MAX_HUFFMAN_WINDOW)) {
+        fprintf(stderr, "Invalid Huffman window: %d (must be 1-%d)\n",
+                opts->huffman_window, NV12_MJPEG_MAX_HUFFMAN_WINDOW);
+        return NULL;
+    }
+    if (opts->huffman != NV12_MJPEG_HUFFMAN_STANDARD && opts->abbreviated) {
+        fprintf(stderr, "Optimized Huffman tables cannot be combined with abbreviated output\n");
+        return NULL;
+    }
+    if (opts->backend == NV12_MJPEG_BACKEND_TURBOJPEG && opts->abbreviated) {
+        fprintf(stderr, "Abbreviated output is not supported by the TurboJPEG backend\n");
+        return NULL;
+    }
+    
+    const char* codec_name = encoder_backend_codec_name(opts->backend);
+    if (!codec_name) {
+        fprintf(stderr, "Invalid encoder backend: %d\n", opts->backend);
+        return NULL;
+    }
     
     // Allocate encoder context
     NV12MJPEGEncoder* encoder = (NV12MJPEGEncoder*)calloc(1, sizeof(NV12MJPEGEncoder));
@@ -97,272 +746,2900 @@ NV12MJPEGEncoder* encoder_create(int width, int height, int quality) {
     }
     
     // Store parameters
+    encoder->backend = opts->backend;
     encoder->width = width;
     encoder->height = height;
     encoder->quality = quality;
     encoder->frame_counter = 0;
+    encoder->queue_depth = opts->queue_depth;
+    encoder->verbose = opts->verbose;
+    encoder->strips = opts->strips;
+    encoder->rc_alpha = RC_DEFAULT_ALPHA;
+    encoder->abbreviated = opts->abbreviated;
+    encoder->huffman = opts->huffman;
+    encoder->huffman_window = opts->huffman_window;
+    encoder->hot_spare = opts->hot_spare && opts->backend != NV12_MJPEG_BACKEND_NATIVE &&
+                         opts->backend != NV12_MJPEG_BACKEND_TURBOJPEG;
+    encoder->sim_config = opts->simulation;
+    
+    // Built-in encoder reads NV12 directly: no codec, frames or packets needed
+    if (encoder->backend == NV12_MJPEG_BACKEND_NATIVE) {
+        encoder->native = native_jpeg_create(width, height, quality, encoder->strips);
+        if (!encoder->native) {
+            free(encoder);
+            return NULL;
+        }
+        // Same mode values in both enums
+        if (native_jpeg_set_huffman(encoder->native, (NativeJpegHuffman)encoder->huffman, encoder->huffman_window) < 0) {
+            fprintf(stderr, "Failed to allocate Huffman statistics\n");
+            native_jpeg_destroy(encoder->native);
+            free(encoder);
+            return NULL;
+        }
+        encoder->pix_fmt = AV_PIX_FMT_NV12;
+        encoder->strips = native_jpeg_strips(encoder->native);
+        ENCODER_LOG(encoder, "[Encoder Config] Native JPEG: quality=%d, simd=%s, strips=%d, huffman=%d\n",
+                quality, native_jpeg_simd_name(encoder->native), encoder->strips, encoder->huffman);
+        return encoder;
+    }
+    
+    // libjpeg-turbo reads the NV12 planes the same way (chroma split on the fly)
+    if (encoder->backend == NV12_MJPEG_BACKEND_TURBOJPEG) {
+        encoder->turbo = turbo_jpeg_encoder_create(width, height, quality);
+        if (!encoder->turbo) {
+            free(encoder);
+            return NULL;
+        }
+        encoder->pix_fmt = AV_PIX_FMT_NV12;
+        encoder->strips = 1;
+        ENCODER_LOG(encoder, "[Encoder Config] TurboJPEG: quality=%d, chroma split=%s\n",
+                quality, turbo_jpeg_simd_name());
+        return encoder;
+    }
     
-    // Find hardware MJPEG encoder
-    encoder->codec = avcodec_find_encoder_by_name("mjpeg_rkmpp");
+    // Find MJPEG encoder for the selected backend
+    encoder->codec = avcodec_find_encoder_by_name(codec_name);
     if (!encoder->codec) {
-        fprintf(stderr, "Hardware MJPEG encoder (mjpeg_rkmpp) not found\n");
+        fprintf(stderr, "MJPEG encoder (%s) not found\n", codec_name);
         free(encoder);
         return NULL;
     }
     
-    // Allocate codec context
-    encoder->codec_ctx = avcodec_alloc_context3(encoder->codec);
+    // Allocate, configure and open codec context
+    encoder->codec_ctx = encoder_open_codec(encoder);
     if (!encoder->codec_ctx) {
-        fprintf(stderr, "Failed to allocate codec context\n");
         free(encoder);
         return NULL;
     }
+    encoder->pix_fmt = encoder->codec_ctx->pix_fmt;
     
-    // Configure codec parameters
-    encoder->codec_ctx->width = width;
-    encoder->codec_ctx->height = height;
-    encoder->codec_ctx->pix_fmt = AV_PIX_FMT_NV12;
-    encoder->codec_ctx->time_base = (AVRational){1, 30};
-    encoder->codec_ctx->framerate = (AVRational){30, 1};
-    encoder->codec_ctx->gop_size = 1;  // Every frame is a keyframe (required for MJPEG)
-    encoder->codec_ctx->max_b_frames = 0;  // No B-frames for MJPEG
-    
-    // Set quality control parameters - use fixed QP mode
-    // 1. Set flag to tell encoder to use fixed quantization parameters
-    encoder->codec_ctx->flags |= AV_CODEC_FLAG_QSCALE;
-    
-    // 2. Set global_quality (critical for quality control)
-    // In FFmpeg, global_quality uses lambda units
-    encoder->codec_ctx->global_quality = quality * FF_QP2LAMBDA;
-    
-    // Print quality parameters for debugging
-    fprintf(stderr, "[Encoder Config] FF_QP2LAMBDA constant: %d\n", FF_QP2LAMBDA);
-    fprintf(stderr, "[Encoder Config] Quality (QP): %d\n", quality);
-    fprintf(stderr, "[Encoder Config] global_quality: %d (QP * FF_QP2LAMBDA = %d * %d)\n", 
-            encoder->codec_ctx->global_quality, quality, FF_QP2LAMBDA);
-    
-    // 3. Set high bitrate for quality encoding
-    // For 1600x1200 @ 30fps with extremely high quality, instantaneous bitrate may exceed 100 Mbps
-    int64_t high_bitrate = 100 * 1000 * 1000; // 100 Mbps
-    
-    encoder->codec_ctx->bit_rate = high_bitrate;
-    encoder->codec_ctx->rc_max_rate = high_bitrate;
-    encoder->codec_ctx->rc_buffer_size = high_bitrate; // Allow buffer to hold one second of data
-    
-    fprintf(stderr, "[Encoder Config] Rate control: bit_rate=%ld bps (%.2f Mbps), rc_max_rate=%ld, rc_buffer_size=%ld\n",
-            encoder->codec_ctx->bit_rate, encoder->codec_ctx->bit_rate / 1000000.0,
-            encoder->codec_ctx->rc_max_rate, encoder->codec_ctx->rc_buffer_size);
-    
-    // Set quality bounds to match the fixed QP
-    encoder->codec_ctx->qmin = quality;
-    encoder->codec_ctx->qmax = quality;
-    
-    fprintf(stderr, "[Encoder Config] Quality bounds: qmin=%d, qmax=%d\n", 
-            encoder->codec_ctx->qmin, encoder->codec_ctx->qmax);
-    
-    // Set hardware encoder options for Rockchip MPP
-    av_opt_set_int(encoder->codec_ctx->priv_data, "qp_init", quality, 0);
-    av_opt_set_int(encoder->codec_ctx->priv_data, "qp_min", quality, 0);
-    av_opt_set_int(encoder->codec_ctx->priv_data, "qp_max", quality, 0);
+    // Allocate frame
+    encoder->frame = av_frame_alloc();
+    encoder->wrap_frame = av_frame_alloc();
+    if (!encoder->frame || !encoder->wrap_frame) {
+        fprintf(stderr, "Failed to allocate frame\n");
+        encoder_free_resources(encoder);
+        free(encoder);
+        return NULL;
+    }
     
-    fprintf(stderr, "[Encoder Config] Hardware encoder options: qp_init=%d, qp_min=%d, qp_max=%d\n",
-            quality, quality, quality);
+    encoder->frame->format = encoder->pix_fmt;
+    encoder->frame->width = width;
+    encoder->frame->height = height;
     
-    // Open codec (expensive operation - done once)
-    ret = avcodec_open2(encoder->codec_ctx, encoder->codec, NULL);
+    // Allocate frame buffers (done once, reused)
+    ret = av_frame_get_buffer(encoder->frame, 0);
     if (ret < 0) {
-        fprintf(stderr, "Failed to open codec: %s\n", av_err2str(ret));
-        avcodec_free_context(&encoder->codec_ctx);
+        fprintf(stderr, "Failed to allocate frame buffer: %s\n", av_err2str(ret));
+        encoder_free_resources(encoder);
         free(encoder);
         return NULL;
     }
     
-    // Print actual effective settings after codec is opened
-    if (ret >= 0) {
-        fprintf(stderr, "[Encoder Config] === After avcodec_open2() ===\n");
-        fprintf(stderr, "[Encoder Config] Actual effective bit_rate: %ld bps\n", encoder->codec_ctx->bit_rate);
-        fprintf(stderr, "[Encoder Config] Actual effective global_quality: %d\n", encoder->codec_ctx->global_quality);
-        fprintf(stderr, "[Encoder Config] Actual effective QScale: %d (global_quality / FF_QP2LAMBDA = %d / %d)\n", 
-                encoder->codec_ctx->global_quality / FF_QP2LAMBDA, 
-                encoder->codec_ctx->global_quality, FF_QP2LAMBDA);
-        fprintf(stderr, "[Encoder Config] Actual effective qmin: %d, qmax: %d\n",
-                encoder->codec_ctx->qmin, encoder->codec_ctx->qmax);
+    // Planar backends need U/V planes even when Y is wrapped zero-copy
+    if (encoder->pix_fmt != AV_PIX_FMT_NV12) {
+        encoder->chroma_pool = av_buffer_pool_init((size_t)((width + 1) / 2) * ((height + 1) / 2), NULL);
+        if (!encoder->chroma_pool) {
+            fprintf(stderr, "Failed to allocate chroma buffer pool\n");
+            encoder_free_resources(encoder);
+            free(encoder);
+            return NULL;
+        }
     }
     
-    // Allocate frame
-    encoder->frame = av_frame_alloc();
-    if (!encoder->frame) {
-        fprintf(stderr, "Failed to allocate frame\n");
-        avcodec_free_context(&encoder->codec_ctx);
+    // Allocate packet
+    encoder->pkt = av_packet_alloc();
+    if (!encoder->pkt) {
+        fprintf(stderr, "Failed to allocate packet\n");
+        encoder_free_resources(encoder);
         free(encoder);
         return NULL;
     }
     
-    encoder->frame->format = AV_PIX_FMT_NV12;
-    encoder->frame->width = width;
-    encoder->frame->height = height;
-    
-    // Allocate frame buffers (done once, reused)
-    ret = av_frame_get_buffer(encoder->frame, 0);
+    // The simulated device's session limit applies like MPP's
+    if (encoder->backend == NV12_MJPEG_BACKEND_SIMULATED) {
+        encoder->sim = sim_session_open(&encoder->sim_config, width, height);
+        if (!encoder->sim) {
+            encoder_free_resources(encoder);
+            free(encoder);
+            return NULL;
+        }
+    }
+    
+    if (encoder->hot_spare) {
+        encoder_spare_start(encoder, NULL);
+    }
+    
+    return encoder;
+}
+
+size_t encoder_max_output_size(const NV12MJPEGEncoder* encoder) {
+    if (!encoder) {
+        return 0;
+    }
+    // Conservative estimate: assume worst case of uncompressed size
+    // In practice, MJPEG compression is usually 5:1 to 20:1
+    size_t size = (size_t)encoder->width * encoder->height * 3 / 2;
+    if (encoder->native) {
+        // Native encoder checks space per MCU, so leave room for headers and one MCU
+        size += native_jpeg_output_reserve(encoder->native);
+    }
+    if (encoder->turbo) {
+        // Buffers of tjBufSize() are encoded into without a copy
+        size = turbo_jpeg_max_output_size(encoder->turbo);
+    }
+    return size;
+}
+
+int encoder_get_stats(const NV12MJPEGEncoder* encoder, NV12MJPEGEncoderStats* stats) {
+    if (!encoder || !stats) {
+        return -EINVAL;
+    }
+    *stats = encoder->stats;
+    return 0;
+}
+
+int encoder_set_quality(NV12MJPEGEncoder* encoder, int quality) {
+    if (!encoder || quality < 1 || quality > 99) {
+        return -EINVAL;
+    }
+    if (quality == encoder->quality) {
+        return 0;
+    }
+    encoder->dedup_valid = 0;
+    
+    // Native tables are swapped per frame and software QP is per frame: no reopen
+    if (!encoder_quality_fixed(encoder)) {
+        encoder->quality = quality;
+        ENCODER_LOG(encoder, "[Encoder Config] Quality changed to %d (qscale=%d)\n",
+                quality, encoder_quality_to_qscale(encoder, quality));
+        return 0;
+    }
+    
+    // mjpeg_rkmpp applies its q_factor at init: reopen the codec context only,
+    // frames, packets and pools are kept
+    if (encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    int old_quality = encoder->quality;
+    encoder->quality = quality;
+    AVCodecContext* codec_ctx = encoder_open_codec(encoder);
+    if (!codec_ctx) {
+        encoder->quality = old_quality;
+        return AVERROR_EXTERNAL;
+    }
+    avcodec_free_context(&encoder->codec_ctx);
+    encoder->codec_ctx = codec_ctx;
+    encoder_spare_refresh(encoder);
+    return 0;
+}
+
+int encoder_set_frame_quality(NV12MJPEGEncoder* encoder, int quality) {
+    if (!encoder || quality < 0 || quality > 99) {
+        return -EINVAL;
+    }
+    if (encoder_quality_fixed(encoder) && quality != 0 && quality != encoder->quality) {
+        fprintf(stderr, "Per-frame quality is not supported by mjpeg_rkmpp, use encoder_set_quality()\n");
+        return -ENOTSUP;
+    }
+    encoder->next_quality = quality;
+    return 0;
+}
+
+int encoder_set_quant_tables(NV12MJPEGEncoder* encoder, const uint8_t* luma, const uint8_t* chroma) {
+    if (!encoder || !luma != !chroma) {
+        return -EINVAL;
+    }
+    for (int n = 0; luma && n < 64; n++) {
+        if (!luma[n] || !chroma[n]) {
+            fprintf(stderr, "Invalid quantization table entry %d: must be 1-255\n", n);
+            return -EINVAL;
+        }
+    }
+    if (encoder_quality_fixed(encoder)) {
+        fprintf(stderr, "Custom quantization tables are not supported by mjpeg_rkmpp (q_factor only)\n");
+        return -ENOTSUP;
+    }
+    if (encoder->turbo) {
+        fprintf(stderr, "Custom quantization tables are not supported by the TurboJPEG backend\n");
+        return -ENOTSUP;
+    }
+    if (encoder->backend == NV12_MJPEG_BACKEND_SOFTWARE && encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    
+    int old_custom = encoder->custom_quant;
+    uint8_t old_tables[2][64];
+    memcpy(old_tables, encoder->quant_tables, sizeof(old_tables));
+    encoder->custom_quant = luma != NULL;
+    if (luma) {
+        memcpy(encoder->quant_tables[0], luma, 64);
+        memcpy(encoder->quant_tables[1], chroma, 64);
+    }
+    
+    if (encoder->native) {
+        native_jpeg_set_base_tables(encoder->native, luma, chroma);
+    } else {
+        // mjpeg reads the matrices at init: reopen the codec context only
+        AVCodecContext* codec_ctx = encoder_open_codec(encoder);
+        if (!codec_ctx) {
+            encoder->custom_quant = old_custom;
+            memcpy(encoder->quant_tables, old_tables, sizeof(old_tables));
+            return AVERROR_EXTERNAL;
+        }
+        avcodec_free_context(&encoder->codec_ctx);
+        encoder->codec_ctx = codec_ctx;
+        encoder_spare_refresh(encoder);
+    }
+    
+    // New tables: re-send them in abbreviated mode, refit the size model, re-encode static scenes
+    encoder->tables_size = 0;
+    encoder->rc_coef = 0.0;
+    encoder->dedup_valid = 0;
+    
+    for (int i = 0; i < ROI_CACHE_SIZE; i++) {
+        if (encoder->roi_cache[i]) {
+            encoder_set_quant_tables(encoder->roi_cache[i], luma, chroma);
+        }
+    }
+    ENCODER_LOG(encoder, "[Encoder Config] Quantization tables: %s\n", luma ? "custom" : "standard");
+    return 0;
+}
+
+int encoder_get_quality(const NV12MJPEGEncoder* encoder) {
+    return encoder ? encoder->quality : -EINVAL;
+}
+
+int encoder_get_tables(const NV12MJPEGEncoder* encoder, uint8_t* out_buffer, size_t buffer_size,
+                       size_t* out_size) {
+    if (!encoder || !out_buffer || !out_size || !encoder->abbreviated) {
+        return -EINVAL;
+    }
+    if (encoder->tables_size == 0) {
+        return -EAGAIN;
+    }
+    
+    *out_size = encoder->tables_size;
+    if (buffer_size < encoder->tables_size) {
+        return -ENOMEM;
+    }
+    memcpy(out_buffer, encoder->tables, encoder->tables_size);
+    return 0;
+}
+
+// Split interleaved NV12 chroma into the separate U and V planes of a planar frame
+static void split_uv_plane(const uint8_t* src_uv, int src_stride,
+                           uint8_t* dst_u, int dst_u_stride, uint8_t* dst_v, int dst_v_stride,
+                           int chroma_width, int chroma_height) {
+    #pragma omp parallel for if(chroma_height > 240)
+    for (int y = 0; y < chroma_height; y++) {
+        const uint8_t* s = src_uv + (size_t)y * src_stride;
+        uint8_t* u = dst_u + (size_t)y * dst_u_stride;
+        uint8_t* v = dst_v + (size_t)y * dst_v_stride;
+        for (int x = 0; x < chroma_width; x++) {
+            u[x] = s[2 * x];
+            v[x] = s[2 * x + 1];
+        }
+    }
+}
+
+// Copy a plane row by row, or in one memcpy when both sides are unpadded
+static void copy_plane(uint8_t* dst, int dst_stride, const uint8_t* src, int src_stride,
+                       int row_bytes, int rows) {
+    if (dst_stride == row_bytes && src_stride == row_bytes) {
+        memcpy(dst, src, (size_t)row_bytes * rows);
+        return;
+    }
+    #pragma omp parallel for if(rows > 480)
+    for (int y = 0; y < rows; y++) {
+        memcpy(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride, row_bytes);
+    }
+}
+
+// Abbreviated output for codec packets: drop DQT/DHT when they match the
+// session tables. The remaining header segments are moved up against SOS,
+// so the entropy-coded data is not copied. Frames with new tables stay complete.
+static void encoder_abbreviate_packet(NV12MJPEGEncoder* encoder, AVPacket* pkt) {
+    uint8_t tables[NV12_MJPEG_MAX_TABLES_SIZE];
+    uint8_t header[NV12_MJPEG_MAX_TABLES_SIZE];
+    size_t tables_size = 2;
+    size_t header_size = 2;
+    size_t pos = 2;
+    
+    if (pkt->size < 4 || pkt->data[0] != 0xFF || pkt->data[1] != 0xD8) {
+        return;
+    }
+    tables[0] = header[0] = 0xFF;
+    tables[1] = header[1] = 0xD8;
+    
+    // Split the segments before SOS into tables and everything else
+    for (;;) {
+        if (pos + 4 > (size_t)pkt->size || pkt->data[pos] != 0xFF) {
+            return;
+        }
+        uint8_t marker = pkt->data[pos + 1];
+        if (marker == 0xDA) {
+            break;
+        }
+        size_t len = 2 + ((size_t)pkt->data[pos + 2] << 8 | pkt->data[pos + 3]);
+        int is_table = marker == 0xDB || marker == 0xC4;
+        uint8_t* dst = is_table ? tables : header;
+        size_t* dst_size = is_table ? &tables_size : &header_size;
+        if (pos + len > (size_t)pkt->size || *dst_size + len + 2 > NV12_MJPEG_MAX_TABLES_SIZE) {
+            return;
+        }
+        memcpy(dst + *dst_size, pkt->data + pos, len);
+        *dst_size += len;
+        pos += len;
+    }
+    tables[tables_size++] = 0xFF;
+    tables[tables_size++] = 0xD9;
+    
+    if (tables_size != encoder->tables_size || memcmp(tables, encoder->tables, tables_size) != 0) {
+        memcpy(encoder->tables, tables, tables_size);
+        encoder->tables_size = tables_size;
+        return;
+    }
+    
+    // Codec packets are normally not shared, so this rarely copies
+    if (av_packet_make_writable(pkt) < 0) {
+        return;
+    }
+    uint8_t* start = pkt->data + pos - header_size;
+    memcpy(start, header, header_size);
+    pkt->size -= (int)(start - pkt->data);
+    pkt->data = start;
+}
+
+// Simulated backend: move the packets the codec has finished into the FIFO
+static int encoder_sim_fetch(NV12MJPEGEncoder* encoder) {
+    int ret = 0;
+    
+    while (encoder->sim_pkt_count < encoder->sim_count) {
+        int tail = (encoder->sim_head + encoder->sim_pkt_count) % SIM_FIFO_SIZE;
+        if (!encoder->sim_pkts[tail]) {
+            encoder->sim_pkts[tail] = av_packet_alloc();
+            if (!encoder->sim_pkts[tail]) {
+                return AVERROR(ENOMEM);
+            }
+        }
+        ret = avcodec_receive_packet(encoder->codec_ctx, encoder->sim_pkts[tail]);
+        if (ret < 0) {
+            break;
+        }
+        encoder->sim_pkt_count++;
+    }
+    
+    return ret;
+}
+
+// Simulated backend: model the hardware time of a frame the codec accepted at submit_ns
+static void encoder_sim_push(NV12MJPEGEncoder* encoder, uint64_t submit_ns) {
+    if (!encoder->sim || encoder->sim_count == SIM_FIFO_SIZE) {
+        return;
+    }
+    
+    double wait_ms = 0.0;
+    uint64_t done = sim_session_schedule(encoder->sim, submit_ns, &wait_ms);
+    encoder->sim_done[(encoder->sim_head + encoder->sim_count) % SIM_FIFO_SIZE] = done;
+    encoder->sim_count++;
+    encoder->stats.last_sim_latency_ms = (done - submit_ns) / 1000000.0;
+    encoder->stats.total_sim_wait_ms += wait_ms;
+    
+    // The software encode ran inside the send: the packet is late if it outlasted the model
+    if (get_time_ns() > done) {
+        encoder->stats.sim_overruns++;
+    }
+    
+    // Errors are reported by the receive
+    encoder_sim_fetch(encoder);
+}
+
+static void encoder_sim_wait_until(uint64_t done) {
+    for (uint64_t now = get_time_ns(); now < done; now = get_time_ns()) {
+        uint64_t ns = done - now;
+        struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// avcodec_receive_packet(); the simulated backend holds each packet back until
+// its modeled completion time (waits for it, or returns EAGAIN before it)
+static int encoder_codec_receive(NV12MJPEGEncoder* encoder, AVPacket* pkt, int wait) {
+    if (!encoder->sim) {
+        return avcodec_receive_packet(encoder->codec_ctx, pkt);
+    }
+    
+    int ret = encoder_sim_fetch(encoder);
+    if (encoder->sim_pkt_count == 0) {
+        // Nothing held: codec status (EAGAIN, EOF, error)
+        return ret < 0 ? ret : avcodec_receive_packet(encoder->codec_ctx, pkt);
+    }
+    
+    uint64_t done = encoder->sim_done[encoder->sim_head];
+    if (get_time_ns() < done) {
+        if (!wait) {
+            return AVERROR(EAGAIN);
+        }
+        encoder_sim_wait_until(done);
+    }
+    av_packet_move_ref(pkt, encoder->sim_pkts[encoder->sim_head]);
+    encoder->sim_head = (encoder->sim_head + 1) % SIM_FIFO_SIZE;
+    encoder->sim_count--;
+    encoder->sim_pkt_count--;
+    return 0;
+}
+
+static void sleep_us(long us) {
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+// Receive the packet for the frame just sent. Hardware codecs finish it
+// asynchronously, so EAGAIN is polled for up to BATCH_STALL_MS; only a codec
+// that still holds the frame back is flushed for it, and a new session is
+// started before returning.
+static int encoder_receive_packet(NV12MJPEGEncoder* encoder) {
+    int ret;
+    uint64_t t_start, t_end;
+    
+    t_start = get_time_ns();
+    ret = encoder_codec_receive(encoder, encoder->pkt, 1);
+    while (ret == AVERROR(EAGAIN) && get_time_ns() - t_start < BATCH_STALL_MS * 1000000ULL) {
+        sleep_us(200);
+        ret = encoder_codec_receive(encoder, encoder->pkt, 1);
+    }
+    t_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] avcodec_receive_packet: %.3f ms\n", (t_end - t_start) / 1000000.0);
+    if (ret == AVERROR(EAGAIN)) {
+        // Codec stalled on the frame - send NULL frame to flush
+        ENCODER_LOG(encoder, "[Encoder] Flushing encoder...\n");
+        t_start = get_time_ns();
+        ret = avcodec_send_frame(encoder->codec_ctx, NULL);
+        if (ret < 0) {
+            fprintf(stderr, "Error flushing encoder: %s\n", av_err2str(ret));
+            return ret;
+        }
+        
+        // Try to receive packet again after flush
+        ret = encoder_codec_receive(encoder, encoder->pkt, 1);
+        if (ret < 0) {
+            fprintf(stderr, "Error receiving packet after flush: %s\n", av_err2str(ret));
+        }
+        
+        // The flushed codec is at EOF; the next frame needs a fresh session
+        int reset = encoder_reset_session(encoder);
+        t_end = get_time_ns();
+        ENCODER_LOG(encoder, "[Perf] Flush + receive + session reset: %.3f ms\n", (t_end - t_start) / 1000000.0);
+        if (ret < 0) {
+            return ret;
+        }
+        if (reset < 0) {
+            fprintf(stderr, "Failed to restart encoder session: %s\n", av_err2str(reset));
+            av_packet_unref(encoder->pkt);
+            return reset;
+        }
+    } else if (ret == AVERROR_EOF) {
+        fprintf(stderr, "Error: encoder returned EOF\n");
+        return ret;
+    } else if (ret < 0) {
+        fprintf(stderr, "Error receiving packet from encoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    
+    if (encoder->abbreviated) {
+        encoder_abbreviate_packet(encoder, encoder->pkt);
+    }
+    
+    return 0;
+}
+
+// Copy the received packet to the caller's buffer and release it
+static int encoder_output_packet(NV12MJPEGEncoder* encoder, uint8_t* out_buffer,
+                                 size_t buffer_size, size_t* out_size) {
+    uint64_t t_start, t_end;
+    
+    // Check if output buffer is large enough
+    if ((size_t)encoder->pkt->size > buffer_size) {
+        *out_size = encoder->pkt->size;  // Return required size
+        fprintf(stderr, "Output buffer too small: need %d bytes, have %zu bytes\n", 
+                encoder->pkt->size, buffer_size);
+        av_packet_unref(encoder->pkt);
+        return -ENOMEM;
+    }
+    
+    // Copy encoded data to output buffer
+    t_start = get_time_ns();
+    memcpy(out_buffer, encoder->pkt->data, encoder->pkt->size);
+    t_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] Output memcpy: %.3f ms (%d bytes)\n", 
+            (t_end - t_start) / 1000000.0, encoder->pkt->size);
+    *out_size = encoder->pkt->size;
+    
+    // Unreference packet for next use
+    av_packet_unref(encoder->pkt);
+    
+    return 0;
+}
+
+// Apply the frame's quality and choose complete or abbreviated output. A frame
+// whose tables differ from the session tables is complete and its tables
+// become the session tables. TurboJPEG frames are always complete.
+static void encoder_native_begin_frame(NV12MJPEGEncoder* encoder) {
+    if (encoder->turbo) {
+        turbo_jpeg_set_quality(encoder->turbo, encoder_take_frame_quality(encoder));
+        return;
+    }
+    native_jpeg_set_quality(encoder->native, encoder_take_frame_quality(encoder));
+    if (!encoder->abbreviated) {
+        return;
+    }
+    
+    int quality = native_jpeg_quality(encoder->native);
+    if (encoder->tables_size && encoder->tables_quality == quality) {
+        native_jpeg_set_abbreviated(encoder->native, 1);
+        return;
+    }
+    native_jpeg_set_abbreviated(encoder->native, 0);
+    native_jpeg_write_tables(encoder->native, encoder->tables, sizeof(encoder->tables), &encoder->tables_size);
+    encoder->tables_quality = quality;
+}
+
+// Count a completed native/TurboJPEG frame and its Huffman table saving
+static void encoder_native_end_frame(NV12MJPEGEncoder* encoder) {
+    encoder->stats.frames_encoded++;
+    encoder->stats.last_huffman_saved = encoder->native ? native_jpeg_huffman_saved(encoder->native) : 0;
+    encoder->stats.total_huffman_saved += encoder->stats.last_huffman_saved;
+}
+
+// Encode NV12 planes with the native or the TurboJPEG encoder (one strip)
+static int encoder_codecless_encode(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride,
+                                    const uint8_t* src_uv, int uv_stride,
+                                    uint8_t* out, size_t out_capacity, size_t* out_size, double* strip_ms) {
+    if (encoder->native) {
+        return native_jpeg_encode(encoder->native, src_y, y_stride, src_uv, uv_stride,
+                                  out, out_capacity, out_size, strip_ms);
+    }
+    uint64_t t_start = get_time_ns();
+    int ret = turbo_jpeg_encode(encoder->turbo, src_y, y_stride, src_uv, uv_stride, out, out_capacity, out_size);
+    if (strip_ms) {
+        strip_ms[0] = (get_time_ns() - t_start) / 1000000.0;
+    }
+    return ret;
+}
+
+// Encode with the native or TurboJPEG encoder into a pooled refcounted buffer. Frames
+// that do not fit the usual output size are retried once into a worst-case buffer.
+static int encoder_native_encode_to_ref(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                                        AVBufferRef** out_buf, size_t* out_size, double* strip_ms) {
+    size_t capacity = encoder_max_output_size(encoder);
+    size_t size = 0;
+    
+    if (!encoder->native_out_pool) {
+        encoder->native_out_pool = av_buffer_pool_init(capacity, NULL);
+        if (!encoder->native_out_pool) {
+            return AVERROR(ENOMEM);
+        }
+    }
+    
+    AVBufferRef* buf = av_buffer_pool_get(encoder->native_out_pool);
+    if (!buf) {
+        return AVERROR(ENOMEM);
+    }
+    encoder_native_begin_frame(encoder);
+    int ret = encoder_codecless_encode(encoder, nv12_data, encoder->width,
+                                       nv12_data + (size_t)encoder->width * encoder->height, encoder->width,
+                                       buf->data, capacity, &size, strip_ms);
+    if (ret == -ENOMEM) {
+        av_buffer_unref(&buf);
+        buf = av_buffer_alloc(size);
+        if (!buf) {
+            return AVERROR(ENOMEM);
+        }
+        ret = encoder_codecless_encode(encoder, nv12_data, encoder->width,
+                                       nv12_data + (size_t)encoder->width * encoder->height, encoder->width,
+                                       buf->data, size, &size, strip_ms);
+    }
+    if (ret < 0) {
+        av_buffer_unref(&buf);
+        return ret;
+    }
+    encoder->frame_counter++;
+    encoder_native_end_frame(encoder);
+    
+    *out_buf = buf;
+    *out_size = size;
+    return 0;
+}
+
+// Encode straight from the caller's NV12 planes with the native or TurboJPEG encoder
+static int encoder_encode_native(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride,
+                                 const uint8_t* src_uv, int uv_stride,
+                                 uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    encoder_native_begin_frame(encoder);
+    uint64_t t_start = get_time_ns();
+    int ret = encoder_codecless_encode(encoder, src_y, y_stride, src_uv, uv_stride,
+                                       out_buffer, buffer_size, out_size, encoder->stats.strip_encode_ms);
+    uint64_t t_end = get_time_ns();
+    encoder->frame_counter++;
+    if (ret == -ENOMEM) {
+        fprintf(stderr, "Output buffer too small: need up to %zu bytes, have %zu bytes\n",
+                *out_size, buffer_size);
+        return ret;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    if (encoder->turbo) {
+        ENCODER_LOG(encoder, "[Perf] TurboJPEG encode: %.3f ms (%zu bytes)\n",
+                (t_end - t_start) / 1000000.0, *out_size);
+    } else {
+        ENCODER_LOG(encoder, "[Perf] Native JPEG encode (%s, %d strips): %.3f ms (%zu bytes)\n",
+                native_jpeg_simd_name(encoder->native), encoder->strips, (t_end - t_start) / 1000000.0, *out_size);
+    }
+    encoder_native_end_frame(encoder);
+    encoder->stats.last_encode_ms = (t_end - t_start) / 1000000.0;
+    encoder->stats.num_strips = encoder->strips;
+    return 0;
+}
+
+// ============================================================================
+// Size-Targeted Rate Control
+// ============================================================================
+
+// Mean absolute luma gradient over every 8th row: cheap estimate of how many
+// bits a frame needs at a given quantizer step
+static double nv12_luma_activity(const uint8_t* y, int stride, int width, int height) {
+    uint64_t sum = 0;
+    uint64_t count = 0;
+    
+    for (int row = 0; row + 1 < height; row += 8) {
+        const uint8_t* p = y + (size_t)row * stride;
+        const uint8_t* below = p + stride;
+        for (int x = 0; x + 1 < width; x++) {
+            sum += abs(p[x] - p[x + 1]) + abs(p[x] - below[x]);
+        }
+        count += width - 1;
+    }
+    return 1.0 + (count ? (double)sum / count : 0.0);
+}
+
+// Relative quantizer step of a quality value (larger step = smaller output)
+static double encoder_rc_step(const NV12MJPEGEncoder* encoder, int quality) {
+    // The software backend only has the integer qscale steps (qscale 8 = 100%)
+    if (encoder->backend == NV12_MJPEG_BACKEND_SOFTWARE) {
+        return encoder_quality_to_qscale(encoder, quality) * 12.5;
+    }
+    return quality_scale_percent(quality);
+}
+
+// Highest quality (not above the configured one) predicted to fit in aim bytes
+static int encoder_rc_pick_quality(const NV12MJPEGEncoder* encoder, double aim) {
+    double min_step = encoder_rc_step(encoder, encoder->quality);
+    int best = 0;
+    double best_step = 0.0;
+    int worst = 0;
+    double worst_step = 0.0;
+    
+    for (int q = 1; q <= 99; q++) {
+        double step = encoder_rc_step(encoder, q);
+        if (step < min_step) {
+            continue;
+        }
+        if (step > worst_step) {
+            worst = q;
+            worst_step = step;
+        }
+        double predicted = encoder->rc_coef * encoder->rc_activity * pow(step, -encoder->rc_alpha);
+        // Ties (qualities sharing a software qscale) go to the highest quality
+        if (predicted <= aim && (!best || step <= best_step)) {
+            best = q;
+            best_step = step;
+        }
+    }
+    return best ? best : worst;
+}
+
+// Measure the frame and choose its quality from the model
+static void encoder_rc_begin(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride) {
+    if (!encoder->rc_target_size) {
+        return;
+    }
+    encoder->rc_activity = nv12_luma_activity(src_y, y_stride, encoder->width, encoder->height);
+    encoder->next_quality = encoder->rc_coef > 0.0 ?
+        encoder_rc_pick_quality(encoder, encoder->rc_target_size * RC_AIM) : encoder->quality;
+}
+
+// Fit the model to an encode result. Returns 1 if the frame should be encoded
+// once more (quality for it already set), 0 to keep the result.
+static int encoder_rc_end(NV12MJPEGEncoder* encoder, int ret, size_t size, int pass) {
+    if (!encoder->rc_target_size || (ret < 0 && ret != -ENOMEM) || size == 0) {
+        return 0;
+    }
+    
+    int quality = encoder->stats.last_quality;
+    double step = encoder_rc_step(encoder, quality);
+    
+    if (pass > 0) {
+        // Two sizes of the same content: refine the exponent
+        double first_step = encoder_rc_step(encoder, encoder->rc_first_quality);
+        if (ret == 0 && first_step != step) {
+            double alpha = log((double)encoder->rc_first_size / size) / log(step / first_step);
+            if (alpha > 0.2 && alpha < 2.0) {
+                encoder->rc_alpha = 0.5 * encoder->rc_alpha + 0.5 * alpha;
+            }
+        }
+    }
+    encoder->rc_coef = size * pow(step, encoder->rc_alpha) / encoder->rc_activity;
+    
+    // Slot mode keeps lowering quality until the frame fits (or the coarsest step is reached)
+    if ((pass == 0 || encoder->slot_size) && (ret == -ENOMEM || size > encoder->rc_target_size)) {
+        int retry_quality = encoder_rc_pick_quality(encoder, encoder->rc_target_size * RC_RETRY_AIM);
+        if (encoder_rc_step(encoder, retry_quality) > step) {
+            encoder->rc_first_size = size;
+            encoder->rc_first_quality = quality;
+            encoder->next_quality = retry_quality;
+            if (pass == 0) {
+                encoder->stats.rc_retries++;
+            }
+            ENCODER_LOG(encoder, "[RateControl] %zu bytes at quality %d exceeds target %zu, retrying at %d\n",
+                    size, quality, encoder->rc_target_size, retry_quality);
+            return 1;
+        }
+    }
+    if (ret == 0 && size > encoder->rc_target_size) {
+        encoder->stats.rc_over_target++;
+    }
+    return 0;
+}
+
+int encoder_set_target_size(NV12MJPEGEncoder* encoder, size_t target_bytes) {
+    if (!encoder) {
+        return -EINVAL;
+    }
+    if (target_bytes && encoder_quality_fixed(encoder)) {
+        fprintf(stderr, "Size-targeted rate control is not supported by mjpeg_rkmpp\n");
+        return -ENOTSUP;
+    }
+    encoder->rc_target_size = target_bytes;
+    encoder->slot_size = 0;
+    encoder->next_quality = 0;
+    encoder->dedup_valid = 0;
+    return 0;
+}
+
+int encoder_set_slot_size(NV12MJPEGEncoder* encoder, size_t slot_bytes) {
+    int ret = encoder_set_target_size(encoder, slot_bytes);
+    if (ret < 0) {
+        return ret;
+    }
+    encoder->slot_size = slot_bytes;
+    return 0;
+}
+
+// Pad a frame that fits its slot with zero bytes after EOI
+static int encoder_fill_slot(NV12MJPEGEncoder* encoder, uint8_t* out_buffer, size_t* out_size) {
+    if (*out_size > encoder->slot_size) {
+        fprintf(stderr, "Frame does not fit its slot: %zu bytes at quality %d, slot %zu bytes\n",
+                *out_size, encoder->stats.last_quality, encoder->slot_size);
+        return -ENOSPC;
+    }
+    size_t padding = encoder->slot_size - *out_size;
+    memset(out_buffer + *out_size, 0, padding);
+    encoder->stats.last_slot_padding = padding;
+    encoder->stats.total_slot_padding += padding;
+    *out_size = encoder->slot_size;
+    return 0;
+}
+
+int encoder_set_target_ratio(NV12MJPEGEncoder* encoder, double ratio) {
+    if (!encoder || ratio < 0.0) {
+        return -EINVAL;
+    }
+    if (ratio == 0.0) {
+        return encoder_set_target_size(encoder, 0);
+    }
+    size_t raw_size = (size_t)encoder->width * encoder->height * 3 / 2;
+    size_t target = (size_t)(raw_size / ratio);
+    return encoder_set_target_size(encoder, target > 0 ? target : 1);
+}
+
+// ============================================================================
+// Static-Scene Deduplication
+// ============================================================================
+
+#define DEDUP_PRIME1 0x9E3779B185EBCA87ULL
+#define DEDUP_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define DEDUP_PRIME32 0x9E3779B1U     // Row scramble multiplier (32 bits: SSE2/NEON have 32x32->64 multiplies only)
+#define DEDUP_KEY_STEP 0x165667B19E3779F9ULL  // Key advance per 32-byte stripe
+#define DEDUP_SAMPLE_ROWS 4       // NV12_MJPEG_DEDUP_SAMPLED hashes every 4th row
+
+static inline uint64_t dedup_round(uint64_t acc, uint64_t v) {
+    acc += v * DEDUP_PRIME2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * DEDUP_PRIME1;
+}
+
+// Accumulate the 32-byte stripes of every row_step-th row into four 64-bit lanes
+// (XXH3-style): lane i adds lo32(d ^ key) * hi32(d ^ key) of its 8 bytes d, its
+// neighbour lane adds d. The key advances per stripe and the lanes are scrambled
+// per row, so moved content hashes differently. A partial last stripe is zero
+// padded. All paths compute the same hash.
+static void dedup_hash_rows(uint64_t acc[4], const uint8_t* p, int stride, int row_bytes, int rows, int row_step) {
+    static const uint64_t key_init[4] = {DEDUP_PRIME2, DEDUP_PRIME1, ~DEDUP_PRIME2, ~DEDUP_PRIME1};
+    uint8_t pad[32];
+    
+#if defined(NV12_MJPEG_SSE2)
+    __m128i acc01 = _mm_loadu_si128((const __m128i*)acc);
+    __m128i acc23 = _mm_loadu_si128((const __m128i*)(acc + 2));
+    const __m128i step = _mm_set1_epi64x((long long)DEDUP_KEY_STEP);
+    const __m128i prime = _mm_set1_epi32((int)DEDUP_PRIME32);
+    
+    for (int y = 0; y < rows; y += row_step) {
+        const uint8_t* row = p + (size_t)y * stride;
+        __m128i key01 = _mm_loadu_si128((const __m128i*)key_init);
+        __m128i key23 = _mm_loadu_si128((const __m128i*)(key_init + 2));
+        for (int x = 0; x < row_bytes; x += 32) {
+            const uint8_t* src = row + x;
+            if (row_bytes - x < 32) {
+                memset(pad, 0, sizeof(pad));
+                memcpy(pad, src, row_bytes - x);
+                src = pad;
+            }
+            __m128i d01 = _mm_loadu_si128((const __m128i*)src);
+            __m128i d23 = _mm_loadu_si128((const __m128i*)(src + 16));
+            __m128i k01 = _mm_xor_si128(d01, key01);
+            __m128i k23 = _mm_xor_si128(d23, key23);
+            acc01 = _mm_add_epi64(acc01, _mm_mul_epu32(k01, _mm_srli_epi64(k01, 32)));
+            acc23 = _mm_add_epi64(acc23, _mm_mul_epu32(k23, _mm_srli_epi64(k23, 32)));
+            acc01 = _mm_add_epi64(acc01, _mm_shuffle_epi32(d01, _MM_SHUFFLE(1, 0, 3, 2)));
+            acc23 = _mm_add_epi64(acc23, _mm_shuffle_epi32(d23, _MM_SHUFFLE(1, 0, 3, 2)));
+            key01 = _mm_add_epi64(key01, step);
+            key23 = _mm_add_epi64(key23, step);
+        }
+        // acc = (acc ^ acc >> 47) * DEDUP_PRIME32, multiplied as two 32-bit halves
+        acc01 = _mm_xor_si128(acc01, _mm_srli_epi64(acc01, 47));
+        acc23 = _mm_xor_si128(acc23, _mm_srli_epi64(acc23, 47));
+        acc01 = _mm_add_epi64(_mm_mul_epu32(acc01, prime),
+                              _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(acc01, 32), prime), 32));
+        acc23 = _mm_add_epi64(_mm_mul_epu32(acc23, prime),
+                              _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(acc23, 32), prime), 32));
+    }
+    _mm_storeu_si128((__m128i*)acc, acc01);
+    _mm_storeu_si128((__m128i*)(acc + 2), acc23);
+#elif defined(NV12_MJPEG_NEON)
+    uint64x2_t acc01 = vld1q_u64(acc);
+    uint64x2_t acc23 = vld1q_u64(acc + 2);
+    const uint64x2_t step = vdupq_n_u64(DEDUP_KEY_STEP);
+    const uint32x2_t prime = vdup_n_u32(DEDUP_PRIME32);
+    
+    for (int y = 0; y < rows; y += row_step) {
+        const uint8_t* row = p + (size_t)y * stride;
+        uint64x2_t key01 = vld1q_u64(key_init);
+        uint64x2_t key23 = vld1q_u64(key_init + 2);
+        for (int x = 0; x < row_bytes; x += 32) {
+            const uint8_t* src = row + x;
+            if (row_bytes - x < 32) {
+                memset(pad, 0, sizeof(pad));
+                memcpy(pad, src, row_bytes - x);
+                src = pad;
+            }
+            uint64x2_t d01 = vreinterpretq_u64_u8(vld1q_u8(src));
+            uint64x2_t d23 = vreinterpretq_u64_u8(vld1q_u8(src + 16));
+            uint64x2_t k01 = veorq_u64(d01, key01);
+            uint64x2_t k23 = veorq_u64(d23, key23);
+            acc01 = vaddq_u64(acc01, vmull_u32(vmovn_u64(k01), vshrn_n_u64(k01, 32)));
+            acc23 = vaddq_u64(acc23, vmull_u32(vmovn_u64(k23), vshrn_n_u64(k23, 32)));
+            acc01 = vaddq_u64(acc01, vextq_u64(d01, d01, 1));
+            acc23 = vaddq_u64(acc23, vextq_u64(d23, d23, 1));
+            key01 = vaddq_u64(key01, step);
+            key23 = vaddq_u64(key23, step);
+        }
+        acc01 = veorq_u64(acc01, vshrq_n_u64(acc01, 47));
+        acc23 = veorq_u64(acc23, vshrq_n_u64(acc23, 47));
+        acc01 = vaddq_u64(vmull_u32(vmovn_u64(acc01), prime), vshlq_n_u64(vmull_u32(vshrn_n_u64(acc01, 32), prime), 32));
+        acc23 = vaddq_u64(vmull_u32(vmovn_u64(acc23), prime), vshlq_n_u64(vmull_u32(vshrn_n_u64(acc23, 32), prime), 32));
+    }
+    vst1q_u64(acc, acc01);
+    vst1q_u64(acc + 2, acc23);
+#else
+    for (int y = 0; y < rows; y += row_step) {
+        const uint8_t* row = p + (size_t)y * stride;
+        uint64_t key[4] = {key_init[0], key_init[1], key_init[2], key_init[3]};
+        for (int x = 0; x < row_bytes; x += 32) {
+            uint64_t d[4];
+            if (row_bytes - x < 32) {
+                memset(pad, 0, sizeof(pad));
+                memcpy(pad, row + x, row_bytes - x);
+                memcpy(d, pad, sizeof(d));
+            } else {
+                memcpy(d, row + x, sizeof(d));
+            }
+            for (int i = 0; i < 4; i++) {
+                uint64_t k = d[i] ^ key[i];
+                acc[i] += (k & 0xFFFFFFFFULL) * (k >> 32);
+                acc[i ^ 1] += d[i];
+                key[i] += DEDUP_KEY_STEP;
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            acc[i] = (acc[i] ^ (acc[i] >> 47)) * DEDUP_PRIME32;
+        }
+    }
+#endif
+}
+
+// Hash every row_step-th row of a plane
+static uint64_t dedup_hash_plane(uint64_t seed, const uint8_t* p, int stride, int row_bytes, int rows, int row_step) {
+    uint64_t acc[4] = {seed + DEDUP_PRIME1, seed ^ DEDUP_PRIME2, seed, seed - DEDUP_PRIME1};
+    
+    dedup_hash_rows(acc, p, stride, row_bytes, rows, row_step);
+    
+    uint64_t h = seed;
+    for (int i = 0; i < 4; i++) {
+        h = dedup_round(h, acc[i]);
+    }
+    h ^= h >> 33;
+    h *= DEDUP_PRIME2;
+    return h ^ (h >> 29);
+}
+
+// Sum of a 16-byte wide luma column of rows rows
+static inline unsigned dedup_sum_y16(const uint8_t* p, int stride, int rows) {
+#if defined(NV12_MJPEG_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (int y = 0; y < rows; y++) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + (size_t)y * stride)), zero));
+    }
+    return (unsigned)(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#elif defined(NV12_MJPEG_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (int y = 0; y < rows; y++) {
+        acc = vpadalq_u8(acc, vld1q_u8(p + (size_t)y * stride));
+    }
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(acc));
+    return (unsigned)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#else
+    unsigned sum = 0;
+    for (int y = 0; y < rows; y++) {
+        for (int k = 0; k < 16; k++) {
+            sum += p[(size_t)y * stride + k];
+        }
+    }
+    return sum;
+#endif
+}
+
+// U and V sums of a 16-byte wide interleaved chroma column (8 samples each per row)
+static inline void dedup_sum_uv16(const uint8_t* p, int stride, int rows, unsigned* sum_u, unsigned* sum_v) {
+#if defined(NV12_MJPEG_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i even = _mm_set1_epi16(0x00FF);
+    __m128i acc_u = zero;
+    __m128i acc_v = zero;
+    for (int y = 0; y < rows; y++) {
+        __m128i uv = _mm_loadu_si128((const __m128i*)(p + (size_t)y * stride));
+        acc_u = _mm_add_epi64(acc_u, _mm_sad_epu8(_mm_and_si128(uv, even), zero));
+        acc_v = _mm_add_epi64(acc_v, _mm_sad_epu8(_mm_srli_epi16(uv, 8), zero));
+    }
+    *sum_u = (unsigned)(_mm_cvtsi128_si32(acc_u) + _mm_cvtsi128_si32(_mm_srli_si128(acc_u, 8)));
+    *sum_v = (unsigned)(_mm_cvtsi128_si32(acc_v) + _mm_cvtsi128_si32(_mm_srli_si128(acc_v, 8)));
+#elif defined(NV12_MJPEG_NEON)
+    uint16x4_t acc_u = vdup_n_u16(0);
+    uint16x4_t acc_v = vdup_n_u16(0);
+    for (int y = 0; y < rows; y++) {
+        uint8x8x2_t uv = vld2_u8(p + (size_t)y * stride);
+        acc_u = vpadal_u8(acc_u, uv.val[0]);
+        acc_v = vpadal_u8(acc_v, uv.val[1]);
+    }
+    *sum_u = (unsigned)vget_lane_u64(vpaddl_u32(vpaddl_u16(acc_u)), 0);
+    *sum_v = (unsigned)vget_lane_u64(vpaddl_u32(vpaddl_u16(acc_v)), 0);
+#else
+    unsigned u = 0;
+    unsigned v = 0;
+    for (int y = 0; y < rows; y++) {
+        for (int k = 0; k < 16; k += 2) {
+            u += p[(size_t)y * stride + k];
+            v += p[(size_t)y * stride + k + 1];
+        }
+    }
+    *sum_u = u;
+    *sum_v = v;
+#endif
+}
+
+// Y, U and V sums of each macroblock (16x16 luma, 8x8 chroma), 3 entries per macroblock
+static void dedup_block_sums(const NV12FrameDesc* frame, uint16_t* sums) {
+    int mb_cols = (frame->width + 15) / 16;
+    int mb_rows = (frame->height + 15) / 16;
+    
+    #pragma omp parallel for if(mb_rows > 30)
+    for (int mb_y = 0; mb_y < mb_rows; mb_y++) {
+        uint16_t* out = sums + (size_t)mb_y * mb_cols * 3;
+        int y_start = mb_y * 16;
+        int y_end = y_start + 16 < frame->height ? y_start + 16 : frame->height;
+        int uv_start = mb_y * 8;
+        int uv_end = (y_end + 1) / 2;
+        int uv_bytes = frame->width + (frame->width & 1);
+        const uint8_t* y_rows = frame->y + (size_t)y_start * frame->y_stride;
+        const uint8_t* uv_rows = frame->uv + (size_t)uv_start * frame->uv_stride;
+        
+        // Whole 16-byte block columns in SIMD; the partial last block is summed bytewise
+        int bx = 0;
+        for (; bx * 16 + 16 <= frame->width; bx++) {
+            out[bx * 3] = (uint16_t)dedup_sum_y16(y_rows + bx * 16, frame->y_stride, y_end - y_start);
+        }
+        if (bx < mb_cols) {
+            unsigned sum = 0;
+            for (int y = y_start; y < y_end; y++) {
+                const uint8_t* row = frame->y + (size_t)y * frame->y_stride;
+                for (int x = bx * 16; x < frame->width; x++) {
+                    sum += row[x];
+                }
+            }
+            out[bx * 3] = (uint16_t)sum;
+        }
+        
+        bx = 0;
+        for (; bx * 16 + 16 <= uv_bytes; bx++) {
+            unsigned sum_u, sum_v;
+            dedup_sum_uv16(uv_rows + bx * 16, frame->uv_stride, uv_end - uv_start, &sum_u, &sum_v);
+            out[bx * 3 + 1] = (uint16_t)sum_u;
+            out[bx * 3 + 2] = (uint16_t)sum_v;
+        }
+        if (bx < mb_cols) {
+            unsigned sum_u = 0;
+            unsigned sum_v = 0;
+            for (int y = uv_start; y < uv_end; y++) {
+                const uint8_t* row = frame->uv + (size_t)y * frame->uv_stride;
+                for (int x = bx * 16; x < uv_bytes; x += 2) {
+                    sum_u += row[x];
+                    sum_v += row[x + 1];
+                }
+            }
+            out[bx * 3 + 1] = (uint16_t)sum_u;
+            out[bx * 3 + 2] = (uint16_t)sum_v;
+        }
+    }
+}
+
+// Measure the incoming frame. Returns 1 if it matches the last encoded frame,
+// 0 if it must be encoded (its signature is then kept by encoder_dedup_store()).
+static int encoder_dedup_check(NV12MJPEGEncoder* encoder, const NV12FrameDesc* frame) {
+    uint64_t t_start = get_time_ns();
+    int match = 0;
+    
+    if (encoder->dedup == NV12_MJPEG_DEDUP_THRESHOLD) {
+        size_t count = (size_t)((encoder->width + 15) / 16) * ((encoder->height + 15) / 16) * 3;
+        dedup_block_sums(frame, encoder->dedup_sums_next);
+        
+        // Block sums scale the level threshold by 256 (luma) and 64 (chroma) samples
+        match = encoder->dedup_valid;
+        for (size_t i = 0; match && i < count; i++) {
+            int limit = encoder->dedup_threshold * (i % 3 == 0 ? 256 : 64);
+            match = abs((int)encoder->dedup_sums_next[i] - (int)encoder->dedup_sums[i]) <= limit;
+        }
+    } else {
+        int row_step = encoder->dedup == NV12_MJPEG_DEDUP_SAMPLED ? DEDUP_SAMPLE_ROWS : 1;
+        uint64_t hash = dedup_hash_plane(0, frame->y, frame->y_stride, frame->width, frame->height, row_step);
+        hash = dedup_hash_plane(hash, frame->uv, frame->uv_stride, frame->width + (frame->width & 1),
+                                (frame->height + 1) / 2, row_step);
+        match = encoder->dedup_valid && hash == encoder->dedup_hash;
+        encoder->dedup_hash_next = hash;
+    }
+    
+    uint64_t t_end = get_time_ns();
+    encoder->stats.last_hash_ms = (t_end - t_start) / 1000000.0;
+    encoder->stats.total_hash_ms += encoder->stats.last_hash_ms;
+    return match;
+}
+
+// Keep the output of a frame that was encoded after encoder_dedup_check()
+static void encoder_dedup_store(NV12MJPEGEncoder* encoder, const uint8_t* data, size_t size) {
+    encoder->dedup_valid = 0;
+    if (size > encoder->dedup_output_capacity) {
+        uint8_t* output = (uint8_t*)realloc(encoder->dedup_output, size);
+        if (!output) {
+            return;
+        }
+        encoder->dedup_output = output;
+        encoder->dedup_output_capacity = size;
+    }
+    memcpy(encoder->dedup_output, data, size);
+    encoder->dedup_output_size = size;
+    encoder->dedup_hash = encoder->dedup_hash_next;
+    if (encoder->dedup == NV12_MJPEG_DEDUP_THRESHOLD) {
+        // The reference only moves when a frame is encoded, so slow drift still triggers an encode
+        uint16_t* sums = encoder->dedup_sums;
+        encoder->dedup_sums = encoder->dedup_sums_next;
+        encoder->dedup_sums_next = sums;
+    }
+    encoder->dedup_valid = 1;
+}
+
+int encoder_set_dedup(NV12MJPEGEncoder* encoder, NV12MJPEGDedup mode, int threshold) {
+    if (!encoder || mode < NV12_MJPEG_DEDUP_OFF || mode > NV12_MJPEG_DEDUP_THRESHOLD ||
+        (mode == NV12_MJPEG_DEDUP_THRESHOLD && (threshold < 0 || threshold > 255))) {
+        return -EINVAL;
+    }
+    
+    if (mode == NV12_MJPEG_DEDUP_THRESHOLD && !encoder->dedup_sums) {
+        size_t count = (size_t)((encoder->width + 15) / 16) * ((encoder->height + 15) / 16) * 3;
+        encoder->dedup_sums = (uint16_t*)malloc(count * sizeof(uint16_t));
+        encoder->dedup_sums_next = (uint16_t*)malloc(count * sizeof(uint16_t));
+        if (!encoder->dedup_sums || !encoder->dedup_sums_next) {
+            fprintf(stderr, "Failed to allocate deduplication block sums\n");
+            free(encoder->dedup_sums);
+            free(encoder->dedup_sums_next);
+            encoder->dedup_sums = NULL;
+            encoder->dedup_sums_next = NULL;
+            return -ENOMEM;
+        }
+    }
+    encoder->dedup = mode;
+    encoder->dedup_threshold = threshold;
+    encoder->dedup_valid = 0;
+    return 0;
+}
+
+// ============================================================================
+// Motion Gating
+// ============================================================================
+
+// SAD of 16 luma bytes against the reference; the bytes are also copied into
+// the next reference, so the detector reads the input only once
+static inline unsigned motion_sad16_copy(const uint8_t* src, const uint8_t* ref, uint8_t* next) {
+#if defined(NV12_MJPEG_SSE2)
+    __m128i s = _mm_loadu_si128((const __m128i*)src);
+    __m128i sad = _mm_sad_epu8(s, _mm_loadu_si128((const __m128i*)ref));
+    _mm_storeu_si128((__m128i*)next, s);
+    return (unsigned)(_mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4));
+#elif defined(NV12_MJPEG_NEON)
+    uint8x16_t s = vld1q_u8(src);
+    uint64x2_t sad = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(s, vld1q_u8(ref)))));
+    vst1q_u8(next, s);
+    return (unsigned)(vgetq_lane_u64(sad, 0) + vgetq_lane_u64(sad, 1));
+#else
+    unsigned sad = 0;
+    for (int k = 0; k < 16; k++) {
+        sad += abs(src[k] - ref[k]);
+        next[k] = src[k];
+    }
+    return sad;
+#endif
+}
+
+// Per-macroblock luma SAD against the reference (none for the first frame),
+// copying the luma into motion_next and, when dst is set, into the codec frame
+// on the way, so the input luma is read from memory once. Returns the number
+// of changed blocks.
+static int encoder_motion_detect(NV12MJPEGEncoder* encoder, const NV12FrameDesc* frame,
+                                 uint8_t* dst, int dst_stride, unsigned* max_sad) {
+    int width = encoder->width;
+    int mb_cols = (width + 15) / 16;
+    int mb_rows = (encoder->height + 15) / 16;
+    int changed = 0;
+    unsigned max = 0;
+    
+    #pragma omp parallel for reduction(+:changed) reduction(max:max) if(mb_rows > 30)
+    for (int mb_y = 0; mb_y < mb_rows; mb_y++) {
+        uint32_t* sads = encoder->motion_sads + (size_t)mb_y * mb_cols;
+        int y_end = mb_y * 16 + 16 < encoder->height ? mb_y * 16 + 16 : encoder->height;
+        memset(sads, 0, (size_t)mb_cols * sizeof(uint32_t));
+        for (int y = mb_y * 16; y < y_end; y++) {
+            const uint8_t* src = frame->y + (size_t)y * frame->y_stride;
+            const uint8_t* ref = encoder->motion_ref + (size_t)y * width;
+            uint8_t* next = encoder->motion_next + (size_t)y * width;
+            if (encoder->motion_ref_valid) {
+                int x = 0;
+                for (; x + 16 <= width; x += 16) {
+                    sads[x >> 4] += motion_sad16_copy(src + x, ref + x, next + x);
+                }
+                for (; x < width; x++) {
+                    sads[x >> 4] += abs(src[x] - ref[x]);
+                    next[x] = src[x];
+                }
+            } else {
+                memcpy(next, src, width);
+            }
+            if (dst) {
+                // The row was just written, so this copy is served from cache
+                memcpy(dst + (size_t)y * dst_stride, next, width);
+            }
+        }
+        for (int bx = 0; bx < mb_cols; bx++) {
+            changed += sads[bx] >= (uint32_t)encoder->motion.block_sad;
+            max = sads[bx] > max ? sads[bx] : max;
+        }
+    }
+    
+    *max_sad = max;
+    return changed;
+}
+
+// Score the incoming frame. Returns 1 if it is below the changed-block fraction
+// (gated), 0 if it has enough motion or there is no reference yet.
+static int encoder_motion_check(NV12MJPEGEncoder* encoder, const NV12FrameDesc* frame) {
+    int blocks = ((encoder->width + 15) / 16) * ((encoder->height + 15) / 16);
+    unsigned max_sad = 0;
+    uint8_t* dst = NULL;
+    int dst_stride = 0;
+    uint64_t t_start = get_time_ns();
+    
+    // Codec backends copy the luma into their frame anyway: do it in the same pass.
+    // Native and TurboJPEG read the caller's planes in place.
+    if (!encoder_codecless(encoder) && av_frame_make_writable(encoder->frame) >= 0) {
+        dst = encoder->frame->data[0];
+        dst_stride = encoder->frame->linesize[0];
+    }
+    int changed = encoder_motion_detect(encoder, frame, dst, dst_stride, &max_sad);
+    uint64_t t_end = get_time_ns();
+    encoder->motion_luma_copied = dst != NULL;
+    
+    if (!encoder->motion_ref_valid) {
+        // First frame: nothing to compare against, only its luma was taken
+        encoder->stats.last_motion_score = 1.0;
+        encoder->stats.last_motion_max_sad = 0;
+        return 0;
+    }
+    
+    encoder->stats.last_motion_score = (double)changed / blocks;
+    encoder->stats.last_motion_max_sad = max_sad;
+    ENCODER_LOG(encoder, "[Perf] Motion detect: %.3f ms (%d/%d blocks changed, max SAD %u)\n",
+            (t_end - t_start) / 1000000.0, changed, blocks, max_sad);
+    return encoder->stats.last_motion_score < encoder->motion.min_changed;
+}
+
+// The frame checked last was encoded: its luma becomes the reference
+static void encoder_motion_commit(NV12MJPEGEncoder* encoder) {
+    uint8_t* ref = encoder->motion_ref;
+    encoder->motion_ref = encoder->motion_next;
+    encoder->motion_next = ref;
+    encoder->motion_ref_valid = 1;
+}
+
+int encoder_set_motion_gate(NV12MJPEGEncoder* encoder, const NV12MJPEGMotionGate* gate) {
+    if (!encoder) {
+        return -EINVAL;
+    }
+    if (!gate) {
+        encoder->motion_enabled = 0;
+        return 0;
+    }
+    if (gate->block_sad < 0 || gate->min_changed < 0.0 || gate->min_changed > 1.0 ||
+        (gate->action != NV12_MJPEG_MOTION_SKIP && gate->action != NV12_MJPEG_MOTION_REDUCE) ||
+        (gate->action == NV12_MJPEG_MOTION_REDUCE && (gate->reduced_quality < 1 || gate->reduced_quality > 99))) {
+        return -EINVAL;
+    }
+    if (gate->action == NV12_MJPEG_MOTION_REDUCE && encoder_quality_fixed(encoder)) {
+        fprintf(stderr, "Reduced-quality motion gating is not supported by mjpeg_rkmpp (no per-frame QP)\n");
+        return -ENOTSUP;
+    }
+    
+    if (!encoder->motion_ref) {
+        size_t luma_size = (size_t)encoder->width * encoder->height;
+        size_t blocks = (size_t)((encoder->width + 15) / 16) * ((encoder->height + 15) / 16);
+        encoder->motion_ref = (uint8_t*)malloc(luma_size);
+        encoder->motion_next = (uint8_t*)malloc(luma_size);
+        encoder->motion_sads = (uint32_t*)malloc(blocks * sizeof(uint32_t));
+        if (!encoder->motion_ref || !encoder->motion_next || !encoder->motion_sads) {
+            fprintf(stderr, "Failed to allocate motion reference\n");
+            free(encoder->motion_ref);
+            free(encoder->motion_next);
+            free(encoder->motion_sads);
+            encoder->motion_ref = NULL;
+            encoder->motion_next = NULL;
+            encoder->motion_sads = NULL;
+            return -ENOMEM;
+        }
+    }
+    // Frames encoded while gating was off are not in the reference
+    if (!encoder->motion_enabled) {
+        encoder->motion_ref_valid = 0;
+    }
+    encoder->motion = *gate;
+    encoder->motion_enabled = 1;
+    return 0;
+}
+
+// ============================================================================
+// Synchronous Encoding
+// ============================================================================
+
+// Box-downscale luma rows [row_begin, row_end) and their chroma rows into the
+// thumbnail planes. row_begin must be a multiple of 2 << thumb_shift so that
+// bands never share a thumbnail row (bands may run concurrently).
+static void downscale_nv12_band(void* opaque, const uint8_t* src_y, int y_stride,
+                                const uint8_t* src_uv, int uv_stride, int row_begin, int row_end) {
+    NV12MJPEGEncoder* encoder = (NV12MJPEGEncoder*)opaque;
+    int shift = encoder->thumb_shift;
+    int n = 1 << shift;
+    int tw = encoder->thumb_width;
+    int th = encoder->thumb_height;
+    uint8_t* dst_y = encoder->thumb_nv12;
+    uint8_t* dst_uv = dst_y + (size_t)tw * th;
+    
+    for (int ty = row_begin >> shift; ty < (row_end >> shift) && ty < th; ty++) {
+        const uint8_t* s = src_y + (size_t)(ty << shift) * y_stride;
+        uint8_t* d = dst_y + (size_t)ty * tw;
+        for (int tx = 0; tx < tw; tx++) {
+            const uint8_t* p = s + (tx << shift);
+            unsigned int sum = 0;
+            for (int j = 0; j < n; j++) {
+                for (int i = 0; i < n; i++) {
+                    sum += p[(size_t)j * y_stride + i];
+                }
+            }
+            d[tx] = (uint8_t)((sum + (n * n / 2)) >> (2 * shift));
+        }
+    }
+    
+    for (int ty = (row_begin / 2) >> shift; ty < ((row_end / 2) >> shift) && ty < th / 2; ty++) {
+        const uint8_t* s = src_uv + (size_t)(ty << shift) * uv_stride;
+        uint8_t* d = dst_uv + (size_t)ty * tw;
+        for (int tx = 0; tx < tw / 2; tx++) {
+            const uint8_t* p = s + (tx << shift) * 2;
+            unsigned int sum_u = 0, sum_v = 0;
+            for (int j = 0; j < n; j++) {
+                for (int i = 0; i < n; i++) {
+                    sum_u += p[(size_t)j * uv_stride + 2 * i];
+                    sum_v += p[(size_t)j * uv_stride + 2 * i + 1];
+                }
+            }
+            d[2 * tx] = (uint8_t)((sum_u + (n * n / 2)) >> (2 * shift));
+            d[2 * tx + 1] = (uint8_t)((sum_v + (n * n / 2)) >> (2 * shift));
+        }
+    }
+}
+
+// Copy NV12 planes into the encoder frame in bands of 16 rows, downscaling
+// each band while it is in cache, so the input is read from memory once
+static void encoder_copy_with_thumbnail(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride,
+                                        const uint8_t* src_uv, int uv_stride) {
+    AVFrame* frame = encoder->frame;
+    int width = encoder->width;
+    int bands = (encoder->height + 15) / 16;
+    
+    #pragma omp parallel for if(encoder->height > 480)
+    for (int b = 0; b < bands; b++) {
+        int row_begin = b * 16;
+        int row_end = row_begin + 16 < encoder->height ? row_begin + 16 : encoder->height;
+        int crow_begin = row_begin / 2;
+        int crows = row_end / 2 - crow_begin;
+        
+        for (int y = row_begin; y < row_end && !encoder->motion_luma_copied; y++) {
+            memcpy(frame->data[0] + (size_t)y * frame->linesize[0], src_y + (size_t)y * y_stride, width);
+        }
+        if (encoder->pix_fmt == AV_PIX_FMT_NV12) {
+            for (int y = crow_begin; y < crow_begin + crows; y++) {
+                memcpy(frame->data[1] + (size_t)y * frame->linesize[1], src_uv + (size_t)y * uv_stride, width);
+            }
+        } else {
+            split_uv_plane(src_uv + (size_t)crow_begin * uv_stride, uv_stride,
+                           frame->data[1] + (size_t)crow_begin * frame->linesize[1], frame->linesize[1],
+                           frame->data[2] + (size_t)crow_begin * frame->linesize[2], frame->linesize[2],
+                           width / 2, crows);
+        }
+        downscale_nv12_band(encoder, src_y, y_stride, src_uv, uv_stride, row_begin, row_end);
+    }
+}
+
+// Copy NV12 planes into the encoder frame and send it to the codec
+static int encoder_send_nv12(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride,
+                             const uint8_t* src_uv, int uv_stride) {
+    int ret;
+    uint64_t t_start, t_end;
+    
+    // Make frame writable (in case it was used before)
+    t_start = get_time_ns();
+    ret = av_frame_make_writable(encoder->frame);
+    t_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] av_frame_make_writable: %.3f ms\n", (t_end - t_start) / 1000000.0);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to make frame writable: %s\n", av_err2str(ret));
+        return ret;
+    }
+    
+    // Print encoder configuration and buffer info
+    ENCODER_LOG(encoder, "[Encoder] Quality: QP=%d, Resolution: %dx%d\n", 
+            encoder->quality, encoder->width, encoder->height);
+    ENCODER_LOG(encoder, "[Encoder] Y linesize: %d (width: %d, padding: %d bytes)\n",
+            encoder->frame->linesize[0], encoder->width, 
+            encoder->frame->linesize[0] - encoder->width);
+    ENCODER_LOG(encoder, "[Encoder] UV linesize: %d (width: %d, padding: %d bytes)\n",
+            encoder->frame->linesize[1], encoder->width,
+            encoder->frame->linesize[1] - encoder->width);
+    
+    if (encoder->thumb_shift) {
+        // Multi-output encode: copy and downscale in one pass over the input
+        t_start = get_time_ns();
+        encoder_copy_with_thumbnail(encoder, src_y, y_stride, src_uv, uv_stride);
+        t_end = get_time_ns();
+        ENCODER_LOG(encoder, "[Perf] NV12 copy + 1/%d thumbnail: %.3f ms\n",
+                1 << encoder->thumb_shift, (t_end - t_start) / 1000000.0);
+    } else if (encoder->motion_luma_copied) {
+        // Y plane already copied by the motion check; only UV is left
+        if (encoder->pix_fmt == AV_PIX_FMT_NV12) {
+            copy_plane(encoder->frame->data[1], encoder->frame->linesize[1], src_uv, uv_stride,
+                       encoder->width, encoder->height / 2);
+        } else {
+            split_uv_plane(src_uv, uv_stride,
+                           encoder->frame->data[1], encoder->frame->linesize[1],
+                           encoder->frame->data[2], encoder->frame->linesize[2],
+                           encoder->width / 2, encoder->height / 2);
+        }
+    } else {
+        // Copy NV12 data to frame using bulk copy
+        // Y plane
+        ENCODER_LOG(encoder, "[Encoder] Y plane: bulk copy %d bytes (linesize=%d, width=%d)\n", 
+                encoder->width * encoder->height, encoder->frame->linesize[0], encoder->width);
+        t_start = get_time_ns();
+        copy_plane(encoder->frame->data[0], encoder->frame->linesize[0], src_y, y_stride,
+                   encoder->width, encoder->height);
+        t_end = get_time_ns();
+        ENCODER_LOG(encoder, "[Perf] Y plane memcpy: %.3f ms (%.2f GB/s)\n", 
+                (t_end - t_start) / 1000000.0,
+                (encoder->width * encoder->height) / ((t_end - t_start) / 1e9) / 1e9);
+        
+        // UV plane (deinterleaved into U and V for planar backends)
+        ENCODER_LOG(encoder, "[Encoder] UV plane: bulk copy %d bytes (linesize=%d, width=%d)\n",
+                encoder->width * encoder->height / 2, encoder->frame->linesize[1], encoder->width);
+        t_start = get_time_ns();
+        if (encoder->pix_fmt == AV_PIX_FMT_NV12) {
+            copy_plane(encoder->frame->data[1], encoder->frame->linesize[1], src_uv, uv_stride,
+                       encoder->width, encoder->height / 2);
+        } else {
+            split_uv_plane(src_uv, uv_stride,
+                           encoder->frame->data[1], encoder->frame->linesize[1],
+                           encoder->frame->data[2], encoder->frame->linesize[2],
+                           encoder->width / 2, encoder->height / 2);
+        }
+        t_end = get_time_ns();
+        ENCODER_LOG(encoder, "[Perf] UV plane memcpy: %.3f ms (%.2f GB/s)\n",
+                (t_end - t_start) / 1000000.0,
+                (encoder->width * encoder->height / 2) / ((t_end - t_start) / 1e9) / 1e9);
+    }
+    
+    // A retry (rate control, failover) copies the whole frame again
+    encoder->motion_luma_copied = 0;
+    
+    // Update PTS
+    encoder->frame->pts = encoder->frame_counter++;
+    
+    // Set frame quality for MJPEG encoding
+    encoder_set_frame_qscale(encoder, encoder->frame);
+    
+    // Send frame to encoder
+    t_start = get_time_ns();
+    if (encoder->fault_pending > 0) {
+        // Injected failure: behaves like an MPP timeout on this context
+        encoder->fault_pending--;
+        ret = AVERROR(ETIMEDOUT);
+    } else {
+        ret = avcodec_send_frame(encoder->codec_ctx, encoder->frame);
+    }
+    t_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] avcodec_send_frame: %.3f ms\n", (t_end - t_start) / 1000000.0);
+    if (ret < 0) {
+        fprintf(stderr, "Error sending frame to encoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    encoder_sim_push(encoder, t_start);
+    
+    return 0;
+}
+
+// Send a frame and receive its packet. A codec failure switches to the hot
+// spare and retries the frame once at the same quality.
+static int encoder_codec_encode(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride,
+                                const uint8_t* src_uv, int uv_stride) {
+    int ret = encoder_send_nv12(encoder, src_y, y_stride, src_uv, uv_stride);
+    if (ret == 0) {
+        ret = encoder_receive_packet(encoder);
+    }
+    if (ret >= 0) {
+        return ret;
+    }
+    
+    uint64_t t_fail = get_time_ns();
+    int quality = encoder->stats.last_quality;
+    if (encoder_failover(encoder, ret) < 0) {
+        return ret;
+    }
+    encoder->next_quality = quality;
+    ret = encoder_send_nv12(encoder, src_y, y_stride, src_uv, uv_stride);
+    if (ret == 0) {
+        ret = encoder_receive_packet(encoder);
+    }
+    if (ret == 0) {
+        encoder->stats.last_failover_ms = (get_time_ns() - t_fail) / 1000000.0;
+        ENCODER_LOG(encoder, "[Perf] Failover + retry: %.3f ms\n", encoder->stats.last_failover_ms);
+    }
+    return ret;
+}
+
+int encoder_inject_fault(NV12MJPEGEncoder* encoder, int count) {
+    if (!encoder || count < 0) {
+        return -EINVAL;
+    }
+    if (encoder_codecless(encoder)) {
+        return -ENOTSUP;
+    }
+    encoder->fault_pending = count;
+    return 0;
+}
+
+int encoder_encode_to_buffer(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                              uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    NV12FrameDesc frame;
+    
+    if (!encoder || !nv12_data) {
+        return -EINVAL;
+    }
+    nv12_frame_desc_init(&frame, (uint8_t*)nv12_data, encoder->width, encoder->height);
+    return encoder_encode_frame(encoder, &frame, out_buffer, buffer_size, out_size);
+}
+
+int encoder_encode_frame(NV12MJPEGEncoder* encoder, const NV12FrameDesc* frame,
+                         uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    int ret;
+    uint64_t t_total_start;
+    
+    t_total_start = get_time_ns();
+    
+    // Validate parameters
+    if (!encoder || !nv12_frame_desc_valid(frame) || !out_buffer || !out_size) {
+        return -EINVAL;
+    }
+    if (frame->width != encoder->width || frame->height != encoder->height) {
+        fprintf(stderr, "Frame size %dx%d does not match encoder size %dx%d\n",
+                frame->width, frame->height, encoder->width, encoder->height);
+        return -EINVAL;
+    }
+    if (encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    if (buffer_size < encoder->slot_size) {
+        *out_size = encoder->slot_size;
+        fprintf(stderr, "Output buffer too small: need %zu bytes (slot), have %zu bytes\n",
+                encoder->slot_size, buffer_size);
+        return -ENOMEM;
+    }
+    
+    // Static scene: hand back the last output without running the encoder.
+    // A pending per-frame quality override always encodes.
+    int dedup = encoder->dedup != NV12_MJPEG_DEDUP_OFF && !encoder->next_quality;
+    if (dedup && encoder_dedup_check(encoder, frame)) {
+        *out_size = encoder->dedup_output_size;
+        if (buffer_size < encoder->dedup_output_size) {
+            fprintf(stderr, "Output buffer too small: need %zu bytes, have %zu bytes\n",
+                    encoder->dedup_output_size, buffer_size);
+            return -ENOMEM;
+        }
+        memcpy(out_buffer, encoder->dedup_output, encoder->dedup_output_size);
+        encoder->stats.dedup_hits++;
+        encoder->stats.last_encode_ms = (get_time_ns() - t_total_start) / 1000000.0;
+        ENCODER_LOG(encoder, "[Perf] Duplicate frame: %.3f ms (hash %.3f ms, %zu bytes reused)\n",
+                encoder->stats.last_encode_ms, encoder->stats.last_hash_ms, *out_size);
+        return 0;
+    }
+    
+    // Little motion since the last encoded frame: skip it or encode it cheaper.
+    // A pending per-frame quality override is never gated.
+    int motion = encoder->motion_enabled && !encoder->next_quality;
+    int gated = motion && encoder_motion_check(encoder, frame);
+    if (gated && encoder->motion.action == NV12_MJPEG_MOTION_SKIP) {
+        // Nothing to store or send; in slot mode the slot holds no JPEG
+        *out_size = 0;
+        if (encoder->slot_size) {
+            memset(out_buffer, 0, encoder->slot_size);
+            *out_size = encoder->slot_size;
+        }
+        encoder->stats.motion_skipped++;
+        encoder->motion_luma_copied = 0;
+        encoder->stats.last_encode_ms = (get_time_ns() - t_total_start) / 1000000.0;
+        return 0;
+    }
+    
+    // Planes are read in place (native) or copied once with their own strides
+    encoder_rc_begin(encoder, frame->y, frame->y_stride);
+    if (gated) {
+        // Rate control may already have picked a coarser quality
+        int rc_quality = encoder->next_quality ? encoder->next_quality : encoder->quality;
+        if (encoder_rc_step(encoder, encoder->motion.reduced_quality) > encoder_rc_step(encoder, rc_quality)) {
+            encoder->next_quality = encoder->motion.reduced_quality;
+            encoder->stats.motion_reduced++;
+        }
+    }
+    for (int pass = 0; ; pass++) {
+        *out_size = 0;
+        if (encoder_codecless(encoder)) {
+            ret = encoder_encode_native(encoder, frame->y, frame->y_stride, frame->uv, frame->uv_stride,
+                                        out_buffer, buffer_size, out_size);
+        } else {
+            ret = encoder_codec_encode(encoder, frame->y, frame->y_stride, frame->uv, frame->uv_stride);
+            if (ret == 0) {
+                ret = encoder_output_packet(encoder, out_buffer, buffer_size, out_size);
+            }
+        }
+        if (!encoder_rc_end(encoder, ret, *out_size, pass)) {
+            break;
+        }
+    }
+    encoder->motion_luma_copied = 0;
+    if (ret == -ENOMEM && encoder->slot_size) {
+        fprintf(stderr, "Frame does not fit its slot at quality %d (slot %zu bytes)\n",
+                encoder->stats.last_quality, encoder->slot_size);
+        return -ENOSPC;
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    
+    uint64_t t_total_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] === TOTAL encoding time: %.3f ms ===\n", 
+            (t_total_end - t_total_start) / 1000000.0);
+    if (!encoder_codecless(encoder)) {
+        encoder->stats.frames_encoded++;
+    }
+    encoder->stats.last_encode_ms = (t_total_end - t_total_start) / 1000000.0;
+    encoder->stats.last_compression_ratio = (double)encoder->width * encoder->height * 3 / 2 / *out_size;
+    
+    if (encoder->slot_size) {
+        ret = encoder_fill_slot(encoder, out_buffer, out_size);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (dedup) {
+        encoder_dedup_store(encoder, out_buffer, *out_size);
+    }
+    if (motion && !gated) {
+        // Reduced frames keep the last reference, so slow changes still add up
+        encoder_motion_commit(encoder);
+    }
+    return 0;
+}
+
+// Default release for zero-copy input when the caller owns the buffer lifetime
+static void zero_copy_release_noop(void* opaque, uint8_t* data) {
+    (void)opaque;
+    (void)data;
+}
+
+int encoder_encode_zero_copy(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                             nv12_buffer_release_fn release, void* opaque,
+                             uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    int ret;
+    uint64_t t_start, t_end, t_total_start;
+    
+    t_total_start = get_time_ns();
+    
+    // Validate parameters (buffer is not taken over on -EINVAL/-EBUSY)
+    if (!encoder || !nv12_data || !out_buffer || !out_size) {
+        return -EINVAL;
+    }
+    if (encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    
+    // Native and TurboJPEG encoders read the caller's buffer directly and are done with it on return
+    if (encoder_codecless(encoder)) {
+        ret = encoder_encode_native(encoder, nv12_data, encoder->width,
+                                        nv12_data + (size_t)encoder->width * encoder->height, encoder->width,
+                                        out_buffer, buffer_size, out_size);
+        if (release) {
+            release(opaque, (uint8_t*)nv12_data);
+        }
+        return ret;
+    }
+    
+    int width = encoder->width;
+    int height = encoder->height;
+    AVFrame* frame = encoder->wrap_frame;
+    
+    // Wrap the caller's buffer: the codec holds a reference for as long as it
+    // needs the pixels, and release() fires when the last reference is dropped
+    AVBufferRef* buf = av_buffer_create((uint8_t*)nv12_data, nv12_frame_size(width, height),
+                                        release ? release : zero_copy_release_noop, opaque,
+                                        AV_BUFFER_FLAG_READONLY);
+    if (!buf) {
+        fprintf(stderr, "Failed to wrap input buffer\n");
+        if (release) {
+            release(opaque, (uint8_t*)nv12_data);
+        }
+        return -ENOMEM;
+    }
+    
+    frame->format = encoder->pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    frame->buf[0] = buf;
+    frame->data[0] = (uint8_t*)nv12_data;
+    frame->linesize[0] = width;
+    
+    if (encoder->pix_fmt == AV_PIX_FMT_NV12) {
+        // Both planes live in the wrapped buffer
+        frame->data[1] = (uint8_t*)nv12_data + (size_t)width * height;
+        frame->linesize[1] = width;
+    } else {
+        // Planar backends: Y stays zero-copy, chroma has to be deinterleaved
+        frame->buf[1] = av_buffer_pool_get(encoder->chroma_pool);
+        frame->buf[2] = av_buffer_pool_get(encoder->chroma_pool);
+        if (!frame->buf[1] || !frame->buf[2]) {
+            fprintf(stderr, "Failed to get chroma buffers\n");
+            av_frame_unref(frame);
+            return -ENOMEM;
+        }
+        frame->data[1] = frame->buf[1]->data;
+        frame->data[2] = frame->buf[2]->data;
+        frame->linesize[1] = (width + 1) / 2;
+        frame->linesize[2] = (width + 1) / 2;
+        
+        t_start = get_time_ns();
+        split_uv_plane(nv12_data + (size_t)width * height, width,
+                       frame->data[1], frame->linesize[1], frame->data[2], frame->linesize[2],
+                       width / 2, height / 2);
+        t_end = get_time_ns();
+        ENCODER_LOG(encoder, "[Perf] UV deinterleave: %.3f ms\n", (t_end - t_start) / 1000000.0);
+    }
+    
+    frame->pts = encoder->frame_counter++;
+    encoder_set_frame_qscale(encoder, frame);
+    
+    // Send frame to encoder; it takes its own reference if it needs one
+    t_start = get_time_ns();
+    ret = avcodec_send_frame(encoder->codec_ctx, frame);
+    t_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] avcodec_send_frame (zero-copy): %.3f ms\n", (t_end - t_start) / 1000000.0);
+    av_frame_unref(frame);
+    if (ret < 0) {
+        fprintf(stderr, "Error sending frame to encoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    encoder_sim_push(encoder, t_start);
+    
+    ret = encoder_receive_packet(encoder);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    ret = encoder_output_packet(encoder, out_buffer, buffer_size, out_size);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    uint64_t t_total_end = get_time_ns();
+    ENCODER_LOG(encoder, "[Perf] === TOTAL encoding time (zero-copy): %.3f ms ===\n", 
+            (t_total_end - t_total_start) / 1000000.0);
+    encoder->stats.frames_encoded++;
+    encoder->stats.last_encode_ms = (t_total_end - t_total_start) / 1000000.0;
+    
+    return 0;
+}
+
+// ============================================================================
+// Asynchronous Submit/Poll
+// ============================================================================
+
+// Copy NV12 input into an encoder frame without logging (throughput paths)
+static void encoder_fill_frame(const NV12MJPEGEncoder* encoder, AVFrame* frame, const uint8_t* nv12_data) {
+    int width = encoder->width;
+    int height = encoder->height;
+    const uint8_t* src_uv = nv12_data + (size_t)width * height;
+    
+    copy_plane(frame->data[0], frame->linesize[0], nv12_data, width, width, height);
+    if (encoder->pix_fmt == AV_PIX_FMT_NV12) {
+        copy_plane(frame->data[1], frame->linesize[1], src_uv, width, width, height / 2);
+    } else {
+        split_uv_plane(src_uv, width, frame->data[1], frame->linesize[1],
+                       frame->data[2], frame->linesize[2], width / 2, height / 2);
+    }
+}
+
+// Allocate input slots and the packet FIFO on first use
+static int encoder_async_init(NV12MJPEGEncoder* encoder) {
+    int depth = encoder->queue_depth;
+    
+    encoder->async_frames = (AVFrame**)calloc(depth, sizeof(AVFrame*));
+    encoder->async_ready = (AVPacket**)calloc(depth, sizeof(AVPacket*));
+    encoder->async_user_data = (void**)calloc(depth, sizeof(void*));
+    if (!encoder->async_frames || !encoder->async_ready || !encoder->async_user_data) {
+        return -ENOMEM;
+    }
+    
+    for (int i = 0; i < depth; i++) {
+        encoder->async_ready[i] = av_packet_alloc();
+        if (!encoder->async_ready[i]) {
+            return -ENOMEM;
+        }
+        if (encoder_codecless(encoder)) {
+            // Native/TurboJPEG encodes read the caller's buffer; only output packets are queued
+            continue;
+        }
+        AVFrame* frame = av_frame_alloc();
+        encoder->async_frames[i] = frame;
+        if (!frame) {
+            return -ENOMEM;
+        }
+        frame->format = encoder->pix_fmt;
+        frame->width = encoder->width;
+        frame->height = encoder->height;
+        int ret = av_frame_get_buffer(frame, 0);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    
+    return 0;
+}
+
+// Hand the oldest frame in flight back to the caller
+static void* encoder_async_pop_user_data(NV12MJPEGEncoder* encoder) {
+    void* user_data = encoder->async_user_data[encoder->async_user_head];
+    encoder->async_user_head = (encoder->async_user_head + 1) % encoder->queue_depth;
+    encoder->async_in_flight--;
+    return user_data;
+}
+
+// Move every packet the codec has finished into the FIFO (or the callback).
+// Never sends a flush frame, so the session stays open.
+// Returns the number of packets collected, or a negative error code.
+static int encoder_async_collect(NV12MJPEGEncoder* encoder) {
+    int collected = 0;
+    
+    while (encoder->async_ready_count < encoder->async_in_flight) {
+        int tail = (encoder->async_ready_head + encoder->async_ready_count) % encoder->queue_depth;
+        AVPacket* pkt = encoder->async_ready[tail];
+        
+        int ret = encoder_codec_receive(encoder, pkt, 0);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "Error receiving packet from encoder: %s\n", av_err2str(ret));
+            return ret;
+        }
+        collected++;
+        encoder->stats.frames_encoded++;
+        if (encoder->abbreviated) {
+            encoder_abbreviate_packet(encoder, pkt);
+        }
+        
+        if (encoder->completion_cb) {
+            void* user_data = encoder_async_pop_user_data(encoder);
+            encoder->completion_cb(encoder->completion_opaque, user_data, 0, pkt->data, pkt->size);
+            av_packet_unref(pkt);
+        } else {
+            encoder->async_ready_count++;
+        }
+    }
+    
+    return collected;
+}
+
+// Record a sent frame as in flight
+static void encoder_async_push_user_data(NV12MJPEGEncoder* encoder, void* user_data) {
+    int tail = (encoder->async_user_head + encoder->async_in_flight) % encoder->queue_depth;
+    encoder->async_user_data[tail] = user_data;
+    encoder->async_in_flight++;
+}
+
+// Native backend: encode synchronously into a pooled packet and queue it as
+// already received, so poll/callback/drain behave exactly as for a codec
+static int encoder_async_send_native(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, void* user_data) {
+    AVBufferRef* buf = NULL;
+    size_t size = 0;
+    
+    int ret = encoder_native_encode_to_ref(encoder, nv12_data, &buf, &size, NULL);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    int tail = (encoder->async_ready_head + encoder->async_ready_count) % encoder->queue_depth;
+    AVPacket* pkt = encoder->async_ready[tail];
+    pkt->buf = buf;
+    pkt->data = buf->data;
+    pkt->size = (int)size;
+    pkt->pts = encoder->frame_counter - 1;
+    encoder_async_push_user_data(encoder, user_data);
+    
+    if (encoder->completion_cb) {
+        void* done_user_data = encoder_async_pop_user_data(encoder);
+        encoder->completion_cb(encoder->completion_opaque, done_user_data, 0, pkt->data, pkt->size);
+        av_packet_unref(pkt);
+    } else {
+        encoder->async_ready_count++;
+    }
+    
+    return 0;
+}
+
+// Copy a frame into the next input slot and send it (parameters already validated)
+static int encoder_async_send(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, void* user_data) {
+    int ret;
+    
+    if (!encoder->async_frames) {
+        ret = encoder_async_init(encoder);
+        if (ret < 0) {
+            fprintf(stderr, "Failed to allocate async encoder queue: %s\n", av_err2str(ret));
+            encoder_async_free(encoder);
+            return ret;
+        }
+    }
+    
+    if (encoder_codecless(encoder)) {
+        return encoder_async_send_native(encoder, nv12_data, user_data);
+    }
+    
+    // Fill the next slot; if the codec still references it, make_writable
+    // gives the slot a fresh buffer instead of overwriting a frame in flight
+    AVFrame* frame = encoder->async_frames[encoder->async_next_slot];
+    ret = av_frame_make_writable(frame);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to make frame writable: %s\n", av_err2str(ret));
+        return ret;
+    }
+    encoder_fill_frame(encoder, frame, nv12_data);
+    frame->pts = encoder->frame_counter++;
+    encoder_set_frame_qscale(encoder, frame);
+    
+    uint64_t t_send = get_time_ns();
+    ret = avcodec_send_frame(encoder->codec_ctx, frame);
+    if (ret == AVERROR(EAGAIN)) {
+        // Codec input is full: pull finished packets out, then retry
+        ret = encoder_async_collect(encoder);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = avcodec_send_frame(encoder->codec_ctx, frame);
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Error sending frame to encoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    encoder_sim_push(encoder, t_send);
+    
+    encoder_async_push_user_data(encoder, user_data);
+    encoder->async_next_slot = (encoder->async_next_slot + 1) % encoder->queue_depth;
+    
+    return 0;
+}
+
+// Take the oldest received packet off the FIFO. If it does not fit, *out_size
+// gets the required size and the packet is kept (keep_on_enomem) or dropped.
+static int encoder_async_take(NV12MJPEGEncoder* encoder, uint8_t* out_buffer, size_t buffer_size,
+                              size_t* out_size, void** user_data, int keep_on_enomem) {
+    AVPacket* pkt = encoder->async_ready[encoder->async_ready_head];
+    int ret = 0;
+    
+    *out_size = pkt->size;
+    if ((size_t)pkt->size > buffer_size) {
+        if (keep_on_enomem) {
+            return -ENOMEM;
+        }
+        ret = -ENOMEM;
+    } else {
+        memcpy(out_buffer, pkt->data, pkt->size);
+    }
+    av_packet_unref(pkt);
+    encoder->async_ready_head = (encoder->async_ready_head + 1) % encoder->queue_depth;
+    encoder->async_ready_count--;
+    
+    void* done_user_data = encoder_async_pop_user_data(encoder);
+    if (user_data) {
+        *user_data = done_user_data;
+    }
+    
+    return ret;
+}
+
+// Wait until a received packet is queued. Returns -EAGAIN on timeout.
+static int encoder_async_wait(NV12MJPEGEncoder* encoder, int timeout_ms) {
+    uint64_t deadline = get_time_ns() + (uint64_t)(timeout_ms > 0 ? timeout_ms : 0) * 1000000ULL;
+    
+    while (encoder->async_ready_count == 0) {
+        if (encoder->async_in_flight == 0) {
+            return -EAGAIN;
+        }
+        int ret = encoder_async_collect(encoder);
+        if (ret < 0) {
+            return ret;
+        }
+        if (encoder->async_ready_count > 0) {
+            break;
+        }
+        if (get_time_ns() >= deadline) {
+            return -EAGAIN;
+        }
+        sleep_us(200);
+    }
+    
+    return 0;
+}
+
+int encoder_submit(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, void* user_data) {
+    int ret;
+    
+    if (!encoder || !nv12_data) {
+        return -EINVAL;
+    }
+    if (encoder->async_in_flight >= encoder->queue_depth) {
+        return -EAGAIN;
+    }
+    
+    ret = encoder_async_send(encoder, nv12_data, user_data);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    // With a callback, deliver whatever is already done without waiting
+    if (encoder->completion_cb) {
+        ret = encoder_async_collect(encoder);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    
+    return 0;
+}
+
+int encoder_poll(NV12MJPEGEncoder* encoder, uint8_t* out_buffer, size_t buffer_size,
+                 size_t* out_size, void** user_data, int timeout_ms) {
+    if (!encoder || !out_buffer || !out_size || encoder->completion_cb) {
+        return -EINVAL;
+    }
+    
+    int ret = encoder_async_wait(encoder, timeout_ms);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    // Keep the packet queued on -ENOMEM so the caller can retry with a larger buffer
+    return encoder_async_take(encoder, out_buffer, buffer_size, out_size, user_data, 1);
+}
+
+int encoder_set_completion_callback(NV12MJPEGEncoder* encoder, nv12_mjpeg_completion_fn cb, void* opaque) {
+    if (!encoder) {
+        return -EINVAL;
+    }
+    if (encoder->async_in_flight > 0) {
+        return -EBUSY;
+    }
+    encoder->completion_cb = cb;
+    encoder->completion_opaque = opaque;
+    return 0;
+}
+
+int encoder_poll_completions(NV12MJPEGEncoder* encoder, int timeout_ms) {
+    if (!encoder || !encoder->completion_cb) {
+        return -EINVAL;
+    }
+    
+    uint64_t deadline = get_time_ns() + (uint64_t)(timeout_ms > 0 ? timeout_ms : 0) * 1000000ULL;
+    for (;;) {
+        int ret = encoder_async_collect(encoder);
+        if (ret != 0 || encoder->async_in_flight == 0 || get_time_ns() >= deadline) {
+            return ret;
+        }
+        sleep_us(200);
+    }
+}
+
+// Drop every received packet and forget the frames in flight
+static void encoder_async_discard(NV12MJPEGEncoder* encoder) {
+    while (encoder->async_ready_count > 0) {
+        av_packet_unref(encoder->async_ready[encoder->async_ready_head]);
+        encoder->async_ready_head = (encoder->async_ready_head + 1) % encoder->queue_depth;
+        encoder->async_ready_count--;
+    }
+    encoder->async_ready_head = 0;
+    encoder->async_user_head = 0;
+    encoder->async_in_flight = 0;
+    while (encoder->sim_pkt_count > 0) {
+        av_packet_unref(encoder->sim_pkts[encoder->sim_head]);
+        encoder->sim_head = (encoder->sim_head + 1) % SIM_FIFO_SIZE;
+        encoder->sim_pkt_count--;
+    }
+    encoder->sim_count = 0;
+}
+
+int encoder_drain(NV12MJPEGEncoder* encoder) {
+    int ret;
+    
+    if (!encoder) {
+        return -EINVAL;
+    }
+    
+    // Nothing held back by the codec
+    if (encoder->async_ready_count == encoder->async_in_flight &&
+        !(encoder->completion_cb && encoder->async_in_flight > 0)) {
+        return 0;
+    }
+    
+    // End of stream: flush the codec so it releases every frame it holds
+    // (after the simulated hardware has finished them)
+    if (encoder->sim_count > 0) {
+        encoder_sim_wait_until(encoder->sim_done[(encoder->sim_head + encoder->sim_count - 1) % SIM_FIFO_SIZE]);
+    }
+    ret = avcodec_send_frame(encoder->codec_ctx, NULL);
+    if (ret < 0) {
+        fprintf(stderr, "Error flushing encoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    ret = encoder_async_collect(encoder);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    // The flushed codec is at EOF; start a fresh session for further frames
+    return encoder_reset_session(encoder);
+}
+
+int encoder_frames_in_flight(const NV12MJPEGEncoder* encoder) {
+    return encoder ? encoder->async_in_flight : 0;
+}
+
+// ============================================================================
+// Region-of-Interest Encoding
+// ============================================================================
+
+// Encode strided NV12 planes of the encoder's size into a caller buffer
+static int encoder_encode_planes(NV12MJPEGEncoder* encoder, const uint8_t* src_y, int y_stride,
+                                 const uint8_t* src_uv, int uv_stride,
+                                 uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    int ret;
+    
+    if (encoder_codecless(encoder)) {
+        return encoder_encode_native(encoder, src_y, y_stride, src_uv, uv_stride, out_buffer, buffer_size, out_size);
+    }
+    ret = encoder_codec_encode(encoder, src_y, y_stride, src_uv, uv_stride);
+    if (ret < 0) {
+        return ret;
+    }
+    return encoder_output_packet(encoder, out_buffer, buffer_size, out_size);
+}
+
+// Encoder for one crop size: cached, or created in the least recently used slot
+static NV12MJPEGEncoder* encoder_roi_get(NV12MJPEGEncoder* encoder, int width, int height) {
+    int slot = 0;
+    
+    for (int i = 0; i < ROI_CACHE_SIZE; i++) {
+        NV12MJPEGEncoder* roi = encoder->roi_cache[i];
+        if (roi && roi->width == width && roi->height == height) {
+            encoder->roi_last_used[i] = ++encoder->roi_clock;
+            return roi;
+        }
+        if (!roi || (encoder->roi_cache[slot] && encoder->roi_last_used[i] < encoder->roi_last_used[slot])) {
+            slot = i;
+        }
+    }
+    
+    NV12MJPEGEncoderOptions opts;
+    encoder_options_init(&opts, width, height, encoder->quality);
+    opts.backend = encoder->backend;
+    opts.verbose = encoder->verbose;
+    opts.strips = encoder->strips;
+    opts.huffman = encoder->huffman;
+    opts.huffman_window = encoder->huffman_window;
+    opts.simulation = encoder->sim_config;
+    NV12MJPEGEncoder* roi = encoder_create_with_options(&opts);
+    if (!roi) {
+        return NULL;
+    }
+    if (encoder->custom_quant) {
+        encoder_set_quant_tables(roi, encoder->quant_tables[0], encoder->quant_tables[1]);
+    }
+    
+    ENCODER_LOG(encoder, "[Encoder] ROI encoder created for %dx%d (slot %d)\n", width, height, slot);
+    encoder_destroy(encoder->roi_cache[slot]);
+    encoder->roi_cache[slot] = roi;
+    encoder->roi_last_used[slot] = ++encoder->roi_clock;
+    return roi;
+}
+
+int encoder_encode_roi(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, int src_width, int src_height,
+                       int x, int y, int width, int height,
+                       uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    int ret;
+    uint64_t t_total_start = get_time_ns();
+    
+    // Validate parameters
+    if (!encoder || !nv12_data || !out_buffer || !out_size) {
+        return -EINVAL;
+    }
+    if (x < 0 || y < 0 || x % 16 != 0 || y % 16 != 0 || width < 2 || height < 2 ||
+        width % 2 != 0 || height % 2 != 0 || x + width > src_width || y + height > src_height) {
+        fprintf(stderr, "Invalid ROI: %dx%d at (%d,%d) in %dx%d frame (origin must be 16-aligned, size even)\n",
+                width, height, x, y, src_width, src_height);
+        return -EINVAL;
+    }
+    
+    NV12MJPEGEncoder* roi = encoder_roi_get(encoder, width, height);
+    if (!roi) {
+        return -ENOMEM;
+    }
+    ret = encoder_set_quality(roi, encoder->quality);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    // Only the region is read: plane pointers at the origin, source strides
+    const uint8_t* src_y = nv12_data + (size_t)y * src_width + x;
+    const uint8_t* src_uv = nv12_data + (size_t)src_width * src_height + (size_t)(y / 2) * src_width + x;
+    ret = encoder_encode_planes(roi, src_y, src_width, src_uv, src_width, out_buffer, buffer_size, out_size);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    uint64_t t_total_end = get_time_ns();
+    encoder->stats.frames_encoded++;
+    encoder->stats.last_encode_ms = (t_total_end - t_total_start) / 1000000.0;
+    encoder->stats.last_compression_ratio = (double)width * height * 3 / 2 / *out_size;
+    ENCODER_LOG(encoder, "[Perf] ROI %dx%d at (%d,%d): %.3f ms (%zu bytes)\n",
+            width, height, x, y, encoder->stats.last_encode_ms, *out_size);
+    
+    return 0;
+}
+
+// ============================================================================
+// Multi-Output Encoding (full frame + thumbnail)
+// ============================================================================
+
+int encoder_encode_with_thumbnail(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, int thumb_scale,
+                                  uint8_t* out_buffer, size_t buffer_size, size_t* out_size,
+                                  uint8_t* thumb_buffer, size_t thumb_buffer_size, size_t* thumb_size) {
+    int ret;
+    int shift;
+    uint64_t t_total_start = get_time_ns();
+    
+    // Validate parameters
+    if (!encoder || !nv12_data || !out_buffer || !out_size || !thumb_buffer || !thumb_size) {
+        return -EINVAL;
+    }
+    switch (thumb_scale) {
+    case 2: shift = 1; break;
+    case 4: shift = 2; break;
+    case 8: shift = 3; break;
+    default:
+        fprintf(stderr, "Invalid thumbnail scale: 1/%d (must be 1/2, 1/4 or 1/8)\n", thumb_scale);
+        return -EINVAL;
+    }
+    int tw = (encoder->width >> shift) & ~1;
+    int th = (encoder->height >> shift) & ~1;
+    if (tw < 2 || th < 2) {
+        return -EINVAL;
+    }
+    if (encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    
+    size_t thumb_nv12_size = (size_t)tw * th * 3 / 2;
+    if (thumb_nv12_size > encoder->thumb_capacity) {
+        uint8_t* buf = (uint8_t*)realloc(encoder->thumb_nv12, thumb_nv12_size);
+        if (!buf) {
+            return -ENOMEM;
+        }
+        encoder->thumb_nv12 = buf;
+        encoder->thumb_capacity = thumb_nv12_size;
+    }
+    encoder->thumb_width = tw;
+    encoder->thumb_height = th;
+    
+    // Full frame: the thumbnail planes are produced from the same pass over the input
+    // (native: per encoded MCU row; codec backends: per copied band). TurboJPEG
+    // reads the planes inside the library, so it gets a separate downscale pass.
+    encoder->thumb_shift = shift;
+    if (encoder->native) {
+        native_jpeg_set_row_callback(encoder->native, downscale_nv12_band, encoder);
+    } else if (encoder->turbo) {
+        downscale_nv12_band(encoder, nv12_data, encoder->width, nv12_data + (size_t)encoder->width * encoder->height,
+                            encoder->width, 0, encoder->height);
+    }
+    ret = encoder_encode_planes(encoder, nv12_data, encoder->width,
+                                nv12_data + (size_t)encoder->width * encoder->height, encoder->width,
+                                out_buffer, buffer_size, out_size);
+    if (encoder->native) {
+        native_jpeg_set_row_callback(encoder->native, NULL, NULL);
+    }
+    encoder->thumb_shift = 0;
+    if (ret < 0) {
+        return ret;
+    }
+    if (!encoder_codecless(encoder)) {
+        encoder->stats.frames_encoded++;
+    }
+    
+    // Thumbnail: small encoder from the ROI cache, reads only the downscaled planes
+    NV12MJPEGEncoder* thumb = encoder_roi_get(encoder, tw, th);
+    if (!thumb) {
+        return -ENOMEM;
+    }
+    ret = encoder_set_quality(thumb, encoder->quality);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = encoder_encode_planes(thumb, encoder->thumb_nv12, tw, encoder->thumb_nv12 + (size_t)tw * th, tw,
+                                thumb_buffer, thumb_buffer_size, thumb_size);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    uint64_t t_total_end = get_time_ns();
+    encoder->stats.last_encode_ms = (t_total_end - t_total_start) / 1000000.0;
+    encoder->stats.last_compression_ratio = (double)encoder->width * encoder->height * 3 / 2 / *out_size;
+    ENCODER_LOG(encoder, "[Perf] === TOTAL encoding time (full + 1/%d thumbnail %dx%d): %.3f ms ===\n",
+            thumb_scale, tw, th, encoder->stats.last_encode_ms);
+    
+    return 0;
+}
+
+// ============================================================================
+// Multi-Quality Encoding
+// ============================================================================
+
+int encoder_encode_multi_quality(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                                 const int* qualities, int count, uint8_t* const out_buffers[],
+                                 const size_t buffer_sizes[], size_t out_sizes[]) {
+    int ret;
+    uint64_t t_total_start = get_time_ns();
+    
+    // Validate parameters
+    if (!encoder || !nv12_data || !qualities || !out_buffers || !buffer_sizes || !out_sizes ||
+        count < 1 || count > NV12_MJPEG_MAX_QUALITY_LEVELS) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < count; i++) {
+        if (qualities[i] < 1 || qualities[i] > 99 || !out_buffers[i]) {
+            return -EINVAL;
+        }
+        if (encoder_quality_fixed(encoder) && qualities[i] != encoder->quality) {
+            fprintf(stderr, "Multi-quality encode is not supported by mjpeg_rkmpp (quality fixed at open)\n");
+            return -ENOTSUP;
+        }
+    }
+    if (encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    
+    const uint8_t* src_y = nv12_data;
+    const uint8_t* src_uv = nv12_data + (size_t)encoder->width * encoder->height;
+    if (encoder->native) {
+        // One transform pass, quantized and entropy coded once per quality
+        ret = native_jpeg_encode_multi(encoder->native, src_y, encoder->width, src_uv, encoder->width,
+                                       qualities, count, out_buffers, buffer_sizes, out_sizes,
+                                       encoder->stats.strip_encode_ms);
+        if (ret < 0) {
+            if (ret == -ENOMEM) {
+                fprintf(stderr, "Output buffer too small: need up to %zu bytes per quality\n", out_sizes[0]);
+            }
+            return ret;
+        }
+        encoder->frame_counter++;
+    } else if (encoder->turbo) {
+        // TurboJPEG: the chroma is split again for every quality
+        for (int i = 0; i < count; i++) {
+            turbo_jpeg_set_quality(encoder->turbo, qualities[i]);
+            ret = encoder_codecless_encode(encoder, src_y, encoder->width, src_uv, encoder->width,
+                                           out_buffers[i], buffer_sizes[i], &out_sizes[i], NULL);
+            if (ret < 0) {
+                if (ret == -ENOMEM) {
+                    fprintf(stderr, "Output buffer too small: need %zu bytes for quality %d\n",
+                            out_sizes[i], qualities[i]);
+                }
+                return ret;
+            }
+        }
+        encoder->frame_counter++;
+    } else {
+        // Codec backends: the input frame is copied once per quality
+        for (int i = 0; i < count; i++) {
+            encoder->next_quality = qualities[i];
+            ret = encoder_encode_planes(encoder, src_y, encoder->width, src_uv, encoder->width,
+                                        out_buffers[i], buffer_sizes[i], &out_sizes[i]);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+    
+    uint64_t t_total_end = get_time_ns();
+    encoder->stats.frames_encoded++;
+    encoder->stats.last_huffman_saved = 0;
+    encoder->stats.last_quality = qualities[0];
+    encoder->stats.last_encode_ms = (t_total_end - t_total_start) / 1000000.0;
+    encoder->stats.last_compression_ratio = (double)encoder->width * encoder->height * 3 / 2 / out_sizes[0];
+    ENCODER_LOG(encoder, "[Perf] === TOTAL encoding time (%d qualities): %.3f ms ===\n",
+            count, encoder->stats.last_encode_ms);
+    
+    return 0;
+}
+
+// ============================================================================
+// File-Descriptor Input
+// ============================================================================
+
+// Mapping of the buffer behind fd: cached, or mapped in the least recently used slot
+static const EncoderFdMapping* encoder_fd_map(NV12MJPEGEncoder* encoder, int fd, size_t length) {
+    struct stat st;
+    int slot = 0;
+    
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "Invalid frame fd %d: %s\n", fd, strerror(errno));
+        return NULL;
+    }
+    if (!length) {
+        // dma-buf reports its size through lseek rather than fstat on older kernels
+        off_t end = st.st_size > 0 ? st.st_size : lseek(fd, 0, SEEK_END);
+        if (end <= 0) {
+            fprintf(stderr, "Cannot determine size of frame fd %d\n", fd);
+            return NULL;
+        }
+        length = end;
+    }
+    
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        EncoderFdMapping* map = &encoder->fd_cache[i];
+        if (map->addr && map->fd == fd && map->dev == st.st_dev && map->ino == st.st_ino) {
+            if (map->size == st.st_size && map->length >= length) {
+                map->last_used = ++encoder->fd_clock;
+                return map;
+            }
+            // Same buffer, resized or mapped too short: replace its mapping
+            slot = i;
+            break;
+        }
+        if (!map->addr || (encoder->fd_cache[slot].addr && map->last_used < encoder->fd_cache[slot].last_used)) {
+            slot = i;
+        }
+    }
+    
+    void* addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Failed to map frame fd %d (%zu bytes): %s\n", fd, length, strerror(errno));
+        return NULL;
+    }
+    
+    EncoderFdMapping* map = &encoder->fd_cache[slot];
+    if (map->addr) {
+        munmap(map->addr, map->length);
+    }
+    map->addr = (uint8_t*)addr;
+    map->length = length;
+    map->fd = fd;
+    map->dev = st.st_dev;
+    map->ino = st.st_ino;
+    map->size = st.st_size;
+    map->last_used = ++encoder->fd_clock;
+    ENCODER_LOG(encoder, "[Encoder] Mapped frame fd %d (%zu bytes, slot %d)\n", fd, length, slot);
+    return map;
+}
+
+// Bracket CPU reads of a dma-buf (cache maintenance); a no-op for other fds.
+// Returns 0 or a negative errno.
+static int encoder_fd_sync(int fd, int end) {
+#ifdef DMA_BUF_IOCTL_SYNC
+    struct dma_buf_sync sync = { DMA_BUF_SYNC_READ | (end ? DMA_BUF_SYNC_END : DMA_BUF_SYNC_START) };
+    int ret;
+    do {
+        ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+    int err = ret < 0 ? errno : 0;
+    if (err && err != ENOTTY) {
+        // ENOTTY: not a dma-buf, nothing to synchronize
+        fprintf(stderr, "DMA_BUF_IOCTL_SYNC %s failed on fd %d: %s\n",
+                end ? "end" : "start", fd, strerror(err));
+        return -err;
+    }
+#else
+    (void)fd;
+    (void)end;
+#endif
+    return 0;
+}
+
+int encoder_encode_fd(NV12MJPEGEncoder* encoder, const NV12FrameFd* frame,
+                      uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
+    int ret;
+    
+    // Validate parameters
+    if (!encoder || !frame || frame->fd < 0 || !out_buffer || !out_size) {
+        return -EINVAL;
+    }
+    if (frame->y_stride < encoder->width || frame->uv_stride < encoder->width) {
+        return -EINVAL;
+    }
+    
+    const EncoderFdMapping* map = encoder_fd_map(encoder, frame->fd, frame->size);
+    if (!map) {
+        return -EINVAL;
+    }
+    
+    // Both planes must lie inside the mapping
+    size_t y_end = frame->y_offset + (size_t)frame->y_stride * (encoder->height - 1) + encoder->width;
+    size_t uv_end = frame->uv_offset + (size_t)frame->uv_stride * (encoder->height / 2 - 1) + encoder->width;
+    if (frame->y_offset >= map->length || frame->uv_offset >= map->length ||
+        y_end > map->length || uv_end > map->length) {
+        fprintf(stderr, "Frame planes exceed fd %d buffer (%zu bytes)\n", frame->fd, map->length);
+        return -EINVAL;
+    }
+    
+    NV12FrameDesc desc;
+    desc.width = encoder->width;
+    desc.height = encoder->height;
+    desc.y = map->addr + frame->y_offset;
+    desc.y_stride = frame->y_stride;
+    desc.uv = map->addr + frame->uv_offset;
+    desc.uv_stride = frame->uv_stride;
+    
+    // Without the start sync the CPU may read stale cache lines: the frame fails
+    ret = encoder_fd_sync(frame->fd, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = encoder_encode_frame(encoder, &desc, out_buffer, buffer_size, out_size);
+    int sync_ret = encoder_fd_sync(frame->fd, 1);
+    return ret < 0 ? ret : sync_ret;
+}
+
+void encoder_release_fd(NV12MJPEGEncoder* encoder, int fd) {
+    if (!encoder) {
+        return;
+    }
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        EncoderFdMapping* map = &encoder->fd_cache[i];
+        if (map->addr && map->fd == fd) {
+            munmap(map->addr, map->length);
+            map->addr = NULL;
+        }
+    }
+}
+
+// ============================================================================
+// Refcounted Output Packets
+// ============================================================================
+
+// Wrap a buffer reference (ownership is taken, also on failure)
+static NV12MJPEGPacket* packet_wrap(AVBufferRef* buf, const uint8_t* data, size_t size, int64_t pts) {
+    NV12MJPEGPacket* pkt = (NV12MJPEGPacket*)malloc(sizeof(NV12MJPEGPacket));
+    if (!pkt) {
+        av_buffer_unref(&buf);
+        return NULL;
+    }
+    pkt->data = data;
+    pkt->size = size;
+    pkt->pts = pts;
+    pkt->buf = buf;
+    return pkt;
+}
+
+// Move a received codec packet into a new handle without copying the payload
+static int packet_from_avpacket(AVPacket* avpkt, NV12MJPEGPacket** out_pkt) {
+    int ret = av_packet_make_refcounted(avpkt);
+    if (ret < 0) {
+        av_packet_unref(avpkt);
+        return ret;
+    }
+    
+    AVBufferRef* buf = avpkt->buf;
+    avpkt->buf = NULL;
+    *out_pkt = packet_wrap(buf, avpkt->data, avpkt->size, avpkt->pts);
+    av_packet_unref(avpkt);
+    return *out_pkt ? 0 : -ENOMEM;
+}
+
+int encoder_encode_packet(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, NV12MJPEGPacket** out_pkt) {
+    int ret;
+    uint64_t t_total_start = get_time_ns();
+    
+    if (!encoder || !nv12_data || !out_pkt) {
+        return -EINVAL;
+    }
+    *out_pkt = NULL;
+    if (encoder->async_in_flight > 0) {
+        fprintf(stderr, "Encoder busy: %d frames submitted asynchronously\n", encoder->async_in_flight);
+        return -EBUSY;
+    }
+    
+    encoder_rc_begin(encoder, nv12_data, encoder->width);
+    for (int pass = 0; ; pass++) {
+        nv12_mjpeg_packet_release(out_pkt);
+        if (encoder_codecless(encoder)) {
+            AVBufferRef* buf = NULL;
+            size_t size = 0;
+            ret = encoder_native_encode_to_ref(encoder, nv12_data, &buf, &size, encoder->stats.strip_encode_ms);
+            if (ret < 0) {
+                return ret;
+            }
+            encoder->stats.num_strips = encoder->strips;
+            *out_pkt = packet_wrap(buf, buf->data, size, encoder->frame_counter - 1);
+        } else {
+            ret = encoder_codec_encode(encoder, nv12_data, encoder->width,
+                                       nv12_data + (size_t)encoder->width * encoder->height, encoder->width);
+            if (ret < 0) {
+                return ret;
+            }
+            ret = packet_from_avpacket(encoder->pkt, out_pkt);
+            if (ret < 0) {
+                return ret;
+            }
+            encoder->stats.frames_encoded++;
+        }
+        if (!*out_pkt) {
+            return -ENOMEM;
+        }
+        if (!encoder_rc_end(encoder, 0, (*out_pkt)->size, pass)) {
+            break;
+        }
+    }
+    if (encoder->slot_size && (*out_pkt)->size > encoder->slot_size) {
+        fprintf(stderr, "Frame does not fit its slot: %zu bytes at quality %d, slot %zu bytes\n",
+                (*out_pkt)->size, encoder->stats.last_quality, encoder->slot_size);
+        nv12_mjpeg_packet_release(out_pkt);
+        return -ENOSPC;
+    }
+    
+    uint64_t t_total_end = get_time_ns();
+    encoder->stats.last_encode_ms = (t_total_end - t_total_start) / 1000000.0;
+    encoder->stats.last_compression_ratio = (double)encoder->width * encoder->height * 3 / 2 / (*out_pkt)->size;
+    ENCODER_LOG(encoder, "[Perf] === TOTAL encoding time (packet, no output copy): %.3f ms (%zu bytes) ===\n",
+            encoder->stats.last_encode_ms, (*out_pkt)->size);
+    
+    return 0;
+}
+
+int encoder_poll_packet(NV12MJPEGEncoder* encoder, NV12MJPEGPacket** out_pkt, void** user_data,
+                        int timeout_ms) {
+    if (!encoder || !out_pkt || encoder->completion_cb) {
+        return -EINVAL;
+    }
+    *out_pkt = NULL;
+    
+    int ret = encoder_async_wait(encoder, timeout_ms);
     if (ret < 0) {
-        fprintf(stderr, "Failed to allocate frame buffer: %s\n", av_err2str(ret));
-        av_frame_free(&encoder->frame);
-        avcodec_free_context(&encoder->codec_ctx);
-        free(encoder);
-        return NULL;
+        return ret;
     }
     
-    // Allocate packet
-    encoder->pkt = av_packet_alloc();
-    if (!encoder->pkt) {
-        fprintf(stderr, "Failed to allocate packet\n");
-        av_frame_free(&encoder->frame);
-        avcodec_free_context(&encoder->codec_ctx);
-        free(encoder);
-        return NULL;
+    AVPacket* avpkt = encoder->async_ready[encoder->async_ready_head];
+    ret = packet_from_avpacket(avpkt, out_pkt);
+    encoder->async_ready_head = (encoder->async_ready_head + 1) % encoder->queue_depth;
+    encoder->async_ready_count--;
+    
+    void* done_user_data = encoder_async_pop_user_data(encoder);
+    if (user_data) {
+        *user_data = done_user_data;
     }
     
-    return encoder;
+    return ret;
 }
 
-size_t encoder_max_output_size(const NV12MJPEGEncoder* encoder) {
-    if (!encoder) {
-        return 0;
+NV12MJPEGPacket* nv12_mjpeg_packet_ref(const NV12MJPEGPacket* pkt) {
+    if (!pkt) {
+        return NULL;
     }
-    // Conservative estimate: assume worst case of uncompressed size
-    // In practice, MJPEG compression is usually 5:1 to 20:1
-    return (size_t)encoder->width * encoder->height * 3 / 2;
+    AVBufferRef* buf = av_buffer_ref((AVBufferRef*)pkt->buf);
+    if (!buf) {
+        return NULL;
+    }
+    return packet_wrap(buf, pkt->data, pkt->size, pkt->pts);
 }
 
-int encoder_encode_to_buffer(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
-                              uint8_t* out_buffer, size_t buffer_size, size_t* out_size) {
-    int ret;
-    uint64_t t_start, t_end, t_total_start;
+void nv12_mjpeg_packet_release(NV12MJPEGPacket** pkt) {
+    if (!pkt || !*pkt) {
+        return;
+    }
+    AVBufferRef* buf = (AVBufferRef*)(*pkt)->buf;
+    av_buffer_unref(&buf);
+    free(*pkt);
+    *pkt = NULL;
+}
+
+// ============================================================================
+// Scatter-Gather Output
+// ============================================================================
+
+int nv12_mjpeg_scatter(const uint8_t* jpeg, size_t size, const NV12MJPEGSegment* segments, int num_segments,
+                       NV12MJPEGScatter* out) {
+    if (!jpeg || !out || num_segments < 0 || num_segments > NV12_MJPEG_MAX_SEGMENTS ||
+        (num_segments > 0 && !segments)) {
+        return -EINVAL;
+    }
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+        fprintf(stderr, "Not a JPEG image: no SOI marker\n");
+        return -EINVAL;
+    }
+    for (int i = 0; i < num_segments; i++) {
+        uint8_t marker = segments[i].marker;
+        if ((marker < 0xE0 || marker > 0xEF) && marker != 0xFE) {
+            fprintf(stderr, "Invalid metadata segment marker 0x%02X (must be APPn or COM)\n", marker);
+            return -EINVAL;
+        }
+        if (segments[i].size > NV12_MJPEG_MAX_SEGMENT_SIZE || (segments[i].size && !segments[i].data)) {
+            fprintf(stderr, "Invalid metadata segment size: %zu bytes (max %d)\n",
+                    segments[i].size, NV12_MJPEG_MAX_SEGMENT_SIZE);
+            return -EINVAL;
+        }
+    }
     
-    t_total_start = get_time_ns();
+    // Insert after SOI and a leading JFIF APP0, which must stay first
+    size_t split = 2;
+    if (size >= 6 && jpeg[2] == 0xFF && jpeg[3] == 0xE0) {
+        size_t length = ((size_t)jpeg[4] << 8) | jpeg[5];
+        if (2 + 2 + length <= size) {
+            split = 2 + 2 + length;
+        }
+    }
     
-    // Validate parameters
-    if (!encoder || !nv12_data || !out_buffer || !out_size) {
+    int n = 0;
+    out->iov[n].iov_base = (void*)jpeg;
+    out->iov[n++].iov_len = split;
+    out->total_size = size;
+    for (int i = 0; i < num_segments; i++) {
+        size_t length = segments[i].size + 2;
+        out->headers[i][0] = 0xFF;
+        out->headers[i][1] = segments[i].marker;
+        out->headers[i][2] = (uint8_t)(length >> 8);
+        out->headers[i][3] = (uint8_t)length;
+        out->iov[n].iov_base = out->headers[i];
+        out->iov[n++].iov_len = 4;
+        if (segments[i].size) {
+            out->iov[n].iov_base = (void*)segments[i].data;
+            out->iov[n++].iov_len = segments[i].size;
+        }
+        out->total_size += 2 + length;
+    }
+    out->iov[n].iov_base = (void*)(jpeg + split);
+    out->iov[n++].iov_len = size - split;
+    out->iov_count = n;
+    return 0;
+}
+
+int encoder_encode_scatter(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                           const NV12MJPEGSegment* segments, int num_segments, NV12MJPEGScatter* out) {
+    if (!out) {
         return -EINVAL;
     }
+    out->pkt = NULL;
+    out->iov_count = 0;
     
-    // Make frame writable (in case it was used before)
-    t_start = get_time_ns();
-    ret = av_frame_make_writable(encoder->frame);
-    t_end = get_time_ns();
-    fprintf(stderr, "[Perf] av_frame_make_writable: %.3f ms\n", (t_end - t_start) / 1000000.0);
+    int ret = encoder_encode_packet(encoder, nv12_data, &out->pkt);
     if (ret < 0) {
-        fprintf(stderr, "Failed to make frame writable: %s\n", av_err2str(ret));
         return ret;
     }
+    ret = nv12_mjpeg_scatter(out->pkt->data, out->pkt->size, segments, num_segments, out);
+    if (ret < 0) {
+        nv12_mjpeg_packet_release(&out->pkt);
+    }
+    return ret;
+}
+
+void nv12_mjpeg_scatter_release(NV12MJPEGScatter* out) {
+    if (!out) {
+        return;
+    }
+    nv12_mjpeg_packet_release(&out->pkt);
+    out->iov_count = 0;
+}
+
+// ============================================================================
+// Batch Encoding
+// ============================================================================
+
+int encoder_encode_batch(NV12MJPEGEncoder* encoder, const uint8_t* frames[], int n,
+                         uint8_t* outputs[], size_t sizes[], int status[]) {
+    int ret;
     
-    // Print encoder configuration and buffer info
-    fprintf(stderr, "[Encoder] Quality: QP=%d, Resolution: %dx%d\n", 
-            encoder->quality, encoder->width, encoder->height);
-    fprintf(stderr, "[Encoder] Y linesize: %d (width: %d, padding: %d bytes)\n",
-            encoder->frame->linesize[0], encoder->width, 
-            encoder->frame->linesize[0] - encoder->width);
-    fprintf(stderr, "[Encoder] UV linesize: %d (width: %d, padding: %d bytes)\n",
-            encoder->frame->linesize[1], encoder->width,
-            encoder->frame->linesize[1] - encoder->width);
-    
-    // Copy NV12 data to frame using bulk copy
-    // Y plane
-    const uint8_t* src_y = nv12_data;
-    uint8_t* dst_y = encoder->frame->data[0];
-    fprintf(stderr, "[Encoder] Y plane: bulk copy %d bytes (linesize=%d, width=%d)\n", 
-            encoder->width * encoder->height, encoder->frame->linesize[0], encoder->width);
-    t_start = get_time_ns();
-    memcpy(dst_y, src_y, encoder->width * encoder->height);
-    t_end = get_time_ns();
-    fprintf(stderr, "[Perf] Y plane memcpy: %.3f ms (%.2f GB/s)\n", 
-            (t_end - t_start) / 1000000.0,
-            (encoder->width * encoder->height) / ((t_end - t_start) / 1e9) / 1e9);
-    
-    // UV plane
-    const uint8_t* src_uv = nv12_data + encoder->width * encoder->height;
-    uint8_t* dst_uv = encoder->frame->data[1];
-    fprintf(stderr, "[Encoder] UV plane: bulk copy %d bytes (linesize=%d, width=%d)\n",
-            encoder->width * encoder->height / 2, encoder->frame->linesize[1], encoder->width);
-    t_start = get_time_ns();
-    memcpy(dst_uv, src_uv, encoder->width * encoder->height / 2);
-    t_end = get_time_ns();
-    fprintf(stderr, "[Perf] UV plane memcpy: %.3f ms (%.2f GB/s)\n",
-            (t_end - t_start) / 1000000.0,
-            (encoder->width * encoder->height / 2) / ((t_end - t_start) / 1e9) / 1e9);
-    
-    // Update PTS
-    encoder->frame->pts = encoder->frame_counter++;
-    
-    // Set frame quality for MJPEG encoding
-    encoder->frame->quality = encoder->quality * FF_QP2LAMBDA;
+    // Validate once for the whole batch
+    if (!encoder || !frames || !outputs || !sizes || !status || n < 0) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!frames[i] || !outputs[i]) {
+            return -EINVAL;
+        }
+    }
+    if (encoder->async_in_flight > 0 || encoder->completion_cb) {
+        return -EBUSY;
+    }
+    if (n == 0) {
+        return 0;
+    }
     
-    // Send frame to encoder
-    t_start = get_time_ns();
-    ret = avcodec_send_frame(encoder->codec_ctx, encoder->frame);
-    t_end = get_time_ns();
-    fprintf(stderr, "[Perf] avcodec_send_frame: %.3f ms\n", (t_end - t_start) / 1000000.0);
-    if (ret < 0) {
-        fprintf(stderr, "Error sending frame to encoder: %s\n", av_err2str(ret));
-        return ret;
+    // Capacities are replaced by encoded sizes as frames complete
+    size_t* capacities = (size_t*)malloc(n * sizeof(size_t));
+    if (!capacities) {
+        return -ENOMEM;
     }
+    memcpy(capacities, sizes, n * sizeof(size_t));
     
-    // Receive encoded packet
-    t_start = get_time_ns();
-    ret = avcodec_receive_packet(encoder->codec_ctx, encoder->pkt);
-    t_end = get_time_ns();
-    fprintf(stderr, "[Perf] avcodec_receive_packet: %.3f ms\n", (t_end - t_start) / 1000000.0);
-    if (ret == AVERROR(EAGAIN)) {
-        // Hardware encoder needs flush - send NULL frame to flush
-        fprintf(stderr, "[Encoder] Flushing encoder...\n");
-        t_start = get_time_ns();
-        ret = avcodec_send_frame(encoder->codec_ctx, NULL);
-        if (ret < 0) {
-            fprintf(stderr, "Error flushing encoder: %s\n", av_err2str(ret));
-            return ret;
+    // Keep the queue full: sends of later frames overlap with encoding of earlier ones
+    int next_submit = 0;
+    int done = 0;
+    int encoded = 0;
+    ret = 0;
+    while (done < n) {
+        while (next_submit < n && encoder->async_in_flight < encoder->queue_depth) {
+            int idx = next_submit++;
+            int err = encoder_async_send(encoder, frames[idx], (void*)(intptr_t)idx);
+            if (err < 0) {
+                status[idx] = err;
+                sizes[idx] = 0;
+                done++;
+            }
+        }
+        if (encoder->async_in_flight == 0) {
+            continue;
         }
         
-        // Try to receive packet again after flush
-        ret = avcodec_receive_packet(encoder->codec_ctx, encoder->pkt);
-        t_end = get_time_ns();
-        fprintf(stderr, "[Perf] Flush + receive: %.3f ms\n", (t_end - t_start) / 1000000.0);
+        // Collect packets as the codec finishes them. A flush ends the session
+        // (a codec reopen without AV_CODEC_CAP_ENCODER_FLUSH), so it is only sent
+        // when every frame is in and a codec with delay stops producing packets.
+        int may_hold = next_submit == n && !encoder_codecless(encoder) &&
+                       (encoder->codec->capabilities & AV_CODEC_CAP_DELAY);
+        ret = encoder_async_wait(encoder, may_hold ? BATCH_STALL_MS : 1000);
+        if (ret == -EAGAIN && may_hold) {
+            ret = encoder_drain(encoder);
+            if (ret == 0) {
+                ret = encoder_async_wait(encoder, 1000);
+            }
+        }
         if (ret < 0) {
-            fprintf(stderr, "Error receiving packet after flush: %s\n", av_err2str(ret));
-            return ret;
+            break;
+        }
+        
+        // Packets come back in submission order: the oldest frame in flight owns it
+        int idx = (int)(intptr_t)encoder->async_user_data[encoder->async_user_head];
+        status[idx] = encoder_async_take(encoder, outputs[idx], capacities[idx], &sizes[idx], NULL, 0);
+        done++;
+        if (status[idx] == 0) {
+            encoded++;
         }
-    } else if (ret == AVERROR_EOF) {
-        fprintf(stderr, "Error: encoder returned EOF\n");
-        return ret;
-    } else if (ret < 0) {
-        fprintf(stderr, "Error receiving packet from encoder: %s\n", av_err2str(ret));
-        return ret;
     }
     
-    // Check if output buffer is large enough
-    if ((size_t)encoder->pkt->size > buffer_size) {
-        *out_size = encoder->pkt->size;  // Return required size
-        av_packet_unref(encoder->pkt);
-        fprintf(stderr, "Output buffer too small: need %d bytes, have %zu bytes\n", 
-                encoder->pkt->size, buffer_size);
-        return -ENOMEM;
+    if (ret < 0) {
+        // Codec failure: fail every unfinished frame and start a clean session
+        while (encoder->async_in_flight > 0) {
+            int idx = (int)(intptr_t)encoder_async_pop_user_data(encoder);
+            status[idx] = ret;
+            sizes[idx] = 0;
+        }
+        for (int i = next_submit; i < n; i++) {
+            status[i] = ret;
+            sizes[i] = 0;
+        }
+        encoder_async_discard(encoder);
+        encoder_reset_session(encoder);
     }
     
-    // Copy encoded data to output buffer
-    t_start = get_time_ns();
-    memcpy(out_buffer, encoder->pkt->data, encoder->pkt->size);
-    t_end = get_time_ns();
-    fprintf(stderr, "[Perf] Output memcpy: %.3f ms (%d bytes)\n", 
-            (t_end - t_start) / 1000000.0, encoder->pkt->size);
-    *out_size = encoder->pkt->size;
-    
-    // Unreference packet for next use
-    av_packet_unref(encoder->pkt);
-    
-    uint64_t t_total_end = get_time_ns();
-    fprintf(stderr, "[Perf] === TOTAL encoding time: %.3f ms ===\n", 
-            (t_total_end - t_total_start) / 1000000.0);
-    
-    return 0;
+    free(capacities);
+    return ret < 0 ? ret : encoded;
 }
 
 void encoder_destroy(NV12MJPEGEncoder* encoder) {
@@ -370,15 +3647,11 @@ void encoder_destroy(NV12MJPEGEncoder* encoder) {
         return;
     }
     
-    if (encoder->pkt) {
-        av_packet_free(&encoder->pkt);
-    }
-    if (encoder->frame) {
-        av_frame_free(&encoder->frame);
-    }
-    if (encoder->codec_ctx) {
-        avcodec_free_context(&encoder->codec_ctx);
-    }
+    // The standby context and a build in progress are not part of the shared cleanup
+    encoder_spare_collect(encoder, 1);
+    avcodec_free_context(&encoder->spare_ctx);
+    sim_session_close(encoder->sim);
+    encoder_free_resources(encoder);
     
     free(encoder);
 }
@@ -392,11 +3665,21 @@ struct NV12MJPEGDecoder {
     AVCodecContext* codec_ctx;    // Hardware decoder context (persistent)
     AVFrame* frame;               // Pre-allocated frame
     AVPacket* pkt;                // Pre-allocated packet
+    TurboJpegDecoder* turbo;      // libjpeg-turbo decoder (NV12_MJPEG_DECODER_TURBOJPEG, no codec)
 };
 
 NV12MJPEGDecoder* decoder_create(void) {
+    return decoder_create_with_backend(NV12_MJPEG_DECODER_SOFTWARE);
+}
+
+NV12MJPEGDecoder* decoder_create_with_backend(NV12MJPEGDecoderBackend backend) {
     int ret;
     
+    if (backend != NV12_MJPEG_DECODER_SOFTWARE && backend != NV12_MJPEG_DECODER_TURBOJPEG) {
+        fprintf(stderr, "Invalid decoder backend: %d\n", backend);
+        return NULL;
+    }
+    
     // Allocate decoder context
     NV12MJPEGDecoder* decoder = (NV12MJPEGDecoder*)calloc(1, sizeof(NV12MJPEGDecoder));
     if (!decoder) {
@@ -404,6 +3687,16 @@ NV12MJPEGDecoder* decoder_create(void) {
         return NULL;
     }
     
+    // libjpeg-turbo decodes into the caller's planes: no codec, frame or packet
+    if (backend == NV12_MJPEG_DECODER_TURBOJPEG) {
+        decoder->turbo = turbo_jpeg_decoder_create();
+        if (!decoder->turbo) {
+            free(decoder);
+            return NULL;
+        }
+        return decoder;
+    }
+    
     // Find MJPEG decoder (use software decoder for reliability)
     decoder->codec = avcodec_find_decoder_by_name("mjpeg");
     if (!decoder->codec) {
@@ -453,18 +3746,100 @@ NV12MJPEGDecoder* decoder_create(void) {
     return decoder;
 }
 
-int decoder_decode_from_buffer(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_data, size_t mjpeg_size,
-                                uint8_t* out_nv12_buffer, size_t buffer_size,
+int decoder_set_tables(NV12MJPEGDecoder* decoder, const uint8_t* tables, size_t tables_size) {
+    int ret;
+    
+    // Validate parameters: a tables-only stream is SOI ... EOI
+    if (!decoder || !tables || tables_size < 4 || tables_size > NV12_MJPEG_MAX_TABLES_SIZE) {
+        return -EINVAL;
+    }
+    if (tables[0] != 0xFF || tables[1] != 0xD8 ||
+        tables[tables_size - 2] != 0xFF || tables[tables_size - 1] != 0xD9) {
+        fprintf(stderr, "Invalid tables-only JPEG stream\n");
+        return -EINVAL;
+    }
+    if (decoder->turbo) {
+        return turbo_jpeg_load_tables(decoder->turbo, tables, tables_size);
+    }
+    
+    // The mjpeg decoder keeps DQT/DHT across packets: decoding the tables-only
+    // stream loads them and produces no picture
+    decoder->pkt->data = (uint8_t*)tables;
+    decoder->pkt->size = tables_size;
+    ret = avcodec_send_packet(decoder->codec_ctx, decoder->pkt);
+    decoder->pkt->data = NULL;
+    decoder->pkt->size = 0;
+    if (ret < 0 && ret != AVERROR_INVALIDDATA) {
+        fprintf(stderr, "Error sending tables to decoder: %s\n", av_err2str(ret));
+        return ret;
+    }
+    
+    ret = avcodec_receive_frame(decoder->codec_ctx, decoder->frame);
+    if (ret == 0) {
+        av_frame_unref(decoder->frame);
+    }
+    return 0;
+}
+
+// Output planes for a decoded width x height picture: out_frame, or a
+// contiguous NV12 layout in out_nv12_buffer when out_frame is NULL
+static int decoder_output_planes(uint8_t* out_nv12_buffer, size_t buffer_size, const NV12FrameDesc* out_frame,
+                                 int width, int height, NV12FrameDesc* dst) {
+    if (out_frame) {
+        if (width > out_frame->width || height > out_frame->height) {
+            fprintf(stderr, "Output frame too small: need %dx%d, have %dx%d\n",
+                    width, height, out_frame->width, out_frame->height);
+            return -ENOMEM;
+        }
+        *dst = *out_frame;
+    } else {
+        size_t required_size = (size_t)width * height * 3 / 2;
+        if (buffer_size < required_size) {
+            fprintf(stderr, "Output buffer too small: need %zu bytes, have %zu bytes\n", 
+                    required_size, buffer_size);
+            return -ENOMEM;
+        }
+        nv12_frame_desc_init(dst, out_nv12_buffer, width, height);
+    }
+    return 0;
+}
+
+// libjpeg-turbo decodes Y straight into the output plane and interleaves chroma into UV
+static int decoder_decode_turbo(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_data, size_t mjpeg_size,
+                                uint8_t* out_nv12_buffer, size_t buffer_size, const NV12FrameDesc* out_frame,
                                 int* out_width, int* out_height) {
+    NV12FrameDesc dst;
+    
+    int ret = turbo_jpeg_read_header(decoder->turbo, mjpeg_data, mjpeg_size, out_width, out_height);
+    if (ret == 0) {
+        ret = decoder_output_planes(out_nv12_buffer, buffer_size, out_frame, *out_width, *out_height, &dst);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = turbo_jpeg_decode(decoder->turbo, mjpeg_data, mjpeg_size, dst.y, dst.y_stride, dst.uv, dst.uv_stride);
+    }
+    // Undecodable data reports like the mjpeg decoder's
+    return ret == -EINVAL ? AVERROR_INVALIDDATA : ret;
+}
+
+// Decode into a contiguous buffer (out_frame == NULL) or into the planes of out_frame
+static int decoder_decode_internal(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_data, size_t mjpeg_size,
+                                   uint8_t* out_nv12_buffer, size_t buffer_size, const NV12FrameDesc* out_frame,
+                                   int* out_width, int* out_height) {
     int ret;
+    NV12FrameDesc dst;
     
     // Validate parameters
-    if (!decoder || !mjpeg_data || !out_nv12_buffer || !out_width || !out_height) {
+    if (!decoder || !mjpeg_data || !out_width || !out_height) {
         return -EINVAL;
     }
     if (mjpeg_size == 0) {
         return -EINVAL;
     }
+    if (decoder->turbo) {
+        return decoder_decode_turbo(decoder, mjpeg_data, mjpeg_size, out_nv12_buffer, buffer_size, out_frame,
+                                    out_width, out_height);
+    }
     
     // Wrap input data in packet (no copy - just reference)
     decoder->pkt->data = (uint8_t*)mjpeg_data;
@@ -499,11 +3874,9 @@ int decoder_decode_from_buffer(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_d
     *out_height = decoder->frame->height;
     
     // Check if output buffer is large enough
-    size_t required_size = (size_t)(*out_width) * (*out_height) * 3 / 2;
-    if (buffer_size < required_size) {
-        fprintf(stderr, "Output buffer too small: need %zu bytes, have %zu bytes\n", 
-                required_size, buffer_size);
-        return -ENOMEM;
+    ret = decoder_output_planes(out_nv12_buffer, buffer_size, out_frame, *out_width, *out_height, &dst);
+    if (ret < 0) {
+        return ret;
     }
     
     // Check pixel format and convert if necessary
@@ -563,13 +3936,13 @@ int decoder_decode_from_buffer(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_d
         }
         
         // Copy converted NV12 data to output buffer
-        copy_frame_to_nv12_buffer(nv12_frame, out_nv12_buffer, *out_width, *out_height);
+        copy_frame_to_nv12_desc(nv12_frame, &dst, *out_width, *out_height);
         
         av_frame_free(&nv12_frame);
         sws_freeContext(sws_ctx);
     } else {
         // Direct copy if already NV12
-        copy_frame_to_nv12_buffer(decoder->frame, out_nv12_buffer, *out_width, *out_height);
+        copy_frame_to_nv12_desc(decoder->frame, &dst, *out_width, *out_height);
     }
     
     // Unreference frame for next use
@@ -578,6 +3951,25 @@ int decoder_decode_from_buffer(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_d
     return 0;
 }
 
+int decoder_decode_from_buffer(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_data, size_t mjpeg_size,
+                                uint8_t* out_nv12_buffer, size_t buffer_size,
+                                int* out_width, int* out_height) {
+    if (!out_nv12_buffer) {
+        return -EINVAL;
+    }
+    return decoder_decode_internal(decoder, mjpeg_data, mjpeg_size, out_nv12_buffer, buffer_size, NULL,
+                                   out_width, out_height);
+}
+
+int decoder_decode_to_frame(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_data, size_t mjpeg_size,
+                            const NV12FrameDesc* out_frame, int* out_width, int* out_height) {
+    if (!nv12_frame_desc_valid(out_frame)) {
+        return -EINVAL;
+    }
+    return decoder_decode_internal(decoder, mjpeg_data, mjpeg_size, NULL, 0, out_frame,
+                                   out_width, out_height);
+}
+
 void decoder_destroy(NV12MJPEGDecoder* decoder) {
     if (!decoder) {
         return;
@@ -592,6 +3984,7 @@ void decoder_destroy(NV12MJPEGDecoder* decoder) {
     if (decoder->codec_ctx) {
         avcodec_free_context(&decoder->codec_ctx);
     }
+    turbo_jpeg_decoder_destroy(decoder->turbo);
     
     free(decoder);
 }
@@ -634,6 +4027,19 @@ int64_t get_file_size(const char* filename) {
     return -1;
 }
 
+size_t nv12_mjpeg_slot_jpeg_size(const uint8_t* slot, size_t slot_size) {
+    size_t size = slot_size;
+    
+    // Padding is zero bytes and a JPEG ends with EOI (FF D9)
+    while (size > 0 && slot[size - 1] == 0) {
+        size--;
+    }
+    if (size < 4 || slot[size - 2] != 0xFF || slot[size - 1] != 0xD9) {
+        return 0;
+    }
+    return size;
+}
+
 // ============================================================================
 // File I/O Functions
 // ============================================================================
@@ -677,3 +4083,109 @@ int write_nv12_to_file(const char* filename, const uint8_t* buffer, int width, i
     
     return 0;
 }
+
+// Natural-order index of each zigzag position (ITU-T T.81 figure A.6)
+static const uint8_t quant_zigzag_to_natural[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Tables 0 and 1 from the DQT segments of a JPEG image (header only)
+static int read_quant_tables_jpeg(const uint8_t* data, size_t size, uint8_t luma[64], uint8_t chroma[64]) {
+    int found = 0;
+    size_t pos = 2;
+    
+    while (pos + 4 <= size && data[pos] == 0xFF) {
+        uint8_t marker = data[pos + 1];
+        size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        if (marker == 0xDA || marker == 0xD9 || length < 2 || pos + 2 + length > size) {
+            break;
+        }
+        if (marker == 0xDB) {
+            const uint8_t* p = data + pos + 4;
+            const uint8_t* end = data + pos + 2 + length;
+            while (p < end) {
+                int precision = *p >> 4;
+                int id = *p & 0x0F;
+                size_t table_size = 1 + 64 * (precision ? 2 : 1);
+                if ((size_t)(end - p) < table_size) {
+                    break;
+                }
+                if (id < 2) {
+                    uint8_t* table = id == 0 ? luma : chroma;
+                    for (int k = 0; k < 64; k++) {
+                        int q = precision ? (p[1 + 2 * k] << 8) | p[2 + 2 * k] : p[1 + k];
+                        table[quant_zigzag_to_natural[k]] = q > 255 ? 255 : q < 1 ? 1 : q;
+                    }
+                    found |= 1 << id;
+                }
+                p += table_size;
+            }
+        }
+        pos += 2 + length;
+    }
+    
+    if (!(found & 1)) {
+        return -1;
+    }
+    // Greyscale images only carry a luma table
+    if (!(found & 2)) {
+        memcpy(chroma, luma, 64);
+    }
+    return 0;
+}
+
+int read_quant_tables_from_file(const char* filename, uint8_t luma[64], uint8_t chroma[64]) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open quantization table file: %s\n", filename);
+        return -1;
+    }
+    
+    // A JPEG image's tables come before its first SOS, well within 64 KiB
+    uint8_t* data = (uint8_t*)malloc(65536);
+    if (!data) {
+        fclose(fp);
+        return -1;
+    }
+    size_t size = fread(data, 1, 65536, fp);
+    fclose(fp);
+    
+    int ret = -1;
+    if (size >= 2 && data[0] == 0xFF && data[1] == 0xD8) {
+        ret = read_quant_tables_jpeg(data, size, luma, chroma);
+        if (ret < 0) {
+            fprintf(stderr, "No quantization table found in JPEG file: %s\n", filename);
+        }
+    } else {
+        // Text: 64 luma then 64 chroma entries in natural order
+        char* text = (char*)data;
+        char* p = text;
+        int n = 0;
+        text[size < 65536 ? size : 65535] = '\0';
+        while (n < 128) {
+            char* end;
+            long q = strtol(p, &end, 10);
+            if (end == p || q < 1 || q > 255) {
+                break;
+            }
+            (n < 64 ? luma : chroma)[n % 64] = (uint8_t)q;
+            n++;
+            p = end;
+            while (*p && (*p == ',' || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+                p++;
+            }
+        }
+        if (n == 128) {
+            ret = 0;
+        } else {
+            fprintf(stderr, "Invalid quantization table file: %s (expected 128 values 1-255, got %d)\n",
+                    filename, n);
+        }
+    }
+    
+    free(data);
+    return ret;
+}
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,6 +64,54 @@ int read_nv12_from_file(const char* filename, uint8_t* buffer, int width, int he
  */
 int write_nv12_to_file(const char* filename, const uint8_t* buffer, int width, int height);
 
+/**
+ * Read luma and chroma quantization tables for encoder_set_quant_tables()
+ * 
+ * Accepts a JPEG image (its DQT tables 0 and 1; chroma falls back to luma,
+ * 16-bit entries are clamped to 255) or a text file of 128 numbers: the 64 luma
+ * then the 64 chroma entries in natural (row-major) order.
+ * 
+ * @param filename JPEG or text file path
+ * @param luma Luma table output (natural order)
+ * @param chroma Chroma table output (natural order)
+ * @return 0 on success, negative error code on failure
+ */
+int read_quant_tables_from_file(const char* filename, uint8_t luma[64], uint8_t chroma[64]);
+
+// ============================================================================
+// Frame Descriptors
+// ============================================================================
+
+/**
+ * NV12 frame in caller memory: Y and interleaved UV planes with their own
+ * row strides, in one allocation or two (camera buffers with row padding,
+ * DMA buffers with a separate chroma plane).
+ * 
+ * Encoders only read the planes; decoders write width bytes per row and
+ * leave the stride padding untouched.
+ */
+typedef struct NV12FrameDesc {
+    int width;                    // Frame width in pixels
+    int height;                   // Frame height in pixels (even)
+    uint8_t* y;                   // Y plane (height rows)
+    int y_stride;                 // Y row stride in bytes (>= width)
+    uint8_t* uv;                  // Interleaved UV plane (height/2 rows)
+    int uv_stride;                // UV row stride in bytes (>= width)
+} NV12FrameDesc;
+
+/**
+ * NV12 frame in a buffer shared by file descriptor (dma-buf from the camera/ISP,
+ * memfd, shared memory): plane offsets and strides within the buffer.
+ */
+typedef struct NV12FrameFd {
+    int fd;                       // Buffer file descriptor (not taken over)
+    size_t size;                  // Buffer size in bytes (0 = size reported by fstat)
+    size_t y_offset;              // Offset of the Y plane in the buffer
+    int y_stride;                 // Y row stride in bytes (>= width)
+    size_t uv_offset;             // Offset of the interleaved UV plane in the buffer
+    int uv_stride;                // UV row stride in bytes (>= width)
+} NV12FrameFd;
+
 // ============================================================================
 // Persistent Encoder Context (New API for Resident Services)
 // ============================================================================
@@ -75,22 +124,397 @@ int write_nv12_to_file(const char* filename, const uint8_t* buffer, int width, i
  */
 typedef struct NV12MJPEGEncoder NV12MJPEGEncoder;
 
+/**
+ * Encoder backend selection
+ */
+typedef enum NV12MJPEGBackend {
+    NV12_MJPEG_BACKEND_RKMPP = 0,     // Rockchip MPP hardware encoder (mjpeg_rkmpp), default
+    NV12_MJPEG_BACKEND_SOFTWARE,      // libavcodec software encoder (mjpeg), runs on any CPU
+    NV12_MJPEG_BACKEND_NATIVE,        // Built-in SIMD baseline JPEG encoder, reads NV12 directly
+    NV12_MJPEG_BACKEND_SIMULATED,     // mjpeg_rkmpp behavior and timing model on the software encoder (load testing)
+    NV12_MJPEG_BACKEND_TURBOJPEG,     // libjpeg-turbo planar YUV encoder (make TURBOJPEG=1), reads NV12 directly
+} NV12MJPEGBackend;
+
+/**
+ * Maximum encode engines of the simulated device (NV12MJPEGSimulation.cores)
+ */
+#define NV12_MJPEG_SIM_MAX_CORES 16
+
+/**
+ * Timing model of NV12_MJPEG_BACKEND_SIMULATED
+ * 
+ * A frame occupies the simulated hardware for latency_ms, scaled by its pixel
+ * count relative to 1920x1080, plus Gaussian jitter (jitter_ms standard
+ * deviation). With probability tail_probability a frame also stalls for an
+ * exponentially distributed time of mean tail_ms (bus contention, IOMMU
+ * faults). Each encoder is one session: its frames are processed one at a
+ * time, in order. Sessions of all simulated encoders in the process share
+ * `cores` engines, so frames wait for a free engine when they are busy.
+ * 
+ * cores and max_sessions describe the shared device: give every simulated
+ * encoder the same values. The defaults are placeholders; calibrate them
+ * against the rkmpp backend's stats on the target board.
+ */
+typedef struct NV12MJPEGSimulation {
+    double latency_ms;            // Mean hardware time of a 1920x1080 frame (default: 4.0)
+    double jitter_ms;             // Standard deviation of the hardware time (default: 0.3)
+    double tail_probability;      // Share of frames that stall, 0-1 (default: 0.01)
+    double tail_ms;               // Mean extra time of a stalled frame (default: 10.0)
+    int cores;                    // Frames the device encodes at once (1-16, default: 1)
+    int max_sessions;             // Simulated encoders open at once, encoder_create() fails beyond (default: 8)
+    uint32_t seed;                // Seed of this encoder's random latencies (default: 1)
+} NV12MJPEGSimulation;
+
+/**
+ * Maximum number of frames in flight for encoder_submit()
+ */
+#define NV12_MJPEG_MAX_QUEUE_DEPTH 64
+
+/**
+ * Maximum number of restart-interval strips per frame
+ */
+#define NV12_MJPEG_MAX_STRIPS 32
+
+/**
+ * Max size of a tables-only JPEG stream (encoder_get_tables())
+ */
+#define NV12_MJPEG_MAX_TABLES_SIZE 2048
+
+// Max qualities per encoder_encode_multi_quality() call
+#define NV12_MJPEG_MAX_QUALITY_LEVELS 4
+
+/**
+ * Maximum statistics window of NV12_MJPEG_HUFFMAN_STREAM (frames)
+ */
+#define NV12_MJPEG_MAX_HUFFMAN_WINDOW 16
+
+/**
+ * Huffman table selection
+ */
+typedef enum NV12MJPEGHuffman {
+    NV12_MJPEG_HUFFMAN_STANDARD = 0,  // Standard tables (ITU-T T.81 Annex K), default
+    NV12_MJPEG_HUFFMAN_FRAME,         // Tables optimized for each frame (two passes)
+    NV12_MJPEG_HUFFMAN_STREAM,        // Tables optimized for the previous frames (one pass)
+} NV12MJPEGHuffman;
+
+/**
+ * Static-scene deduplication mode (encoder_set_dedup())
+ */
+typedef enum NV12MJPEGDedup {
+    NV12_MJPEG_DEDUP_OFF = 0,         // Encode every frame, default
+    NV12_MJPEG_DEDUP_EXACT,           // Hash of every byte: identical frames only
+    NV12_MJPEG_DEDUP_SAMPLED,         // Hash of every 4th row: faster, misses changes confined to other rows
+    NV12_MJPEG_DEDUP_THRESHOLD,       // Every macroblock's mean Y/U/V within a threshold of the last encoded frame
+} NV12MJPEGDedup;
+
+/**
+ * What happens to a frame with too little motion (encoder_set_motion_gate())
+ */
+typedef enum NV12MJPEGMotionAction {
+    NV12_MJPEG_MOTION_SKIP = 0,       // Not encoded: out_size 0 (an empty slot in slot mode)
+    NV12_MJPEG_MOTION_REDUCE,         // Encoded at reduced_quality
+} NV12MJPEGMotionAction;
+
+/**
+ * Motion gate parameters
+ */
+typedef struct NV12MJPEGMotionGate {
+    int block_sad;                // Luma SAD of a 16x16 block against the last encoded frame at
+                                  // which the block counts as changed (e.g. 4 * 256 = mean change 4)
+    double min_changed;           // Frames with a lower changed-block fraction are gated (0-1)
+    NV12MJPEGMotionAction action; // Skip or encode cheaper
+    int reduced_quality;          // NV12_MJPEG_MOTION_REDUCE: quality of gated frames (1-99, as encoder_create())
+} NV12MJPEGMotionGate;
+
+/**
+ * Encoder creation options
+ * 
+ * Always initialize with encoder_options_init() before changing fields, so that
+ * options added in later versions get their defaults.
+ */
+typedef struct NV12MJPEGEncoderOptions {
+    int width;                    // Frame width in pixels
+    int height;                   // Frame height in pixels
+    int quality;                  // Quality parameter (1-99, higher is better quality, libjpeg q_factor)
+    NV12MJPEGBackend backend;     // Encoder backend (default: NV12_MJPEG_BACKEND_RKMPP)
+    int queue_depth;              // Frames in flight for encoder_submit() (1-64, default: 4)
+    int verbose;                  // Print configuration and per-frame timing logs (default: 1)
+    int strips;                   // Horizontal strips encoded in parallel per frame (1-32, default: 1)
+    int abbreviated;              // Omit DQT/DHT from frames, see encoder_get_tables() (default: 0)
+    NV12MJPEGHuffman huffman;     // Huffman tables (default: NV12_MJPEG_HUFFMAN_STANDARD)
+    int huffman_window;           // Frames of statistics for NV12_MJPEG_HUFFMAN_STREAM (1-16, default: 8)
+    int hot_spare;                // Keep a standby codec context for failover, see encoder_inject_fault() (default: 0)
+    NV12MJPEGSimulation simulation;  // Timing model of NV12_MJPEG_BACKEND_SIMULATED
+} NV12MJPEGEncoderOptions;
+
+/**
+ * Initialize encoder options with defaults
+ * 
+ * @param opts Options to initialize
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ * @param quality Quality parameter (1-99, higher is better quality)
+ */
+void encoder_options_init(NV12MJPEGEncoderOptions* opts, int width, int height, int quality);
+
 /**
  * Create persistent MJPEG encoder with pre-allocated resources
  * 
  * Initializes Rockchip hardware encoder and allocates all buffers upfront.
- * The encoder is bound to specific width/height/quality parameters.
- * To change parameters, destroy and recreate the encoder.
+ * The encoder is bound to specific width/height parameters. Quality can be
+ * changed later with encoder_set_quality(); to change the resolution, destroy
+ * and recreate the encoder.
+ * 
+ * Quality is a JPEG q_factor on one scale for every backend: 1-99, higher is
+ * better, scaling the Annex K tables like libjpeg and MPP (50 uses them as
+ * given, 75 at half their step). Each backend converts it to its own scale.
  * 
  * @param width Frame width in pixels
  * @param height Frame height in pixels
- * @param quality Quality parameter (1-31, lower is better quality)
+ * @param quality Quality parameter (1-99, higher is better quality)
  * @return Encoder context, or NULL on failure
  * 
  * Note: Not thread-safe. Each thread needs its own encoder instance.
  */
 NV12MJPEGEncoder* encoder_create(int width, int height, int quality);
 
+/**
+ * Create persistent MJPEG encoder from options
+ * 
+ * Same as encoder_create(), but allows selecting the backend. The rkmpp
+ * backend passes quality to MPP as its q_factor. The software backend accepts
+ * the same NV12 input and converts quality to mjpeg's qscale, which scales
+ * the tables by qscale/8 (qscale 8 at quality 50, 4 at 75, 1 from 91 up and
+ * 31 at 13 and below), so it has fewer distinct steps than the q_factor.
+ * 
+ * The native backend needs no codec: it encodes 4:2:0 baseline JPEG directly
+ * from the NV12 planes (SIMD DCT/quantization: AVX2/SSE2 or NEON), building
+ * its tables from quality with libjpeg scaling. Zero-copy input is released
+ * as soon as the encode call returns, and submitted frames complete
+ * immediately.
+ * 
+ * The TurboJPEG backend (built with make TURBOJPEG=1) needs no codec either:
+ * libjpeg-turbo encodes the Y plane in place through its planar YUV
+ * interface, after the UV plane is deinterleaved (SSE2/NEON), so no RGB
+ * conversion happens. Quality, zero-copy input and submitted frames behave as
+ * with the native backend. Width and height must be even. It cannot write
+ * abbreviated frames or use custom quantization tables.
+ * 
+ * strips > 1 cuts a single frame's latency on multi-core CPUs. The native
+ * backend encodes that many MCU-row strips concurrently and joins them with
+ * restart markers (DRI/RSTn, one interval per MCU row). The software backend
+ * uses as many slice threads. The rkmpp and TurboJPEG backends ignore it.
+ * 
+ * huffman selects optimized Huffman tables, typically 2-20% smaller frames at
+ * identical image quality (more at lower qualities). With the native backend,
+ * NV12_MJPEG_HUFFMAN_FRAME quantizes the frame in a statistics pass and
+ * entropy codes it in a second pass with tables built for it;
+ * NV12_MJPEG_HUFFMAN_STREAM encodes in one pass with tables built from the
+ * last huffman_window frames, nearly as small at almost no extra cost for
+ * continuous video. The saving is reported in NV12MJPEGEncoderStats. The
+ * software backend uses libavcodec's per-frame optimal tables for both modes;
+ * the rkmpp and TurboJPEG backends ignore it. Cannot be combined with abbreviated output.
+ * 
+ * The simulated backend stands in for mjpeg_rkmpp where no board is
+ * available (pool, queueing and scheduling tests on CI machines). It behaves
+ * like the rkmpp backend: quality is applied when the codec is opened (no
+ * per-frame quality, rate control or custom tables). The frames are valid
+ * JPEGs from libavcodec's mjpeg encoder with the libjpeg-scaled Annex K
+ * tables of that q_factor, so output sizes follow the QP the way MPP's do.
+ * Each packet is held back until the completion time drawn from
+ * opts->simulation, both for synchronous encodes and for encoder_submit(),
+ * whose frames complete asynchronously. Creation fails while max_sessions
+ * simulated encoders are open. The software encode itself runs on the
+ * calling thread; when it takes longer than the modeled time the packet is
+ * late and the stats count an overrun.
+ * 
+ * @param opts Options initialized with encoder_options_init()
+ * @return Encoder context, or NULL on failure
+ */
+NV12MJPEGEncoder* encoder_create_with_options(const NV12MJPEGEncoderOptions* opts);
+
+/**
+ * Change encoder quality, effective from the next frame
+ * 
+ * The native backend swaps its quantization tables in place and the software
+ * and TurboJPEG backends pass the new quality with each frame, so none of
+ * them reopens a codec.
+ * mjpeg_rkmpp applies its q_factor when opened, so the rkmpp backend reopens
+ * the codec context (frames and buffers are kept).
+ * 
+ * @param encoder Encoder context
+ * @param quality New quality (same range and meaning as encoder_create())
+ * @return 0 on success, -EINVAL on invalid parameters,
+ *         -EBUSY if the rkmpp backend has frames in flight
+ */
+int encoder_set_quality(NV12MJPEGEncoder* encoder, int quality);
+
+/**
+ * Override quality for the next encoded or submitted frame only
+ * 
+ * The frame after it uses the quality from encoder_set_quality() again.
+ * Not supported by the rkmpp backend (it cannot change QP without reopening).
+ * 
+ * @param encoder Encoder context
+ * @param quality Quality for the next frame (0 cancels a pending override)
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOTSUP on the rkmpp backend
+ */
+int encoder_set_frame_quality(NV12MJPEGEncoder* encoder, int quality);
+
+/**
+ * Replace the standard (Annex K) quantization tables, e.g. with perceptually
+ * tuned tables or those of a reference JPEG (see read_quant_tables_from_file())
+ * 
+ * Quality keeps scaling the tables: the native backend scales them like
+ * libjpeg (quality 50 uses them as given), the software backend by qscale/8
+ * with a fixed DC step. Existing ROI encoders follow, and in abbreviated mode
+ * the next frame is complete with the new tables. The rate-control model is
+ * refitted. Not supported by the rkmpp backend (mjpeg_rkmpp only takes a
+ * q_factor) or the TurboJPEG backend (TurboJPEG only takes a quality).
+ * 
+ * @param encoder Encoder context
+ * @param luma 64 luma entries in natural (row-major) order, 1-255 (NULL with chroma NULL = standard tables)
+ * @param chroma 64 chroma entries in natural order, 1-255
+ * @return 0 on success, -EINVAL on invalid tables, -ENOTSUP on the rkmpp and TurboJPEG backends,
+ *         -EBUSY if the software backend has frames in flight
+ */
+int encoder_set_quant_tables(NV12MJPEGEncoder* encoder, const uint8_t* luma, const uint8_t* chroma);
+
+/**
+ * Limit the encoded size of each frame (size-targeted rate control)
+ * 
+ * Before each synchronous encode (encoder_encode_to_buffer(),
+ * encoder_encode_packet()) the encoder measures the frame's luma activity and
+ * picks the quality predicted to fit the target from a size model fitted on
+ * the previous frames. If the result is still too large, the frame is encoded
+ * once more at a lower quality. The quality set with encoder_set_quality()
+ * is the highest quality used, and per-frame overrides are replaced.
+ * Asynchronous and zero-copy encodes are not rate controlled.
+ * 
+ * Not supported by the rkmpp backend (it cannot change QP per frame).
+ * 
+ * @param encoder Encoder context
+ * @param target_bytes Max encoded size per frame in bytes (0 = fixed quality)
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOTSUP on the rkmpp backend
+ */
+int encoder_set_target_size(NV12MJPEGEncoder* encoder, size_t target_bytes);
+
+/**
+ * Encode every frame to exactly slot_bytes (constant-size slot output)
+ * 
+ * Rate control as in encoder_set_target_size() with the slot as target, but
+ * an oversized frame is re-encoded at lower qualities until it fits, and the
+ * rest of the slot is filled with zero bytes after EOI. A recording is then
+ * an array of fixed-size records: frame n starts at n * slot_bytes, with no
+ * index. nv12_mjpeg_slot_jpeg_size() recovers the JPEG length of a slot.
+ * 
+ * encoder_encode_to_buffer() and encoder_encode_frame() return slot_bytes in
+ * out_size (buffers must hold a slot); encoder_encode_packet() returns the
+ * unpadded JPEG, which always fits a slot. A frame that does not fit even at
+ * the lowest quality fails with -ENOSPC. encoder_set_target_size() ends slot mode.
+ * 
+ * Not supported by the rkmpp backend (it cannot change QP per frame).
+ * 
+ * @param encoder Encoder context
+ * @param slot_bytes Slot size in bytes (0 = off, fixed quality)
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOTSUP on the rkmpp backend
+ */
+int encoder_set_slot_size(NV12MJPEGEncoder* encoder, size_t slot_bytes);
+
+/**
+ * Skip encoding frames that match the last encoded frame (static scenes)
+ * 
+ * encoder_encode_to_buffer() and encoder_encode_frame() measure each frame
+ * first; a match returns a copy of the last output without running the
+ * encoder. Matches are judged against the last frame actually encoded, so a
+ * slowly changing scene is still re-encoded once it drifts past the
+ * threshold. Quality, table and size target changes invalidate the last
+ * output, and frames with a per-frame quality override are always encoded.
+ * 
+ * @param encoder Encoder context
+ * @param mode Comparison mode (NV12_MJPEG_DEDUP_OFF disables)
+ * @param threshold NV12_MJPEG_DEDUP_THRESHOLD: max change of a macroblock's mean
+ *                  level (0-255, 0 = same means); ignored by the other modes
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOMEM
+ */
+int encoder_set_dedup(NV12MJPEGEncoder* encoder, NV12MJPEGDedup mode, int threshold);
+
+/**
+ * Gate encodes on motion (fixed cameras: noise, clock overlays)
+ * 
+ * encoder_encode_to_buffer() and encoder_encode_frame() compute the luma SAD
+ * of every 16x16 block against the last encoded frame (SSE2/NEON, in the
+ * same pass that copies the luma into the next reference). When fewer than
+ * gate->min_changed of the blocks reach gate->block_sad, the frame is skipped
+ * or encoded at gate->reduced_quality (never above the quality rate control
+ * picked). Only frames that pass the gate become the reference (skipped and
+ * reduced frames do not), so slow changes add up until they pass the gate. The first frame and frames with a per-frame
+ * quality override are always encoded. Scores are in the encoder stats.
+ * Needs two luma planes of memory.
+ * 
+ * @param encoder Encoder context
+ * @param gate Gate parameters (NULL disables gating)
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOMEM,
+ *         -ENOTSUP for NV12_MJPEG_MOTION_REDUCE on the rkmpp backend
+ */
+int encoder_set_motion_gate(NV12MJPEGEncoder* encoder, const NV12MJPEGMotionGate* gate);
+
+/**
+ * Make the next codec sends fail as an MPP timeout would (AVERROR(ETIMEDOUT)),
+ * to exercise recovery on any machine with the software backend
+ *
+ * With opts->hot_spare set, synchronous encodes that fail switch to a
+ * standby codec context opened at create time and retry the frame once at
+ * the same quality; the failed context is closed and a new standby opened on
+ * a background thread. Without a standby (disabled, or the rebuild failed)
+ * the error is returned as before. The encoder stats report the failovers,
+ * the swap + retry time and the background rebuild time. Asynchronous
+ * encodes are not retried.
+ *
+ * @param encoder Encoder context
+ * @param count Number of sends to fail (0 cancels pending faults)
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOTSUP for the native and TurboJPEG backends
+ */
+int encoder_inject_fault(NV12MJPEGEncoder* encoder, int count);
+
+/**
+ * Same as encoder_set_target_size(), with the target given as a compression ratio
+ * 
+ * @param encoder Encoder context
+ * @param ratio Min compression ratio (raw NV12 size / encoded size, e.g. 3.0; 0 = fixed quality)
+ * @return 0 on success, negative error code on failure
+ */
+int encoder_set_target_ratio(NV12MJPEGEncoder* encoder, double ratio);
+
+/**
+ * Get the tables-only JPEG stream of an abbreviated-mode encoder
+ * 
+ * With opts->abbreviated set, frames are abbreviated JPEGs (no DQT/DHT) as
+ * defined by the JPEG abbreviated format, and this tables-only stream (SOI,
+ * DQT, DHT, EOI) is stored or sent once per session. Decoders load it with
+ * decoder_set_tables(). The first frame, and the first frame after a quality
+ * change, is complete and updates the tables; fetch them again after
+ * changing quality. Packet sizes then no longer include the several hundred
+ * bytes of tables.
+ * 
+ * @param encoder Encoder context (created with opts->abbreviated)
+ * @param out_buffer Output buffer (NV12_MJPEG_MAX_TABLES_SIZE bytes is always enough)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store the stream size (required size on -ENOMEM)
+ * @return 0 on success, -EAGAIN if no frame has been encoded yet,
+ *         -ENOMEM if buffer is too small, -EINVAL if not in abbreviated mode
+ */
+int encoder_get_tables(const NV12MJPEGEncoder* encoder, uint8_t* out_buffer, size_t buffer_size,
+                       size_t* out_size);
+
+/**
+ * Get configured quality
+ * 
+ * @param encoder Encoder context
+ * @return Quality, or -EINVAL if encoder is NULL
+ */
+int encoder_get_quality(const NV12MJPEGEncoder* encoder);
+
 /**
  * Encode NV12 frame to MJPEG in user-provided buffer
  * 
@@ -109,6 +533,420 @@ NV12MJPEGEncoder* encoder_create(int width, int height, int quality);
 int encoder_encode_to_buffer(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
                               uint8_t* out_buffer, size_t buffer_size, size_t* out_size);
 
+/**
+ * Encode NV12 frame with arbitrary plane layout to MJPEG in user-provided buffer
+ * 
+ * Same as encoder_encode_to_buffer() without requiring a contiguous buffer with
+ * stride == width: the native backend reads the planes in place, the codec
+ * backends copy them once into the input frame with the given strides.
+ * 
+ * @param encoder Encoder context from encoder_create()
+ * @param frame Input frame (width/height must match the encoder)
+ * @param out_buffer Output buffer (pre-allocated by user)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size
+ * @return 0 on success, negative error code on failure (same codes as
+ *         encoder_encode_to_buffer())
+ */
+int encoder_encode_frame(NV12MJPEGEncoder* encoder, const NV12FrameDesc* frame,
+                         uint8_t* out_buffer, size_t buffer_size, size_t* out_size);
+
+/**
+ * Encode NV12 frame from a file-descriptor buffer to MJPEG in user-provided buffer
+ * 
+ * The buffer is mapped read-only on first use and the mapping is cached per fd
+ * (a few buffers, least recently used is unmapped first), so frames cycling
+ * through a buffer pool are imported without a syscall-heavy map per frame.
+ * A cached mapping is only reused for the same underlying buffer, so closing
+ * an fd and getting its number back for another buffer is safe, and a buffer
+ * whose size changed is mapped again. dma-buf reads are bracketed with
+ * DMA_BUF_IOCTL_SYNC; if either sync fails, so does the frame.
+ * 
+ * @param encoder Encoder context from encoder_create()
+ * @param frame Input buffer and plane layout (frame size is the encoder size)
+ * @param out_buffer Output buffer (pre-allocated by user)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size
+ * @return 0 on success, negative error code on failure (same codes as
+ *         encoder_encode_to_buffer(); -EINVAL also if the fd cannot be mapped
+ *         or the planes exceed the buffer; the ioctl's error if a dma-buf
+ *         sync fails)
+ */
+int encoder_encode_fd(NV12MJPEGEncoder* encoder, const NV12FrameFd* frame,
+                      uint8_t* out_buffer, size_t buffer_size, size_t* out_size);
+
+/**
+ * Drop the cached mapping of a frame buffer fd (e.g. before the buffer pool is
+ * freed); mappings are otherwise released by encoder_destroy()
+ * 
+ * @param encoder Encoder context
+ * @param fd Buffer file descriptor passed to encoder_encode_fd()
+ */
+void encoder_release_fd(NV12MJPEGEncoder* encoder, int fd);
+
+/**
+ * Release callback for caller-owned input buffers
+ * 
+ * @param opaque User pointer passed alongside the buffer
+ * @param data The buffer that is no longer referenced by the encoder
+ */
+typedef void (*nv12_buffer_release_fn)(void* opaque, uint8_t* data);
+
+/**
+ * Encode NV12 frame without copying it into the encoder
+ * 
+ * The caller's buffer is wrapped as the refcounted backing storage of the input
+ * frame. The buffer must stay valid and unmodified until release(opaque, nv12_data)
+ * is called, which happens once the codec drops its last reference (possibly after
+ * this function returns). With the software backend the Y plane is used in place
+ * and only the chroma is deinterleaved into encoder-owned planes.
+ * 
+ * @param encoder Encoder context from encoder_create()
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes, stride == width)
+ * @param release Called when the buffer is no longer referenced; if NULL the buffer
+ *                must stay valid until encoder_destroy()
+ * @param opaque User pointer passed to release
+ * @param out_buffer Output buffer (pre-allocated by user)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size
+ * @return 0 on success, negative error code on failure (same codes as
+ *         encoder_encode_to_buffer()). On -EINVAL the buffer is not taken and
+ *         release is not called.
+ */
+int encoder_encode_zero_copy(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                             nv12_buffer_release_fn release, void* opaque,
+                             uint8_t* out_buffer, size_t buffer_size, size_t* out_size);
+
+/**
+ * Encode a region of interest of a larger NV12 frame
+ * 
+ * Reads only the region (source strides, no full-frame copy) and encodes it
+ * as a standalone JPEG of width x height. Encoder resources are created per
+ * crop size on first use and reused; the last four sizes stay cached. Uses
+ * the encoder's backend and current quality.
+ * 
+ * @param encoder Encoder context
+ * @param nv12_data Source NV12 frame (src_width*src_height*3/2 bytes, unpadded)
+ * @param src_width Source frame width in pixels
+ * @param src_height Source frame height in pixels
+ * @param x ROI left edge (multiple of 16, MCU-aligned)
+ * @param y ROI top edge (multiple of 16, MCU-aligned)
+ * @param width ROI width (even, x + width <= src_width)
+ * @param height ROI height (even, y + height <= src_height)
+ * @param out_buffer Output buffer for MJPEG data
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size (required size on -ENOMEM)
+ * @return 0 on success, negative error code on failure
+ */
+int encoder_encode_roi(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, int src_width, int src_height,
+                       int x, int y, int width, int height,
+                       uint8_t* out_buffer, size_t buffer_size, size_t* out_size);
+
+/**
+ * Encode a frame and a downscaled thumbnail of it in one call
+ * 
+ * The thumbnail planes (box filter) are produced in the same pass that reads
+ * the input for the full frame, so the input is read from memory once. The
+ * thumbnail is (width / thumb_scale) x (height / thumb_scale), rounded down
+ * to even, and is encoded with a cached encoder of that size at the same
+ * quality.
+ * 
+ * @param encoder Encoder context (no frames in flight)
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param thumb_scale Thumbnail scale denominator (2, 4 or 8)
+ * @param out_buffer Output buffer for the full-resolution MJPEG
+ * @param buffer_size Size of out_buffer in bytes
+ * @param out_size Pointer to store the full-resolution encoded size
+ * @param thumb_buffer Output buffer for the thumbnail MJPEG
+ * @param thumb_buffer_size Size of thumb_buffer in bytes
+ * @param thumb_size Pointer to store the thumbnail encoded size
+ * @return 0 on success, negative error code on failure
+ */
+int encoder_encode_with_thumbnail(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, int thumb_scale,
+                                  uint8_t* out_buffer, size_t buffer_size, size_t* out_size,
+                                  uint8_t* thumb_buffer, size_t thumb_buffer_size, size_t* thumb_size);
+
+/**
+ * Encode one NV12 frame at several qualities (e.g. archive, live, low bandwidth)
+ * 
+ * With the native backend the frame is read and transformed (DCT) once; each
+ * quality only repeats quantization and entropy coding. The software backend
+ * encodes the frame once per quality without reopening the codec. mjpeg_rkmpp
+ * fixes its quality at open and returns -ENOTSUP unless every quality equals
+ * the configured one. Outputs are complete JPEGs (abbreviated mode does not
+ * apply); rate control is bypassed.
+ * 
+ * @param encoder Encoder context (no frames in flight)
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param qualities Quality per output (1-99)
+ * @param count Number of outputs (1..NV12_MJPEG_MAX_QUALITY_LEVELS)
+ * @param out_buffers Output buffer per quality
+ * @param buffer_sizes Size of each output buffer in bytes
+ * @param out_sizes Encoded size per quality
+ * @return 0 on success, negative error code on failure (same codes as
+ *         encoder_encode_to_buffer(); -ENOTSUP, see above)
+ */
+int encoder_encode_multi_quality(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                                 const int* qualities, int count, uint8_t* const out_buffers[],
+                                 const size_t buffer_sizes[], size_t out_sizes[]);
+
+// ============================================================================
+// Asynchronous Encoding (submit/poll)
+// ============================================================================
+//
+// encoder_submit() copies a frame into one of queue_depth input slots and sends
+// it to the codec without waiting for the result, so the copy and send of the
+// next frame overlap with the hardware encoding the previous ones. Packets are
+// returned in submission order by encoder_poll() or a completion callback.
+// The session is never flushed by polling; call encoder_drain() at end of stream. Do not call the synchronous
+// encode functions while frames are in flight (they return -EBUSY).
+
+/**
+ * Completion callback for asynchronous encoding
+ * 
+ * @param opaque User pointer given to encoder_set_completion_callback()
+ * @param frame_user_data User pointer given to encoder_submit() for this frame
+ * @param status 0 on success, negative error code on failure
+ * @param data Encoded MJPEG data, valid only during the callback
+ * @param size Encoded size in bytes
+ */
+typedef void (*nv12_mjpeg_completion_fn)(void* opaque, void* frame_user_data, int status,
+                                         const uint8_t* data, size_t size);
+
+/**
+ * Submit NV12 frame for asynchronous encoding
+ * 
+ * The input is copied before returning, so nv12_data can be reused immediately.
+ * 
+ * @param encoder Encoder context
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param user_data Pointer handed back with the encoded frame
+ * @return 0 on success, negative error code on failure
+ * 
+ * Error codes:
+ *   -EINVAL: Invalid parameters
+ *   -EAGAIN: queue_depth frames already in flight, poll first
+ *   <0: FFmpeg error code
+ */
+int encoder_submit(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, void* user_data);
+
+/**
+ * Retrieve the next encoded frame in submission order
+ * 
+ * @param encoder Encoder context (without completion callback)
+ * @param out_buffer Output buffer (pre-allocated by user)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size
+ * @param user_data Pointer to store the frame's user_data (can be NULL)
+ * @param timeout_ms Maximum time to wait for the encoder, 0 to return immediately
+ * @return 0 on success, negative error code on failure
+ * 
+ * Error codes:
+ *   -EINVAL: Invalid parameters, or a completion callback is set
+ *   -EAGAIN: No frame finished within timeout_ms (or none in flight)
+ *   -ENOMEM: Output buffer too small (*out_size holds the required size,
+ *            the frame stays queued)
+ *   <0: FFmpeg error code
+ */
+int encoder_poll(NV12MJPEGEncoder* encoder, uint8_t* out_buffer, size_t buffer_size,
+                 size_t* out_size, void** user_data, int timeout_ms);
+
+/**
+ * Deliver finished frames through a callback instead of encoder_poll()
+ * 
+ * Finished frames are delivered from inside encoder_submit() (without waiting)
+ * and encoder_poll_completions(), on the calling thread.
+ * 
+ * @param encoder Encoder context
+ * @param cb Completion callback, or NULL to switch back to encoder_poll()
+ * @param opaque User pointer passed to cb
+ * @return 0 on success, -EBUSY if frames are in flight, -EINVAL on invalid parameters
+ */
+int encoder_set_completion_callback(NV12MJPEGEncoder* encoder, nv12_mjpeg_completion_fn cb, void* opaque);
+
+/**
+ * Wait for finished frames and deliver them to the completion callback
+ * 
+ * @param encoder Encoder context with completion callback
+ * @param timeout_ms Maximum time to wait, 0 to return immediately
+ * @return Number of frames delivered, or negative error code
+ */
+int encoder_poll_completions(NV12MJPEGEncoder* encoder, int timeout_ms);
+
+/**
+ * End the stream: make the codec release every frame it still holds
+ * 
+ * Some encoders keep a frame back until the next one arrives. Call this after
+ * the last encoder_submit() so every frame becomes available to encoder_poll()
+ * (or is delivered to the completion callback). The codec session is reset
+ * afterwards, so the encoder can be used again.
+ * 
+ * @param encoder Encoder context
+ * @return 0 on success, negative error code on failure
+ */
+int encoder_drain(NV12MJPEGEncoder* encoder);
+
+/**
+ * Get number of submitted frames not yet returned to the caller
+ * 
+ * @param encoder Encoder context
+ * @return Frames in flight
+ */
+int encoder_frames_in_flight(const NV12MJPEGEncoder* encoder);
+
+// ============================================================================
+// Refcounted Output Packets
+// ============================================================================
+//
+// Instead of copying the encoded frame into a caller buffer, these functions
+// hand out a reference to the codec's own packet buffer. Several consumers
+// (file writer, network sender, pre-event ring) can share one JPEG by taking
+// their own reference with nv12_mjpeg_packet_ref(); the bytes are freed when
+// the last reference is released. References can be released from any thread
+// and may outlive the encoder. With the rkmpp backend a reference can pin a
+// hardware output buffer, so release packets promptly.
+
+/**
+ * Refcounted encoded frame
+ */
+typedef struct NV12MJPEGPacket {
+    const uint8_t* data;          // Encoded MJPEG data (read-only, shared)
+    size_t size;                  // Encoded size in bytes
+    int64_t pts;                  // Frame number assigned by the encoder
+    void* buf;                    // Internal buffer reference, do not use
+} NV12MJPEGPacket;
+
+/**
+ * Encode NV12 frame and return a reference to the encoded packet (no output copy)
+ * 
+ * @param encoder Encoder context (no frames in flight)
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param out_pkt Receives the new packet reference (release with nv12_mjpeg_packet_release())
+ * @return 0 on success, negative error code on failure (-EBUSY while frames are in flight)
+ */
+int encoder_encode_packet(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data, NV12MJPEGPacket** out_pkt);
+
+/**
+ * Get next packet of an asynchronous stream as a reference (no output copy)
+ * 
+ * Same as encoder_poll(), but returns the packet instead of copying it.
+ * 
+ * @param encoder Encoder context (no completion callback set)
+ * @param out_pkt Receives the new packet reference (release with nv12_mjpeg_packet_release())
+ * @param user_data Receives the user pointer given to encoder_submit() (can be NULL)
+ * @param timeout_ms Max time to wait for a packet (0 = don't wait)
+ * @return 0 on success, -EAGAIN if nothing is ready within timeout_ms,
+ *         -EINVAL if a completion callback is set, other negative codes on failure
+ */
+int encoder_poll_packet(NV12MJPEGEncoder* encoder, NV12MJPEGPacket** out_pkt, void** user_data,
+                        int timeout_ms);
+
+/**
+ * Take another reference to a packet (for an additional consumer)
+ * 
+ * @param pkt Packet reference
+ * @return New reference to the same data, or NULL on allocation failure
+ */
+NV12MJPEGPacket* nv12_mjpeg_packet_ref(const NV12MJPEGPacket* pkt);
+
+/**
+ * Release a packet reference; data is freed with the last reference
+ * 
+ * @param pkt Pointer to packet reference (set to NULL; can point to NULL)
+ */
+void nv12_mjpeg_packet_release(NV12MJPEGPacket** pkt);
+
+// Max metadata segments per scattered frame, and max payload of one segment
+#define NV12_MJPEG_MAX_SEGMENTS 8
+#define NV12_MJPEG_MAX_SEGMENT_SIZE 65533
+
+/**
+ * Metadata segment to insert into a JPEG (timestamps, camera IDs, GPS, ...)
+ */
+typedef struct NV12MJPEGSegment {
+    uint8_t marker;               // APPn (0xE0-0xEF) or COM (0xFE)
+    const uint8_t* data;          // Payload without marker and length (caller-owned)
+    size_t size;                  // Payload size in bytes (0-65533)
+} NV12MJPEGSegment;
+
+/**
+ * JPEG with metadata as an iovec list for writev()/sendmsg(): the start of
+ * the bitstream (SOI and a leading JFIF APP0), each segment's marker and
+ * length, its payload, then the rest of the bitstream. The entropy-coded
+ * data is never copied.
+ */
+typedef struct NV12MJPEGScatter {
+    NV12MJPEGPacket* pkt;         // Encoded frame the iovecs point into (encoder_encode_scatter())
+    struct iovec iov[2 + 2 * NV12_MJPEG_MAX_SEGMENTS];
+    int iov_count;
+    size_t total_size;            // Sum of the iovec lengths
+    uint8_t headers[NV12_MJPEG_MAX_SEGMENTS][4];  // Segment markers and lengths
+} NV12MJPEGScatter;
+
+/**
+ * Describe an encoded JPEG with metadata segments inserted, without copying
+ * 
+ * The iovecs point into jpeg, segment payloads and out itself, which must all
+ * stay valid (and out unmoved) until the data is written. Segments go after
+ * SOI, or after the JFIF APP0 segment if the JPEG starts with one.
+ * 
+ * @param jpeg Encoded JPEG (e.g. NV12MJPEGPacket data or encoder_encode_to_buffer() output)
+ * @param size JPEG size in bytes
+ * @param segments Metadata segments, inserted in order
+ * @param num_segments Number of segments (0-NV12_MJPEG_MAX_SEGMENTS)
+ * @param out Scatter list output (out->pkt is not touched)
+ * @return 0 on success, -EINVAL on invalid segments or if jpeg does not start with SOI
+ */
+int nv12_mjpeg_scatter(const uint8_t* jpeg, size_t size, const NV12MJPEGSegment* segments, int num_segments,
+                       NV12MJPEGScatter* out);
+
+/**
+ * Encode NV12 frame and return it with metadata segments as an iovec list
+ * 
+ * Same as encoder_encode_packet() followed by nv12_mjpeg_scatter(); out holds
+ * the packet reference until nv12_mjpeg_scatter_release().
+ * 
+ * @param encoder Encoder context (no frames in flight)
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param segments Metadata segments, inserted in order
+ * @param num_segments Number of segments (0-NV12_MJPEG_MAX_SEGMENTS)
+ * @param out Scatter list output
+ * @return 0 on success, negative error code on failure (nothing to release)
+ */
+int encoder_encode_scatter(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data,
+                           const NV12MJPEGSegment* segments, int num_segments, NV12MJPEGScatter* out);
+
+/**
+ * Release the packet reference of a scatter list
+ * 
+ * @param out Scatter list (can be NULL or hold no packet)
+ */
+void nv12_mjpeg_scatter_release(NV12MJPEGScatter* out);
+
+/**
+ * Encode a batch of NV12 frames
+ * 
+ * Parameters are validated once for the whole batch, then the frames are
+ * pipelined through the asynchronous queue (up to queue_depth in flight)
+ * without per-frame logging. Frames are independent: one frame failing
+ * (e.g. output too small) does not stop the others. Packets are collected as
+ * the codec finishes them; the session is flushed (like encoder_drain()) only
+ * if the codec still holds frames back once the whole batch is sent.
+ * 
+ * @param encoder Encoder context (no frames in flight, no completion callback)
+ * @param frames Input NV12 frames (width*height*3/2 bytes each)
+ * @param n Number of frames
+ * @param outputs Output buffers, one per frame
+ * @param sizes In: capacity of each output buffer. Out: encoded size of each
+ *              frame (required size when its status is -ENOMEM, 0 on other errors)
+ * @param status Out: per-frame status (0 or negative error code)
+ * @return Number of frames encoded successfully, or negative error code if the
+ *         batch could not run (-EINVAL, -EBUSY) or the codec failed (remaining
+ *         frames get the same error in status[])
+ */
+int encoder_encode_batch(NV12MJPEGEncoder* encoder, const uint8_t* frames[], int n,
+                         uint8_t* outputs[], size_t sizes[], int status[]);
+
 /**
  * Get maximum possible output size for encoded MJPEG frame
  * 
@@ -120,6 +958,48 @@ int encoder_encode_to_buffer(NV12MJPEGEncoder* encoder, const uint8_t* nv12_data
  */
 size_t encoder_max_output_size(const NV12MJPEGEncoder* encoder);
 
+/**
+ * Encoder statistics
+ */
+typedef struct NV12MJPEGEncoderStats {
+    uint64_t frames_encoded;      // Packets produced (synchronous and asynchronous)
+    double last_encode_ms;        // Wall time of the last synchronous encode call
+    int last_quality;             // Quality of the last frame sent to the encoder
+    double last_compression_ratio;  // Raw NV12 size / encoded size of the last synchronous encode
+    uint64_t rc_retries;          // Frames re-encoded by size-targeted rate control
+    uint64_t rc_over_target;      // Frames still larger than the target after rate control
+    int64_t last_huffman_saved;   // Bytes saved by optimized Huffman tables on the last native frame
+                                  // (estimate against the standard tables, 0 when not optimized)
+    int64_t total_huffman_saved;  // Sum of last_huffman_saved over all frames
+    uint64_t last_slot_padding;   // Padding bytes in the last slot (encoder_set_slot_size())
+    uint64_t total_slot_padding;  // Sum of last_slot_padding over all slots
+    uint64_t dedup_hits;          // Frames answered with the last output (encoder_set_dedup())
+    double last_hash_ms;          // Time spent measuring the last frame for deduplication
+    double total_hash_ms;         // Sum of last_hash_ms over all measured frames
+    double last_motion_score;     // Changed-block fraction of the last frame checked by the gate (0-1)
+    uint32_t last_motion_max_sad; // Largest 16x16 block SAD of that frame
+    uint64_t motion_skipped;      // Frames skipped by the motion gate
+    uint64_t motion_reduced;      // Frames encoded at the gate's reduced quality
+    uint64_t failovers;           // Codec failures recovered by switching to the hot spare
+    double last_failover_ms;      // Swap + retry time of the last failover (frame delay it caused)
+    double last_spare_build_ms;   // Background time to close the failed context and open a spare
+    double last_sim_latency_ms;   // Simulated backend: modeled submit-to-completion time of the last frame
+    double total_sim_wait_ms;     // Simulated backend: time frames waited for a busy engine or session
+    uint64_t sim_overruns;        // Simulated backend: frames the software encode delivered after the modeled time
+    uint64_t session_reopens;     // Codec contexts reopened to start a new session (after a flush or an error)
+    int num_strips;               // Strips timed for the last native encode (0 for codec backends)
+    double strip_encode_ms[NV12_MJPEG_MAX_STRIPS];  // Per-strip encode time of that frame
+} NV12MJPEGEncoderStats;
+
+/**
+ * Get encoder statistics
+ * 
+ * @param encoder Encoder context
+ * @param stats Statistics output
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int encoder_get_stats(const NV12MJPEGEncoder* encoder, NV12MJPEGEncoderStats* stats);
+
 /**
  * Destroy encoder and free all resources
  * 
@@ -127,6 +1007,179 @@ size_t encoder_max_output_size(const NV12MJPEGEncoder* encoder);
  */
 void encoder_destroy(NV12MJPEGEncoder* encoder);
 
+// ============================================================================
+// Encoder Pool (Multi-Instance, Thread-Safe)
+// ============================================================================
+
+/**
+ * Opaque pool of encoder instances, one worker thread per instance
+ * 
+ * Frames can be submitted from any thread. Each worker encodes with its own
+ * NV12MJPEGEncoder, so instances run concurrently (multiple hardware sessions
+ * on the board, all cores with the software backend). Packets are returned in
+ * submission order: a reorder buffer holds frames that finish early.
+ */
+typedef struct NV12MJPEGEncoderPool NV12MJPEGEncoderPool;
+
+/**
+ * Create encoder pool
+ * 
+ * @param opts Options used for every instance (see encoder_options_init());
+ *             set verbose = 0 to keep per-frame logs of the workers quiet
+ * @param num_instances Number of encoder instances/threads (<= 0: one per online CPU)
+ * @param max_pending Max frames between submit and receive (<= 0: 2 * num_instances)
+ * @return Pool, or NULL on failure
+ */
+NV12MJPEGEncoderPool* encoder_pool_create(const NV12MJPEGEncoderOptions* opts, int num_instances,
+                                          int max_pending);
+
+/**
+ * Submit NV12 frame to the pool (thread-safe)
+ * 
+ * The input is not copied at submit time. With a release callback the worker
+ * encodes it zero-copy and release(release_opaque, nv12_data) is called once
+ * the encoder no longer needs it. Without a release callback the buffer must
+ * stay valid until the frame is returned by encoder_pool_receive().
+ * 
+ * @param pool Encoder pool
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param release Input release callback (can be NULL)
+ * @param release_opaque User pointer passed to release
+ * @param user_data Pointer handed back by encoder_pool_receive()
+ * @param timeout_ms Max time to wait while max_pending frames are outstanding
+ * @return 0 on success, -EAGAIN if the pool stayed full, -EINVAL on invalid parameters
+ */
+int encoder_pool_submit(NV12MJPEGEncoderPool* pool, const uint8_t* nv12_data,
+                        nv12_buffer_release_fn release, void* release_opaque,
+                        void* user_data, int timeout_ms);
+
+/**
+ * Receive the next encoded frame in submission order (thread-safe)
+ * 
+ * @param pool Encoder pool
+ * @param out_buffer Output buffer (pre-allocated by user)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size
+ * @param user_data Pointer to store the frame's user_data (can be NULL)
+ * @param timeout_ms Max time to wait for the frame, 0 to return immediately
+ * @return 0 on success, or the frame's encode error. Also:
+ *   -EAGAIN: Nothing submitted, or the next frame is not done within timeout_ms
+ *   -ENOMEM: Output buffer too small (*out_size holds the required size,
+ *            the frame stays queued)
+ */
+int encoder_pool_receive(NV12MJPEGEncoderPool* pool, uint8_t* out_buffer, size_t buffer_size,
+                         size_t* out_size, void** user_data, int timeout_ms);
+
+/**
+ * Get number of frames submitted but not yet received
+ * 
+ * @param pool Encoder pool
+ * @return Pending frames
+ */
+int encoder_pool_pending(NV12MJPEGEncoderPool* pool);
+
+/**
+ * Stop the workers and destroy the pool
+ * 
+ * Frames not yet received are dropped; inputs not yet encoded are released.
+ * 
+ * @param pool Encoder pool (can be NULL)
+ */
+void encoder_pool_destroy(NV12MJPEGEncoderPool* pool);
+
+// ============================================================================
+// Encoder Cache (Multi-Resolution, Thread-Safe)
+// ============================================================================
+
+/**
+ * Opaque cache of opened encoder instances keyed by (width, height, quality)
+ * 
+ * For services that encode at a handful of configurations: each one is opened
+ * once (avcodec_open2, frame buffers) and reused by later requests. Idle
+ * instances are destroyed least recently used first when the estimated memory
+ * of all instances exceeds the cap.
+ */
+typedef struct NV12MJPEGEncoderCache NV12MJPEGEncoderCache;
+
+/**
+ * Encoder cache counters
+ */
+typedef struct NV12MJPEGEncoderCacheStats {
+    uint64_t hits;                // Requests served by an opened instance
+    uint64_t misses;              // Requests that opened a new instance
+    uint64_t evictions;           // Instances destroyed to stay under the memory cap
+    int entries;                  // Instances currently cached (idle or in use)
+    size_t memory_bytes;          // Estimated memory of the cached instances
+} NV12MJPEGEncoderCacheStats;
+
+/**
+ * Create encoder cache
+ * 
+ * @param opts Options for every instance (see encoder_options_init()); width,
+ *             height and quality are replaced by the requested ones
+ * @param memory_cap Memory cap in bytes for the cached instances (0: 64 MiB).
+ *                   Instances in use are never evicted, so the cap can be
+ *                   exceeded while they are held.
+ * @return Cache, or NULL on failure
+ */
+NV12MJPEGEncoderCache* encoder_cache_create(const NV12MJPEGEncoderOptions* opts, size_t memory_cap);
+
+/**
+ * Take an encoder for one configuration (thread-safe)
+ * 
+ * The instance is exclusive to the caller until encoder_cache_release(). If the
+ * cached instance of this configuration is held by another caller, a second
+ * one is opened.
+ * 
+ * @param cache Encoder cache
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ * @param quality Encoding quality (see encoder_create())
+ * @return Encoder, or NULL on failure
+ */
+NV12MJPEGEncoder* encoder_cache_acquire(NV12MJPEGEncoderCache* cache, int width, int height, int quality);
+
+/**
+ * Return an encoder taken with encoder_cache_acquire() (thread-safe)
+ * 
+ * @param cache Encoder cache
+ * @param encoder Encoder to return (do not use it afterwards)
+ */
+void encoder_cache_release(NV12MJPEGEncoderCache* cache, NV12MJPEGEncoder* encoder);
+
+/**
+ * Encode NV12 frame with the cached encoder of its configuration (thread-safe)
+ * 
+ * @param cache Encoder cache
+ * @param nv12_data Input NV12 frame data (width*height*3/2 bytes)
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ * @param quality Encoding quality
+ * @param out_buffer Output buffer (pre-allocated by user)
+ * @param buffer_size Size of output buffer in bytes
+ * @param out_size Pointer to store actual encoded size
+ * @return 0 on success, negative error code on failure (same codes as
+ *         encoder_encode_to_buffer(); -ENOMEM if no encoder could be opened)
+ */
+int encoder_cache_encode(NV12MJPEGEncoderCache* cache, const uint8_t* nv12_data, int width, int height,
+                         int quality, uint8_t* out_buffer, size_t buffer_size, size_t* out_size);
+
+/**
+ * Get encoder cache counters
+ * 
+ * @param cache Encoder cache
+ * @param stats Pointer to store the counters
+ * @return 0 on success, -EINVAL on invalid parameters
+ */
+int encoder_cache_get_stats(NV12MJPEGEncoderCache* cache, NV12MJPEGEncoderCacheStats* stats);
+
+/**
+ * Destroy the cache and every cached encoder
+ * 
+ * @param cache Encoder cache (can be NULL); all encoders must have been released
+ */
+void encoder_cache_destroy(NV12MJPEGEncoderCache* cache);
+
 // ============================================================================
 // Persistent Decoder Context (New API for Resident Services)
 // ============================================================================
@@ -139,6 +1192,14 @@ void encoder_destroy(NV12MJPEGEncoder* encoder);
  */
 typedef struct NV12MJPEGDecoder NV12MJPEGDecoder;
 
+/**
+ * Decoder backend selection
+ */
+typedef enum NV12MJPEGDecoderBackend {
+    NV12_MJPEG_DECODER_SOFTWARE = 0,  // libavcodec software decoder (mjpeg), default
+    NV12_MJPEG_DECODER_TURBOJPEG,     // libjpeg-turbo planar YUV decoder (make TURBOJPEG=1)
+} NV12MJPEGDecoderBackend;
+
 /**
  * Create persistent MJPEG decoder with pre-allocated resources
  * 
@@ -150,6 +1211,34 @@ typedef struct NV12MJPEGDecoder NV12MJPEGDecoder;
  */
 NV12MJPEGDecoder* decoder_create(void);
 
+/**
+ * Create persistent MJPEG decoder with the selected backend
+ * 
+ * Same as decoder_create(), which uses NV12_MJPEG_DECODER_SOFTWARE. The
+ * TurboJPEG backend decodes with libjpeg-turbo straight into the output Y
+ * plane and interleaves the chroma planes into the UV plane (SSE2/NEON),
+ * without the libavcodec frame copy or a pixel format conversion. 4:2:2,
+ * 4:4:4 and other subsamplings are averaged to 4:2:0; grayscale frames get
+ * neutral chroma. Abbreviated frames need libjpeg-turbo 2.1 or later.
+ * 
+ * @param backend Decoder backend
+ * @return Decoder context, or NULL on failure (or backend not built in)
+ */
+NV12MJPEGDecoder* decoder_create_with_backend(NV12MJPEGDecoderBackend backend);
+
+/**
+ * Load tables for decoding abbreviated JPEG frames
+ * 
+ * Primes the decoder with a tables-only stream from encoder_get_tables().
+ * They stay in effect until replaced by later tables or by a complete frame.
+ * 
+ * @param decoder Decoder context
+ * @param tables Tables-only JPEG stream (SOI, DQT, DHT, EOI)
+ * @param tables_size Size of the stream in bytes
+ * @return 0 on success, negative error code on failure
+ */
+int decoder_set_tables(NV12MJPEGDecoder* decoder, const uint8_t* tables, size_t tables_size);
+
 /**
  * Decode MJPEG frame to NV12 in user-provided buffer
  * 
@@ -173,6 +1262,24 @@ int decoder_decode_from_buffer(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_d
                                 uint8_t* out_nv12_buffer, size_t buffer_size,
                                 int* out_width, int* out_height);
 
+/**
+ * Decode MJPEG frame to NV12 planes described by the caller
+ * 
+ * The decoded picture is written to the top-left of out_frame, row by row with
+ * the descriptor strides.
+ * 
+ * @param decoder Decoder context from decoder_create()
+ * @param mjpeg_data Input MJPEG compressed data
+ * @param mjpeg_size Size of MJPEG data in bytes
+ * @param out_frame Output planes; width/height are the capacity in pixels
+ * @param out_width Pointer to store decoded frame width
+ * @param out_height Pointer to store decoded frame height
+ * @return 0 on success, negative error code on failure
+ *         (-ENOMEM: decoded frame larger than out_frame)
+ */
+int decoder_decode_to_frame(NV12MJPEGDecoder* decoder, const uint8_t* mjpeg_data, size_t mjpeg_size,
+                            const NV12FrameDesc* out_frame, int* out_width, int* out_height);
+
 /**
  * Destroy decoder and free all resources
  * 
@@ -201,6 +1308,15 @@ uint64_t get_time_ns(void);
  */
 int64_t get_file_size(const char* filename);
 
+/**
+ * Get the JPEG length inside a slot written in slot mode (encoder_set_slot_size())
+ * 
+ * @param slot Slot data
+ * @param slot_size Slot size in bytes
+ * @return JPEG size in bytes (the padding after EOI excluded), or 0 if the slot holds no JPEG
+ */
+size_t nv12_mjpeg_slot_jpeg_size(const uint8_t* slot, size_t slot_size);
+
 /**
  * Calculate NV12 frame size in bytes
  * 
@@ -212,6 +1328,23 @@ static inline size_t nv12_frame_size(int width, int height) {
     return (size_t)width * (size_t)height * 3 / 2;
 }
 
+/**
+ * Describe a contiguous NV12 buffer (stride == width, UV right after Y)
+ * 
+ * @param desc Descriptor to fill
+ * @param nv12_data NV12 buffer of nv12_frame_size(width, height) bytes
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ */
+static inline void nv12_frame_desc_init(NV12FrameDesc* desc, uint8_t* nv12_data, int width, int height) {
+    desc->width = width;
+    desc->height = height;
+    desc->y = nv12_data;
+    desc->y_stride = width;
+    desc->uv = nv12_data + (size_t)width * height;
+    desc->uv_stride = width;
+}
+
 #ifdef __cplusplus
 }
 #endif
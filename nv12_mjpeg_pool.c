@@ -0,0 +1,345 @@
+/*
+ * NV12 → MJPEG Encoder Pool
+ *
+ * Runs N independent encoder instances, each on its own worker thread.
+ * Frames can be submitted from any thread; encoded packets are handed back
+ * strictly in submission order through a reorder buffer.
+ */
+
+#include "nv12_mjpeg_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// ============================================================================
+// Pool Data Structures
+// ============================================================================
+
+typedef enum {
+    POOL_SLOT_FREE = 0,           // Not in use
+    POOL_SLOT_QUEUED,             // Submitted, waiting for a worker
+    POOL_SLOT_ENCODING,           // Taken by a worker
+    POOL_SLOT_DONE,               // Encoded, waiting for encoder_pool_receive()
+} PoolSlotState;
+
+// One entry of the reorder buffer, indexed by sequence number % capacity
+typedef struct {
+    PoolSlotState state;
+    uint64_t seq;                 // Submission sequence number
+    const uint8_t* nv12_data;     // Input frame (caller-owned)
+    nv12_buffer_release_fn release;  // Input release callback (can be NULL)
+    void* release_opaque;         // User pointer for release
+    void* user_data;              // Handed back with the packet
+    uint8_t* out_buffer;          // Encoded packet (max output size)
+    size_t out_size;              // Encoded size
+    int status;                   // Encode result
+} PoolSlot;
+
+typedef struct {
+    struct NV12MJPEGEncoderPool* pool;
+    NV12MJPEGEncoder* encoder;    // Instance owned by this worker
+    pthread_t thread;
+    int started;
+} PoolWorker;
+
+struct NV12MJPEGEncoderPool {
+    PoolWorker* workers;
+    int num_workers;
+    
+    PoolSlot* slots;              // Reorder buffer
+    int capacity;                 // Max frames between submit and receive
+    size_t out_buffer_size;       // Per-slot output buffer size
+    
+    uint64_t next_seq;            // Next sequence number to assign
+    uint64_t next_dispatch;       // Next sequence number for a worker
+    uint64_t next_receive;        // Next sequence number to hand back
+    
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;     // Queued frame available / stopping
+    pthread_cond_t done_cond;     // Slot finished encoding
+    pthread_cond_t space_cond;    // Slot freed by receive
+    int stop;
+};
+
+// ============================================================================
+// Worker Thread
+// ============================================================================
+
+static void* pool_worker_main(void* arg) {
+    PoolWorker* worker = (PoolWorker*)arg;
+    NV12MJPEGEncoderPool* pool = worker->pool;
+
+#ifdef _OPENMP
+    // Parallelism comes from the workers; avoid nested OpenMP teams per copy
+    omp_set_num_threads(1);
+#endif
+    
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->next_dispatch == pool->next_seq) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        
+        PoolSlot* slot = &pool->slots[pool->next_dispatch % pool->capacity];
+        pool->next_dispatch++;
+        slot->state = POOL_SLOT_ENCODING;
+        pthread_mutex_unlock(&pool->lock);
+        
+        // Encode outside the lock; instances are never shared between workers
+        size_t out_size = 0;
+        int ret;
+        if (slot->release) {
+            ret = encoder_encode_zero_copy(worker->encoder, slot->nv12_data,
+                                           slot->release, slot->release_opaque,
+                                           slot->out_buffer, pool->out_buffer_size, &out_size);
+        } else {
+            ret = encoder_encode_to_buffer(worker->encoder, slot->nv12_data,
+                                           slot->out_buffer, pool->out_buffer_size, &out_size);
+        }
+        
+        pthread_mutex_lock(&pool->lock);
+        slot->status = ret;
+        slot->out_size = ret == 0 ? out_size : 0;
+        slot->state = POOL_SLOT_DONE;
+        pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    
+    return NULL;
+}
+
+// ============================================================================
+// Pool API
+// ============================================================================
+
+// Absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static struct timespec pool_deadline(int timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+NV12MJPEGEncoderPool* encoder_pool_create(const NV12MJPEGEncoderOptions* opts, int num_instances,
+                                          int max_pending) {
+    if (!opts) {
+        return NULL;
+    }
+    
+    // Default: one instance per online CPU (useful for the software backend)
+    if (num_instances <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_instances = cpus > 0 ? (int)cpus : 1;
+    }
+    if (max_pending <= 0) {
+        max_pending = num_instances * 2;
+    }
+    if (max_pending < num_instances) {
+        fprintf(stderr, "Invalid pool size: max_pending %d < instances %d\n", max_pending, num_instances);
+        return NULL;
+    }
+    
+    NV12MJPEGEncoderPool* pool = (NV12MJPEGEncoderPool*)calloc(1, sizeof(NV12MJPEGEncoderPool));
+    if (!pool) {
+        fprintf(stderr, "Failed to allocate encoder pool\n");
+        return NULL;
+    }
+    
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pthread_cond_init(&pool->space_cond, NULL);
+    
+    pool->num_workers = num_instances;
+    pool->capacity = max_pending;
+    pool->workers = (PoolWorker*)calloc(num_instances, sizeof(PoolWorker));
+    pool->slots = (PoolSlot*)calloc(max_pending, sizeof(PoolSlot));
+    if (!pool->workers || !pool->slots) {
+        fprintf(stderr, "Failed to allocate encoder pool\n");
+        encoder_pool_destroy(pool);
+        return NULL;
+    }
+    
+    // Create all instances before starting any thread
+    for (int i = 0; i < num_instances; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].encoder = encoder_create_with_options(opts);
+        if (!pool->workers[i].encoder) {
+            fprintf(stderr, "Failed to create pool encoder %d/%d\n", i + 1, num_instances);
+            encoder_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    
+    pool->out_buffer_size = encoder_max_output_size(pool->workers[0].encoder);
+    for (int i = 0; i < max_pending; i++) {
+        pool->slots[i].out_buffer = (uint8_t*)malloc(pool->out_buffer_size);
+        if (!pool->slots[i].out_buffer) {
+            fprintf(stderr, "Failed to allocate pool output buffer\n");
+            encoder_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    
+    for (int i = 0; i < num_instances; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, pool_worker_main, &pool->workers[i]) != 0) {
+            fprintf(stderr, "Failed to start pool worker %d\n", i);
+            encoder_pool_destroy(pool);
+            return NULL;
+        }
+        pool->workers[i].started = 1;
+    }
+    
+    return pool;
+}
+
+int encoder_pool_submit(NV12MJPEGEncoderPool* pool, const uint8_t* nv12_data,
+                        nv12_buffer_release_fn release, void* release_opaque,
+                        void* user_data, int timeout_ms) {
+    if (!pool || !nv12_data) {
+        return -EINVAL;
+    }
+    
+    struct timespec deadline = pool_deadline(timeout_ms > 0 ? timeout_ms : 0);
+    
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next_seq - pool->next_receive >= (uint64_t)pool->capacity) {
+        if (timeout_ms == 0 ||
+            pthread_cond_timedwait(&pool->space_cond, &pool->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&pool->lock);
+            return -EAGAIN;
+        }
+    }
+    
+    PoolSlot* slot = &pool->slots[pool->next_seq % pool->capacity];
+    slot->seq = pool->next_seq;
+    slot->nv12_data = nv12_data;
+    slot->release = release;
+    slot->release_opaque = release_opaque;
+    slot->user_data = user_data;
+    slot->out_size = 0;
+    slot->status = 0;
+    slot->state = POOL_SLOT_QUEUED;
+    pool->next_seq++;
+    
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    
+    return 0;
+}
+
+int encoder_pool_receive(NV12MJPEGEncoderPool* pool, uint8_t* out_buffer, size_t buffer_size,
+                         size_t* out_size, void** user_data, int timeout_ms) {
+    if (!pool || !out_buffer || !out_size) {
+        return -EINVAL;
+    }
+    
+    struct timespec deadline = pool_deadline(timeout_ms > 0 ? timeout_ms : 0);
+    
+    pthread_mutex_lock(&pool->lock);
+    if (pool->next_receive == pool->next_seq) {
+        pthread_mutex_unlock(&pool->lock);
+        return -EAGAIN;
+    }
+    
+    // Later frames may already be done; only the oldest one can be returned
+    PoolSlot* slot = &pool->slots[pool->next_receive % pool->capacity];
+    while (slot->state != POOL_SLOT_DONE) {
+        if (timeout_ms == 0 ||
+            pthread_cond_timedwait(&pool->done_cond, &pool->lock, &deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&pool->lock);
+            return -EAGAIN;
+        }
+    }
+    
+    int ret = slot->status;
+    *out_size = slot->out_size;
+    if (ret == 0 && slot->out_size > buffer_size) {
+        // Keep the frame so the caller can retry with a larger buffer
+        pthread_mutex_unlock(&pool->lock);
+        return -ENOMEM;
+    }
+    if (ret == 0) {
+        memcpy(out_buffer, slot->out_buffer, slot->out_size);
+    }
+    if (user_data) {
+        *user_data = slot->user_data;
+    }
+    
+    slot->state = POOL_SLOT_FREE;
+    pool->next_receive++;
+    pthread_cond_signal(&pool->space_cond);
+    pthread_mutex_unlock(&pool->lock);
+    
+    return ret;
+}
+
+int encoder_pool_pending(NV12MJPEGEncoderPool* pool) {
+    if (!pool) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    int pending = (int)(pool->next_seq - pool->next_receive);
+    pthread_mutex_unlock(&pool->lock);
+    
+    return pending;
+}
+
+void encoder_pool_destroy(NV12MJPEGEncoderPool* pool) {
+    if (!pool) {
+        return;
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    
+    if (pool->workers) {
+        for (int i = 0; i < pool->num_workers; i++) {
+            if (pool->workers[i].started) {
+                pthread_join(pool->workers[i].thread, NULL);
+            }
+            encoder_destroy(pool->workers[i].encoder);
+        }
+        free(pool->workers);
+    }
+    
+    if (pool->slots) {
+        // Frames never picked up by a worker still own their input buffer
+        for (uint64_t seq = pool->next_dispatch; seq < pool->next_seq; seq++) {
+            PoolSlot* slot = &pool->slots[seq % pool->capacity];
+            if (slot->release) {
+                slot->release(slot->release_opaque, (uint8_t*)slot->nv12_data);
+            }
+        }
+        for (int i = 0; i < pool->capacity; i++) {
+            free(pool->slots[i].out_buffer);
+        }
+        free(pool->slots);
+    }
+    
+    pthread_cond_destroy(&pool->space_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
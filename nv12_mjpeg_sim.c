@@ -0,0 +1,152 @@
+/*
+ * Simulated MJPEG Hardware Encoder Device
+ *
+ * Completion-time model of the Rockchip MPP JPEG encoder for
+ * NV12_MJPEG_BACKEND_SIMULATED. Every simulated encoder is a session on one
+ * process-wide device: sessions process their frames one at a time, and all
+ * sessions share the device's engines. Per-frame hardware time is drawn from
+ * the session's latency distribution.
+ */
+
+#include "nv12_mjpeg_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+// Pixel count the configured latency refers to
+#define SIM_REFERENCE_PIXELS (1920.0 * 1080.0)
+
+// Shortest hardware time of a frame (register setup and interrupt)
+#define SIM_MIN_FRAME_MS 0.05
+
+// ============================================================================
+// Device and Session State
+// ============================================================================
+
+static struct {
+    pthread_mutex_t lock;
+    int sessions;                            // Sessions open
+    uint64_t engine_free[NV12_MJPEG_SIM_MAX_CORES];  // Time each engine finishes its last frame
+} sim_device = { PTHREAD_MUTEX_INITIALIZER, 0, { 0 } };
+
+struct SimSession {
+    NV12MJPEGSimulation config;
+    double frame_scale;                      // Frame pixels / SIM_REFERENCE_PIXELS
+    uint64_t rng;                            // xorshift64* state
+    uint64_t last_done;                      // Completion time of the session's last frame
+};
+
+// ============================================================================
+// Latency Distribution
+// ============================================================================
+
+// Uniform in (0, 1)
+static double sim_uniform(SimSession* session) {
+    uint64_t x = session->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    session->rng = x;
+    return ((x * 0x2545F4914F6CDD1DULL >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// Hardware time of one frame: scaled mean + Gaussian jitter + occasional exponential stall
+static double sim_frame_ms(SimSession* session) {
+    const NV12MJPEGSimulation* config = &session->config;
+    double ms = config->latency_ms * session->frame_scale;
+    
+    if (config->jitter_ms > 0.0) {
+        // Box-Muller
+        double u1 = sim_uniform(session);
+        double u2 = sim_uniform(session);
+        ms += config->jitter_ms * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+    }
+    if (config->tail_probability > 0.0 && sim_uniform(session) < config->tail_probability) {
+        ms += -config->tail_ms * log(sim_uniform(session));
+    }
+    
+    return ms < SIM_MIN_FRAME_MS ? SIM_MIN_FRAME_MS : ms;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+SimSession* sim_session_open(const NV12MJPEGSimulation* config, int width, int height) {
+    if (!config || config->latency_ms < 0.0 || config->jitter_ms < 0.0 || config->tail_ms < 0.0 ||
+        config->tail_probability < 0.0 || config->tail_probability > 1.0 ||
+        config->cores < 1 || config->cores > NV12_MJPEG_SIM_MAX_CORES || config->max_sessions < 1) {
+        fprintf(stderr, "Invalid simulated encoder parameters\n");
+        return NULL;
+    }
+    
+    SimSession* session = (SimSession*)calloc(1, sizeof(SimSession));
+    if (!session) {
+        fprintf(stderr, "Failed to allocate simulated session\n");
+        return NULL;
+    }
+    session->config = *config;
+    session->frame_scale = (double)width * height / SIM_REFERENCE_PIXELS;
+    
+    // splitmix64 of the seed: distinct, never-zero xorshift states for nearby seeds
+    uint64_t z = (uint64_t)config->seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    session->rng = (z ^ (z >> 31)) | 1;
+    
+    pthread_mutex_lock(&sim_device.lock);
+    if (sim_device.sessions >= config->max_sessions) {
+        int open = sim_device.sessions;
+        pthread_mutex_unlock(&sim_device.lock);
+        fprintf(stderr, "Simulated encoder busy: %d of %d sessions open\n", open, config->max_sessions);
+        free(session);
+        return NULL;
+    }
+    sim_device.sessions++;
+    pthread_mutex_unlock(&sim_device.lock);
+    
+    return session;
+}
+
+uint64_t sim_session_schedule(SimSession* session, uint64_t submit_ns, double* wait_ms) {
+    uint64_t frame_ns = (uint64_t)(sim_frame_ms(session) * 1000000.0);
+    
+    pthread_mutex_lock(&sim_device.lock);
+    
+    // Earliest free engine; the frame also waits for the session's previous frame
+    int engine = 0;
+    for (int e = 1; e < session->config.cores; e++) {
+        if (sim_device.engine_free[e] < sim_device.engine_free[engine]) {
+            engine = e;
+        }
+    }
+    uint64_t start = submit_ns;
+    if (sim_device.engine_free[engine] > start) {
+        start = sim_device.engine_free[engine];
+    }
+    if (session->last_done > start) {
+        start = session->last_done;
+    }
+    uint64_t done = start + frame_ns;
+    sim_device.engine_free[engine] = done;
+    
+    pthread_mutex_unlock(&sim_device.lock);
+    
+    session->last_done = done;
+    if (wait_ms) {
+        *wait_ms = (start - submit_ns) / 1000000.0;
+    }
+    return done;
+}
+
+void sim_session_close(SimSession* session) {
+    if (!session) {
+        return;
+    }
+    pthread_mutex_lock(&sim_device.lock);
+    sim_device.sessions--;
+    pthread_mutex_unlock(&sim_device.lock);
+    free(session);
+}
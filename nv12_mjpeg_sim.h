@@ -0,0 +1,52 @@
+/*
+ * Simulated MJPEG Hardware Encoder Device (internal)
+ *
+ * Timing model behind NV12_MJPEG_BACKEND_SIMULATED: a process-wide device with
+ * a session limit and a few encode engines, and a per-session latency
+ * distribution. Only computes completion times; the codec library encodes
+ * the frames. Not part of the public API.
+ */
+
+#ifndef NV12_MJPEG_SIM_H
+#define NV12_MJPEG_SIM_H
+
+#include "nv12_mjpeg_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SimSession SimSession;
+
+/**
+ * Open a session on the simulated device
+ *
+ * @param config Timing model (copied)
+ * @param width Frame width in pixels
+ * @param height Frame height in pixels
+ * @return Session, or NULL on invalid parameters or when config->max_sessions are open
+ */
+SimSession* sim_session_open(const NV12MJPEGSimulation* config, int width, int height);
+
+/**
+ * Schedule a frame sent at submit_ns (get_time_ns() clock) on the device
+ *
+ * @param session Simulated session
+ * @param submit_ns Time the frame was handed to the encoder
+ * @param wait_ms Receives the time the frame waits for the session or an engine
+ * @return Time the simulated hardware finishes the frame
+ */
+uint64_t sim_session_schedule(SimSession* session, uint64_t submit_ns, double* wait_ms);
+
+/**
+ * Close a session
+ *
+ * @param session Simulated session (can be NULL)
+ */
+void sim_session_close(SimSession* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NV12_MJPEG_SIM_H